@@ -0,0 +1,280 @@
+#include "benchmark/benchmark.h"
+
+#include "clad/Differentiator/Differentiator.h"
+
+#include "BenchmarkedFunctions.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fstream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Sweep the input dimension n from 2 to 1024 for the Hessian, the Jacobian,
+// vector forward mode and repeated forward mode. Each benchmark reports the
+// time, the number of allocations per execution and the size of the source of
+// the generated derivatives, to expose the asymptotic cost of each mode.
+
+// The functions are differentiated outside of the anonymous namespace, so
+// that their derivatives are written to the derivative library.
+
+///\returns the sum of the squares of the elements of \p x.
+double sumOfSquares(const double* x, int n) {
+  double s = 0;
+  for (int i = 0; i < n; i++)
+    s += x[i] * x[i];
+  return s;
+}
+
+///\returns the sum of the cubes of the elements of \p x.
+double sumOfCubes(const double* x, int n) {
+  double s = 0;
+  for (int i = 0; i < n; i++)
+    s += x[i] * x[i] * x[i];
+  return s;
+}
+
+/// Jacobian mode differentiates the expressions assigned to the outputs, so
+/// the loops are in functions whose pullbacks fill the rows of the Jacobian.
+void sumsOfPowers(const double* x, int n, double* out) {
+  out[0] = sumOfSquares(x, n);
+  out[1] = sumOfCubes(x, n);
+}
+
+///\returns the gaussian distribution where the element \p i of \p x is moved
+/// by \p t, i.e. the directional derivative w.r.t. \p t is the derivative
+/// w.r.t. x[i].
+double gausShifted(double* x, double* p, double sigma, int dim, int i,
+                   double t) {
+  double r = 0;
+  for (int j = 0; j < dim; j++) {
+    double xj = x[j];
+    if (j == i)
+      xj += t;
+    r += (xj - p[j]) * (xj - p[j]);
+  }
+  r = -r / (2 * sigma * sigma);
+  return std::pow(2 * M_PI, -dim / 2.0) * std::pow(sigma, -0.5) * std::exp(r);
+}
+
+namespace {
+size_t g_NumAllocs = 0;
+
+bool isIdentifierChar(char c) {
+  return std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+}
+
+/// \returns the name of the function defined or declared by \p code.
+std::string getDefinedName(const std::string& code) {
+  size_t end = code.find('(');
+  if (end == std::string::npos)
+    return "";
+  size_t begin = end;
+  while (begin && isIdentifierChar(code[begin - 1]))
+    --begin;
+  return code.substr(begin, end - begin);
+}
+
+/// \returns the definitions of the derivative library written by the plugin
+/// for this file, see CLAD_DERIVATIVE_LIBRARY_DIR in CMakeLists.txt, by name.
+const std::map<std::string, std::string>& getLibraryDefinitions() {
+  static const std::map<std::string, std::string> definitions = [] {
+    std::map<std::string, std::string> defs;
+#ifdef CLAD_DERIVATIVE_LIBRARY_DIR
+    std::string text;
+    if (DIR* dir = opendir(CLAD_DERIVATIVE_LIBRARY_DIR)) {
+      while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name.size() > 2 && name.compare(name.size() - 2, 2, ".h") == 0) {
+          std::ifstream in(CLAD_DERIVATIVE_LIBRARY_DIR "/" + name);
+          std::stringstream ss;
+          ss << in.rdbuf();
+          text += ss.str();
+        }
+      }
+      closedir(dir);
+    }
+    // Each definition is guarded by #ifndef CLAD_DERIVATIVE_<mangled name>.
+    const std::string guard = "\n#ifndef CLAD_DERIVATIVE_";
+    for (size_t pos = text.find(guard); pos != std::string::npos;) {
+      size_t begin = text.find('\n', text.find("#define", pos)) + 1;
+      size_t end = text.find("\n#endif", begin);
+      std::string def = text.substr(begin, end - begin);
+      defs[getDefinedName(def)] += def;
+      pos = text.find(guard, end);
+    }
+#endif
+    return defs;
+  }();
+  return definitions;
+}
+
+/// \returns the size of the source of the derivative \p code and of the
+/// derivatives it calls, e.g. the pullbacks of a Jacobian or the columns of a
+/// Hessian. Falls back to the size of \p code without the library.
+size_t getCodeSize(const char* code) {
+  const std::map<std::string, std::string>& defs = getLibraryDefinitions();
+  std::vector<std::string> worklist{getDefinedName(code)};
+  std::set<std::string> seen(worklist.begin(), worklist.end());
+  if (!defs.count(worklist.back()))
+    return std::strlen(code);
+  size_t size = 0;
+  while (!worklist.empty()) {
+    auto it = defs.find(worklist.back());
+    worklist.pop_back();
+    if (it == defs.end())
+      continue;
+    const std::string& def = it->second;
+    size += def.size();
+    for (size_t i = 0; i < def.size(); ++i) {
+      if (!isIdentifierChar(def[i]) || (i && isIdentifierChar(def[i - 1])))
+        continue;
+      size_t end = i;
+      while (end < def.size() && isIdentifierChar(def[end]))
+        ++end;
+      std::string name = def.substr(i, end - i);
+      if (end < def.size() && def[end] == '(' && seen.insert(name).second)
+        worklist.push_back(name);
+      i = end;
+    }
+  }
+  return size;
+}
+
+// Reports the allocations done per execution of the derivative and the size
+// of its generated code.
+template <typename CF>
+void addCounters(benchmark::State& state, const CF& cf, size_t allocs) {
+  state.counters["AllocN"] = benchmark::Counter(
+      allocs, benchmark::Counter::kAvgIterations);
+  state.counters["CodeSize"] = getCodeSize(cf.getCode());
+  state.counters["n"] = state.range(0);
+}
+
+struct Inputs {
+  std::vector<double> x, p;
+  explicit Inputs(int n) : x(n), p(n) {
+    for (int i = 0; i < n; ++i) {
+      x[i] = 1;
+      p[i] = i + 1;
+    }
+  }
+};
+
+template <typename CF> void runHessian(benchmark::State& state, CF& h) {
+  int n = state.range(0);
+  Inputs in(n);
+  std::vector<double> matrix(n * n);
+  size_t allocs = g_NumAllocs;
+  for (auto _ : state) {
+    std::fill(matrix.begin(), matrix.end(), 0);
+    h.execute(in.x.data(), in.p.data(), /*sigma*/ 2., n, matrix.data());
+    benchmark::DoNotOptimize(matrix.data());
+  }
+  addCounters(state, h, g_NumAllocs - allocs);
+}
+
+template <typename CF> void runJacobian(benchmark::State& state, CF& j) {
+  int n = state.range(0);
+  Inputs in(n);
+  double out[2];
+  std::vector<double> matrix(2 * n);
+  size_t allocs = g_NumAllocs;
+  for (auto _ : state) {
+    std::fill(matrix.begin(), matrix.end(), 0);
+    j.execute(in.x.data(), n, out, matrix.data());
+    benchmark::DoNotOptimize(matrix.data());
+  }
+  // The rows are 2 * x[i] and 3 * x[i]^2, and x is 1.
+  for (int i = 0; i < n; ++i)
+    if (matrix[i] != 2 || matrix[n + i] != 3) {
+      state.SkipWithError("wrong Jacobian");
+      return;
+    }
+  addCounters(state, j, g_NumAllocs - allocs);
+}
+} // namespace
+
+void* operator new(size_t size) {
+  g_NumAllocs++;
+  return malloc(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+// The derivatives w.r.t. the elements of an array are generated for a fixed
+// number of elements, hence one benchmark per dimension. \p L is n - 1.
+#define CLAD_DIMENSIONS(X)                                                     \
+  X(2, 1)                                                                      \
+  X(4, 3)                                                                      \
+  X(8, 7)                                                                      \
+  X(16, 15)                                                                    \
+  X(32, 31)                                                                    \
+  X(64, 63)                                                                    \
+  X(128, 127)                                                                  \
+  X(256, 255)                                                                  \
+  X(512, 511)                                                                  \
+  X(1024, 1023)
+
+// Benchmark the Hessian of the gaussian w.r.t. x, an n x n matrix.
+#define CLAD_HESSIAN_BENCHMARK(N, L)                                           \
+  static void BM_HessianGausX_##N(benchmark::State& state) {                   \
+    auto h = clad::hessian(gaus, "x[0:" #L "]");                               \
+    runHessian(state, h);                                                      \
+  }                                                                            \
+  BENCHMARK(BM_HessianGausX_##N)->Arg(N);
+CLAD_DIMENSIONS(CLAD_HESSIAN_BENCHMARK)
+
+// Benchmark the 2 x n Jacobian of sumsOfPowers.
+#define CLAD_JACOBIAN_BENCHMARK(N, L)                                          \
+  static void BM_JacobianSumsOfPowers_##N(benchmark::State& state) {           \
+    auto j = clad::jacobian(sumsOfPowers, "x[0:" #L "]");                      \
+    runJacobian(state, j);                                                     \
+  }                                                                            \
+  BENCHMARK(BM_JacobianSumsOfPowers_##N)->Arg(N);
+CLAD_DIMENSIONS(CLAD_JACOBIAN_BENCHMARK)
+
+// Benchmark the gradient of the gaussian w.r.t. x computed with vector forward
+// mode, which seeds the derivatives of x with the n x n identity matrix.
+static void BM_VectorForwardGausX(benchmark::State& state) {
+  auto vm = clad::differentiate<clad::opts::vector_mode>(gaus, "x");
+  int n = state.range(0);
+  Inputs in(n);
+  std::vector<double> dx(n);
+  clad::array_ref<double> dx_ref(dx.data(), n);
+  size_t allocs = g_NumAllocs;
+  for (auto _ : state) {
+    std::fill(dx.begin(), dx.end(), 0);
+    vm.execute(in.x.data(), in.p.data(), /*sigma*/ 2., n, dx_ref);
+    benchmark::DoNotOptimize(dx.data());
+  }
+  addCounters(state, vm, g_NumAllocs - allocs);
+}
+BENCHMARK(BM_VectorForwardGausX)->RangeMultiplier(2)->Range(2, 1024);
+
+// Benchmark the gradient of the gaussian w.r.t. x computed with n executions
+// of forward mode, one per element of x.
+static void BM_RepeatedForwardGausX(benchmark::State& state) {
+  auto d = clad::differentiate(gausShifted, "t");
+  int n = state.range(0);
+  Inputs in(n);
+  std::vector<double> dx(n);
+  size_t allocs = g_NumAllocs;
+  for (auto _ : state) {
+    for (int i = 0; i < n; ++i)
+      dx[i] = d.execute(in.x.data(), in.p.data(), /*sigma*/ 2., n, i, 0.);
+    benchmark::DoNotOptimize(dx.data());
+  }
+  addCounters(state, d, g_NumAllocs - allocs);
+}
+BENCHMARK(BM_RepeatedForwardGausX)->RangeMultiplier(2)->Range(2, 1024);
+
+// Define our main.
+BENCHMARK_MAIN();
@@ -0,0 +1,202 @@
+#include "benchmark/benchmark.h"
+
+// Enable the numerical differentiation fallback, the benchmarks are built
+// without it.
+#undef CLAD_NO_NUM_DIFF
+#include "clad/Differentiator/Differentiator.h"
+
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+// Compare the gradient computed with reverse mode against the numerical
+// differentiation fallback and against the gradient with error estimation for
+// the same functions. Each benchmark reports the time, the number of
+// allocations and the number of evaluations of the original function per
+// gradient.
+
+// Defined in FallbackKernels.cpp.
+extern std::size_t g_NumEvals;
+double opaqueKernel(double x, double y);
+
+namespace {
+std::size_t g_NumAllocs = 0;
+
+void addCounters(benchmark::State& state, std::size_t allocs,
+                 std::size_t evals) {
+  state.counters["AllocN"] =
+      benchmark::Counter(allocs, benchmark::Counter::kAvgIterations);
+  state.counters["FnEvals"] =
+      benchmark::Counter(evals, benchmark::Counter::kAvgIterations);
+}
+} // namespace
+
+#ifdef __GLIBC__
+// Count the calls to malloc, which also allocates for new, because the copies
+// of the array arguments made by numerical_diff are allocated with malloc.
+extern "C" void* __libc_malloc(std::size_t size);
+extern "C" void* malloc(std::size_t size) noexcept {
+  g_NumAllocs++;
+  return __libc_malloc(size);
+}
+#else
+void* operator new(std::size_t size) {
+  g_NumAllocs++;
+  return malloc(size);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+#endif
+
+double kernel(double x, double y) {
+  return std::exp(-x * x) * std::sin(x * y) + x * y;
+}
+
+double model(double x, double y) { return kernel(x, y) * y; }
+
+// The same as model, but clad cannot see the definition of the kernel and
+// differentiates it numerically.
+double modelFallback(double x, double y) { return opaqueKernel(x, y) * y; }
+
+double countedModel(double x, double y) {
+  ++g_NumEvals;
+  return model(x, y);
+}
+
+///\returns the sum of the squares of the elements in \p x weighted by \p w.
+double quadraticForm(double* x, double* w, int n) {
+  double r = 0;
+  for (int i = 0; i < n; i++)
+    r += w[i] * x[i] * x[i];
+  return r;
+}
+
+double countedQuadraticForm(double* x, double* w, int n) {
+  ++g_NumEvals;
+  return quadraticForm(x, w, n);
+}
+
+// Benchmark the gradient of model computed with reverse mode.
+static void BM_GradientModel(benchmark::State& state) {
+  auto grad = clad::gradient(model);
+  std::size_t allocs = g_NumAllocs, evals = g_NumEvals;
+  for (auto _ : state) {
+    double dx = 0, dy = 0;
+    grad.execute(1.5, 2.5, &dx, &dy);
+    benchmark::DoNotOptimize(dx + dy);
+  }
+  addCounters(state, g_NumAllocs - allocs, g_NumEvals - evals);
+}
+BENCHMARK(BM_GradientModel);
+
+// Benchmark the gradient of model where the kernel is differentiated with
+// numerical_diff::forward_central_difference.
+static void BM_GradientModelFallback(benchmark::State& state) {
+  auto grad = clad::gradient(modelFallback);
+  std::size_t allocs = g_NumAllocs, evals = g_NumEvals;
+  for (auto _ : state) {
+    double dx = 0, dy = 0;
+    grad.execute(1.5, 2.5, &dx, &dy);
+    benchmark::DoNotOptimize(dx + dy);
+  }
+  addCounters(state, g_NumAllocs - allocs, g_NumEvals - evals);
+}
+BENCHMARK(BM_GradientModelFallback);
+
+// Benchmark the gradient of model computed with
+// numerical_diff::central_difference.
+static void BM_CentralDifferenceModel(benchmark::State& state) {
+  double dx = 0, dy = 0;
+  clad::tape<clad::array_ref<double>> grad = {};
+  grad.emplace_back(&dx, 1);
+  grad.emplace_back(&dy, 1);
+  std::size_t allocs = g_NumAllocs, evals = g_NumEvals;
+  for (auto _ : state) {
+    numerical_diff::central_difference(countedModel, grad,
+                                       /*printErrors=*/false, 1.5, 2.5);
+    benchmark::DoNotOptimize(dx + dy);
+  }
+  addCounters(state, g_NumAllocs - allocs, g_NumEvals - evals);
+}
+BENCHMARK(BM_CentralDifferenceModel);
+
+// Benchmark the gradient of model with the estimation of its floating-point
+// error.
+static void BM_EstimateErrorModel(benchmark::State& state) {
+  auto est = clad::estimate_error(model);
+  std::size_t allocs = g_NumAllocs, evals = g_NumEvals;
+  for (auto _ : state) {
+    double dx = 0, dy = 0, error = 0;
+    est.execute(1.5, 2.5, &dx, &dy, error);
+    benchmark::DoNotOptimize(dx + dy + error);
+  }
+  addCounters(state, g_NumAllocs - allocs, g_NumEvals - evals);
+}
+BENCHMARK(BM_EstimateErrorModel);
+
+// The same comparison for a function of arrays of n elements, for which the
+// numerical differentiation evaluates the function 4 * 2n times.
+struct Inputs {
+  std::vector<double> x, w, dx, dw;
+  explicit Inputs(int n) : x(n), w(n), dx(n), dw(n) {
+    for (int i = 0; i < n; ++i) {
+      x[i] = i + 1;
+      w[i] = 1.0 / (i + 1);
+    }
+  }
+};
+
+static void BM_GradientQuadraticForm(benchmark::State& state) {
+  auto grad = clad::gradient(quadraticForm);
+  int n = state.range(0);
+  Inputs in(n);
+  int dn = 0;
+  std::size_t allocs = g_NumAllocs, evals = g_NumEvals;
+  for (auto _ : state) {
+    grad.execute(in.x.data(), in.w.data(), n, in.dx.data(), in.dw.data(),
+                 &dn);
+    benchmark::DoNotOptimize(in.dx.data());
+  }
+  addCounters(state, g_NumAllocs - allocs, g_NumEvals - evals);
+}
+BENCHMARK(BM_GradientQuadraticForm)->RangeMultiplier(4)->Range(4, 1024);
+
+static void BM_CentralDifferenceQuadraticForm(benchmark::State& state) {
+  int n = state.range(0);
+  Inputs in(n);
+  clad::tape<clad::array_ref<double>> grad = {};
+  grad.emplace_back(in.dx.data(), n);
+  grad.emplace_back(in.dw.data(), n);
+  // n is not differentiated.
+  grad.emplace_back(nullptr, 0);
+  std::size_t allocs = g_NumAllocs, evals = g_NumEvals;
+  for (auto _ : state) {
+    numerical_diff::central_difference(countedQuadraticForm, grad,
+                                       /*printErrors=*/false, in.x.data(),
+                                       in.w.data(), n);
+    benchmark::DoNotOptimize(in.dx.data());
+  }
+  addCounters(state, g_NumAllocs - allocs, g_NumEvals - evals);
+}
+BENCHMARK(BM_CentralDifferenceQuadraticForm)
+    ->RangeMultiplier(4)
+    ->Range(4, 1024);
+
+static void BM_EstimateErrorQuadraticForm(benchmark::State& state) {
+  auto est = clad::estimate_error(quadraticForm);
+  int n = state.range(0);
+  Inputs in(n);
+  int dn = 0;
+  std::size_t allocs = g_NumAllocs, evals = g_NumEvals;
+  for (auto _ : state) {
+    double error = 0;
+    est.execute(in.x.data(), in.w.data(), n, in.dx.data(), in.dw.data(), &dn,
+                error);
+    benchmark::DoNotOptimize(error);
+  }
+  addCounters(state, g_NumAllocs - allocs, g_NumEvals - evals);
+}
+BENCHMARK(BM_EstimateErrorQuadraticForm)->RangeMultiplier(4)->Range(4, 1024);
+
+// Define our main.
+BENCHMARK_MAIN();
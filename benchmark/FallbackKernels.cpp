@@ -0,0 +1,12 @@
+// Functions whose definitions clad cannot see from FallbackCost.cpp, so that
+// their derivatives fall back to numerical differentiation.
+
+#include <cmath>
+#include <cstddef>
+
+std::size_t g_NumEvals = 0;
+
+double opaqueKernel(double x, double y) {
+  ++g_NumEvals;
+  return std::exp(-x * x) * std::sin(x * y) + x * y;
+}
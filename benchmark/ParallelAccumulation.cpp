@@ -0,0 +1,45 @@
+#include "benchmark/benchmark.h"
+
+#include "clad/Differentiator/Differentiator.h"
+#include "clad/Differentiator/Reduction.h"
+
+#include "BenchmarkedFunctions.h"
+
+#include <vector>
+
+// Accumulates the gradients of weightedSum w.r.t. the weights over a batch of
+// state.range(0) samples of 16 inputs each.
+template <clad::reduction_mode Mode>
+static void BM_AccumulateWeightedSumGradients(benchmark::State& state) {
+  auto grad = clad::gradient(weightedSum, "w");
+  constexpr int n = 16;
+  std::size_t numSamples = state.range(0);
+  std::vector<double> samples(numSamples * n);
+  for (std::size_t i = 0; i < samples.size(); ++i)
+    samples[i] = 1.0 / (double)(i + 1);
+  double weights[n];
+  for (int i = 0; i < n; ++i)
+    weights[i] = i + 1;
+
+  double sum = 0;
+  for (auto _ : state) {
+    double d_w[n] = {};
+    clad::accumulate_adjoints<Mode>(
+        numSamples, d_w, n, [&](std::size_t i, double* d) {
+          grad.execute(samples.data() + i * n, weights, n, d);
+        });
+    benchmark::DoNotOptimize(sum += d_w[0]);
+  }
+  state.SetItemsProcessed(state.iterations() * numSamples);
+}
+BENCHMARK_TEMPLATE(BM_AccumulateWeightedSumGradients,
+                   clad::reduction_mode::fast)
+    ->RangeMultiplier(8)
+    ->Range(64, 1 << 18);
+BENCHMARK_TEMPLATE(BM_AccumulateWeightedSumGradients,
+                   clad::reduction_mode::deterministic)
+    ->RangeMultiplier(8)
+    ->Range(64, 1 << 18);
+
+// Define our main.
+BENCHMARK_MAIN();
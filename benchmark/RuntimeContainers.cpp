@@ -0,0 +1,190 @@
+#include "benchmark/benchmark.h"
+
+#include "clad/Differentiator/Differentiator.h"
+
+#include <cstddef>
+#include <vector>
+
+// Microbenchmarks of the containers of the clad runtime, clad::tape,
+// clad::array and clad::matrix, compared to std::vector and raw loops. They
+// are the yardstick for changes to the storage of tapes and arrays.
+
+namespace {
+// A user-defined type stored on the tape, e.g. an object of a class which is
+// overwritten in a loop of the differentiated function.
+struct Particle {
+  double x, v, m;
+};
+
+double g_Buffer[4] = {1, 2, 3, 4};
+
+template <typename T> T makeValue(std::size_t i);
+template <> double makeValue<double>(std::size_t i) { return i; }
+template <> bool makeValue<bool>(std::size_t i) { return i & 1; }
+template <>
+clad::array_ref<double> makeValue<clad::array_ref<double>>(std::size_t i) {
+  return clad::array_ref<double>(g_Buffer, 1 + i % 4);
+}
+template <> Particle makeValue<Particle>(std::size_t i) {
+  return {static_cast<double>(i), 1, 2};
+}
+} // namespace
+
+// The sizes range from 10 to 10^7 elements, which covers tapes larger than the
+// caches while keeping a run of the benchmark within the time of the CI jobs.
+#define CLAD_TAPE_SIZES RangeMultiplier(10)->Range(10, 10000000)
+
+// Benchmark the forward sweep pushing n values followed by the reverse sweep
+// popping them, the access pattern of the tapes in the gradients.
+template <typename T> static void BM_TapeLIFO(benchmark::State& state) {
+  std::size_t n = state.range(0);
+  T value = makeValue<T>(1);
+  for (auto _ : state) {
+    clad::tape<T> t;
+    for (std::size_t i = 0; i < n; ++i)
+      clad::push(t, value);
+    for (std::size_t i = 0; i < n; ++i)
+      benchmark::DoNotOptimize(clad::pop(t));
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * sizeof(T));
+}
+BENCHMARK_TEMPLATE(BM_TapeLIFO, double)->CLAD_TAPE_SIZES;
+BENCHMARK_TEMPLATE(BM_TapeLIFO, bool)->CLAD_TAPE_SIZES;
+BENCHMARK_TEMPLATE(BM_TapeLIFO, clad::array_ref<double>)->CLAD_TAPE_SIZES;
+BENCHMARK_TEMPLATE(BM_TapeLIFO, Particle)->CLAD_TAPE_SIZES;
+
+// Benchmark the same sweeps with std::vector.
+template <typename T> static void BM_VectorLIFO(benchmark::State& state) {
+  std::size_t n = state.range(0);
+  T value = makeValue<T>(1);
+  for (auto _ : state) {
+    std::vector<T> v;
+    for (std::size_t i = 0; i < n; ++i)
+      v.push_back(value);
+    for (std::size_t i = 0; i < n; ++i) {
+      benchmark::DoNotOptimize(v.back());
+      v.pop_back();
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * sizeof(T));
+}
+BENCHMARK_TEMPLATE(BM_VectorLIFO, double)->CLAD_TAPE_SIZES;
+BENCHMARK_TEMPLATE(BM_VectorLIFO, Particle)->CLAD_TAPE_SIZES;
+
+// Benchmark the growth of the tape alone, i.e. the forward sweep.
+template <typename T> static void BM_TapeGrowth(benchmark::State& state) {
+  std::size_t n = state.range(0);
+  for (auto _ : state) {
+    clad::tape<T> t;
+    for (std::size_t i = 0; i < n; ++i)
+      clad::push(t, makeValue<T>(i));
+    benchmark::DoNotOptimize(t.back());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK_TEMPLATE(BM_TapeGrowth, double)->CLAD_TAPE_SIZES;
+BENCHMARK_TEMPLATE(BM_TapeGrowth, Particle)->CLAD_TAPE_SIZES;
+
+// Benchmark reading a filled tape from its end to its beginning without
+// popping, e.g. to replay the forward sweep in reverse.
+static void BM_TapeReverseIteration(benchmark::State& state) {
+  std::size_t n = state.range(0);
+  clad::tape<double> t;
+  for (std::size_t i = 0; i < n; ++i)
+    clad::push(t, makeValue<double>(i));
+  for (auto _ : state) {
+    double sum = 0;
+    for (auto it = t.end(); it != t.begin();)
+      sum += *--it;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_TapeReverseIteration)->CLAD_TAPE_SIZES;
+
+static void BM_VectorReverseIteration(benchmark::State& state) {
+  std::size_t n = state.range(0);
+  std::vector<double> v(n);
+  for (std::size_t i = 0; i < n; ++i)
+    v[i] = makeValue<double>(i);
+  for (auto _ : state) {
+    double sum = 0;
+    for (auto it = v.rbegin(); it != v.rend(); ++it)
+      sum += *it;
+    benchmark::DoNotOptimize(sum);
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_VectorReverseIteration)->CLAD_TAPE_SIZES;
+
+// Benchmark the expression x*y + y*z of clad arrays, evaluated with
+// expression templates, against the same loop on std::vector.
+static void BM_ArrayExpression(benchmark::State& state) {
+  std::size_t n = state.range(0);
+  clad::array<double> x(n), y(n), z(n), res(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    x[i] = i + 1;
+    y[i] = i + 2;
+    z[i] = i + 3;
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(res = x * y + y * z);
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_ArrayExpression)->CLAD_TAPE_SIZES;
+
+static void BM_VectorExpressionLoop(benchmark::State& state) {
+  std::size_t n = state.range(0);
+  std::vector<double> x(n), y(n), z(n), res(n);
+  for (std::size_t i = 0; i < n; ++i) {
+    x[i] = i + 1;
+    y[i] = i + 2;
+    z[i] = i + 3;
+  }
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < n; ++i)
+      res[i] = x[i] * y[i] + y[i] * z[i];
+    benchmark::DoNotOptimize(res.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+}
+BENCHMARK(BM_VectorExpressionLoop)->CLAD_TAPE_SIZES;
+
+// Benchmark the accumulation of the rows of a clad::matrix, e.g. the
+// adjoints of the rows of a Jacobian, against a raw loop on the same data.
+static void BM_MatrixRowAccumulation(benchmark::State& state) {
+  std::size_t n = state.range(0);
+  clad::matrix<double> m(n, n);
+  clad::array<double> res(n);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < n; ++i)
+      res += m[i];
+    benchmark::DoNotOptimize(res.ptr());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n * n);
+}
+BENCHMARK(BM_MatrixRowAccumulation)->RangeMultiplier(10)->Range(10, 10000);
+
+static void BM_RawRowAccumulation(benchmark::State& state) {
+  std::size_t n = state.range(0);
+  std::vector<double> m(n * n), res(n);
+  for (auto _ : state) {
+    for (std::size_t i = 0; i < n; ++i)
+      for (std::size_t j = 0; j < n; ++j)
+        res[j] += m[i * n + j];
+    benchmark::DoNotOptimize(res.data());
+    benchmark::ClobberMemory();
+  }
+  state.SetItemsProcessed(state.iterations() * n * n);
+}
+BENCHMARK(BM_RawRowAccumulation)->RangeMultiplier(10)->Range(10, 10000);
+
+// Define our main.
+BENCHMARK_MAIN();
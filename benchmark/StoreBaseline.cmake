@@ -0,0 +1,17 @@
+# Copies the benchmark results of the commit COMMIT from RESULTS_DIR into
+# BASELINE_DIR, replacing the results stored for earlier commits.
+#   cmake -DRESULTS_DIR=<dir> -DBASELINE_DIR=<dir> -DCOMMIT=<hash>
+#         -P StoreBaseline.cmake
+
+file(GLOB _results "${RESULTS_DIR}/clad-gbenchmark-*-${COMMIT}.json")
+if (NOT _results)
+  message(FATAL_ERROR "No benchmark results of ${COMMIT} in ${RESULTS_DIR}")
+endif()
+
+file(GLOB _old "${BASELINE_DIR}/clad-gbenchmark-*.json")
+if (_old)
+  file(REMOVE ${_old})
+endif()
+file(MAKE_DIRECTORY "${BASELINE_DIR}")
+file(COPY ${_results} DESTINATION "${BASELINE_DIR}")
+message(STATUS "Stored the benchmark results of ${COMMIT} in ${BASELINE_DIR}")
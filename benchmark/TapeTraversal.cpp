@@ -0,0 +1,57 @@
+#include "benchmark/benchmark.h"
+
+#include "clad/Differentiator/Differentiator.h"
+
+#include <cstddef>
+
+// Benchmarks of the reverse sweep over large tapes. The same source is built
+// as TapeTraversal with the default configuration, TapeTraversalPrefetch with
+// CLAD_TAPE_PREFETCH_DISTANCE and TapeTraversalHugePages with the prefetches
+// and CLAD_TAPE_HUGE_PAGES, so that their pop bandwidths can be compared.
+
+namespace {
+struct Particle {
+  double x, v, m;
+};
+
+template <typename T> T makeValue(std::size_t i) { return T(i); }
+template <> Particle makeValue<Particle>(std::size_t i) {
+  return {static_cast<double>(i), 1, 2};
+}
+template <typename T> double valueOf(const T& value) { return value; }
+double valueOf(const Particle& value) { return value.x; }
+} // namespace
+
+// Benchmark popping all values of a filled tape, the access pattern of the
+// reverse sweep. Filling the tape is not timed.
+template <typename T> static void BM_TapeReverseSweep(benchmark::State& state) {
+  std::size_t n = state.range(0);
+  for (auto _ : state) {
+    state.PauseTiming();
+    {
+      clad::tape<T> t;
+      for (std::size_t i = 0; i < n; ++i)
+        clad::push(t, makeValue<T>(i));
+      state.ResumeTiming();
+      double sum = 0;
+      for (std::size_t i = 0; i < n; ++i)
+        sum += valueOf(clad::pop(t));
+      benchmark::DoNotOptimize(sum);
+      state.PauseTiming();
+    }
+    state.ResumeTiming();
+  }
+  state.SetItemsProcessed(state.iterations() * n);
+  state.SetBytesProcessed(state.iterations() * n * sizeof(T));
+}
+BENCHMARK_TEMPLATE(BM_TapeReverseSweep, double)
+    ->RangeMultiplier(100)
+    ->Range(10000, 100000000)
+    ->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_TapeReverseSweep, Particle)
+    ->RangeMultiplier(100)
+    ->Range(10000, 10000000)
+    ->Unit(benchmark::kMillisecond);
+
+// Define our main.
+BENCHMARK_MAIN();
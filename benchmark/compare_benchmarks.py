@@ -0,0 +1,255 @@
+#!/usr/bin/env python3
+"""Compares Google Benchmark JSON results against stored baselines.
+
+The baseline and the current results are either two JSON files or two
+directories of clad-gbenchmark-<name>-<commit>.json files as written by the
+benchmark-clad target, which are paired by <name>. The times of the
+repetitions of each benchmark are compared with a two-sided Mann-Whitney U
+test, and a benchmark regresses when the test is significant and its median
+time grew more than the threshold. The times are only tested with at least
+MIN_TIME_SAMPLES repetitions on both sides. With --advisory-time, the time
+regressions are reported but do not fail, e.g. on shared CI runners. Allocation
+and byte counters are deterministic and regress when their median grew more
+than the threshold.
+
+Exits with 1 when any benchmark regressed, 2 on invalid input.
+"""
+
+import argparse
+import glob
+import json
+import math
+import os
+import statistics
+import sys
+
+# Counters which measure allocations, memory or the size of the preprocessed
+# runtime, lower is better. A counter can be given as NAME:THRESHOLD to
+# override --counter-threshold.
+DEFAULT_COUNTERS = ["AllocN", "AllocBytes", "allocs_per_iter", "max_bytes_used",
+                    "PreprocessedBytes:0.01"]
+
+# The number of repetitions below which the U test cannot detect a
+# significant change of the times at the usual significance levels.
+MIN_TIME_SAMPLES = 5
+
+
+def load(path):
+    """Returns {benchmark name: {metric: [samples]}} read from path."""
+    with open(path) as f:
+        data = json.load(f)
+    results = {}
+    for bench in data.get("benchmarks", []):
+        # Skip the mean, median and stddev aggregates of the repetitions.
+        if bench.get("run_type", "iteration") != "iteration":
+            continue
+        if "error_occurred" in bench:
+            continue
+        name = bench.get("run_name", bench["name"])
+        metrics = results.setdefault(name, {})
+        # Convert to the same unit so that files can be compared.
+        scale = {"ns": 1, "us": 1e3, "ms": 1e6, "s": 1e9}
+        unit = scale.get(bench.get("time_unit", "ns"), 1)
+        metrics.setdefault("time", []).append(bench["real_time"] * unit)
+        for key, value in bench.items():
+            if isinstance(value, (int, float)) and key not in (
+                    "real_time", "cpu_time", "iterations", "repetitions",
+                    "repetition_index", "threads", "family_index",
+                    "per_family_instance_index"):
+                metrics.setdefault(key, []).append(float(value))
+    return results
+
+
+def result_files(directory):
+    """Returns {benchmark executable: newest JSON file} in directory."""
+    files = {}
+    for path in glob.glob(os.path.join(directory, "clad-gbenchmark-*.json")):
+        stem = os.path.basename(path)[len("clad-gbenchmark-"):-len(".json")]
+        # Strip the commit hash appended by CB_ADD_GBENCHMARK.
+        name = stem.rsplit("-", 1)[0] if "-" in stem else stem
+        if name not in files or os.path.getmtime(path) > os.path.getmtime(
+                files[name]):
+            files[name] = path
+    return files
+
+
+def _ranks(values):
+    """Returns the ranks of values, averaged over ties, and the tie sizes."""
+    order = sorted(range(len(values)), key=lambda i: values[i])
+    ranks = [0.0] * len(values)
+    ties = []
+    i = 0
+    while i < len(order):
+        j = i
+        while j + 1 < len(order) and values[order[j + 1]] == values[order[i]]:
+            j += 1
+        for k in range(i, j + 1):
+            ranks[order[k]] = (i + j) / 2.0 + 1
+        ties.append(j - i + 1)
+        i = j + 1
+    return ranks, ties
+
+
+def _exact_u_cdf(u, n1, n2):
+    """Returns P(U <= u) for samples of sizes n1 and n2 without ties."""
+    # counts[i][j][v] is the number of orderings of i and j elements with U = v.
+    counts = [[None] * (n2 + 1) for _ in range(n1 + 1)]
+    for i in range(n1 + 1):
+        for j in range(n2 + 1):
+            if i == 0 or j == 0:
+                counts[i][j] = [1]
+                continue
+            size = i * j + 1
+            c = [0] * size
+            for v, w in enumerate(counts[i - 1][j]):
+                c[v + j] += w
+            for v, w in enumerate(counts[i][j - 1]):
+                c[v] += w
+            counts[i][j] = c
+    dist = counts[n1][n2]
+    return sum(dist[:int(math.floor(u)) + 1]) / float(sum(dist))
+
+
+def mann_whitney_u(a, b):
+    """Returns the two-sided p-value of the Mann-Whitney U test of a and b."""
+    n1, n2 = len(a), len(b)
+    ranks, ties = _ranks(list(a) + list(b))
+    u1 = sum(ranks[:n1]) - n1 * (n1 + 1) / 2.0
+    u = min(u1, n1 * n2 - u1)
+    if max(ties) == 1 and n1 * n2 <= 400:
+        return min(1.0, 2 * _exact_u_cdf(u, n1, n2))
+    n = n1 + n2
+    tie_term = sum(t ** 3 - t for t in ties) / float(n * (n - 1))
+    sigma = math.sqrt(n1 * n2 / 12.0 * ((n + 1) - tie_term))
+    if sigma == 0:
+        return 1.0
+    # Normal approximation with continuity correction.
+    z = (abs(u - n1 * n2 / 2.0) - 0.5) / sigma
+    return min(1.0, math.erfc(max(z, 0) / math.sqrt(2)))
+
+
+def compare(baseline, current, args, report):
+    """Compares two result sets and appends rows to report.
+
+    Returns the number of regressions."""
+    regressions = 0
+    for name in sorted(current):
+        if name not in baseline:
+            report.append((name, "", "", "", "", "", "new"))
+            continue
+        old, new = baseline[name], current[name]
+        for metric in ["time"] + list(args.counters):
+            if metric not in old or metric not in new:
+                continue
+            before = statistics.median(old[metric])
+            after = statistics.median(new[metric])
+            if before == 0:
+                change = 0.0 if after == 0 else math.inf
+            else:
+                change = (after - before) / before
+            pvalue = ""
+            verdict = "ok"
+            threshold = args.threshold if metric == "time" else \
+                args.counters[metric]
+            if metric == "time":
+                if min(len(old[metric]),
+                       len(new[metric])) < MIN_TIME_SAMPLES:
+                    verdict = "ok (fewer than %d repetitions)" % \
+                        MIN_TIME_SAMPLES
+                else:
+                    p = mann_whitney_u(old[metric], new[metric])
+                    pvalue = "%.4f" % p
+                    if p < args.alpha and change > threshold:
+                        verdict = "regression (advisory)" \
+                            if args.advisory_time else "REGRESSION"
+                    elif p < args.alpha and change < -threshold:
+                        verdict = "improvement"
+            elif change > threshold:
+                verdict = "REGRESSION"
+            elif change < -threshold:
+                verdict = "improvement"
+            if verdict == "REGRESSION":
+                regressions += 1
+            if verdict != "ok" or args.verbose:
+                report.append((name, metric, "%.6g" % before, "%.6g" % after,
+                               "%+.1f%%" % (change * 100), pvalue, verdict))
+    for name in sorted(set(baseline) - set(current)):
+        report.append((name, "", "", "", "", "", "missing"))
+    return regressions
+
+
+def print_report(report):
+    header = ("Benchmark", "Metric", "Baseline", "Current", "Change",
+              "p-value", "Verdict")
+    rows = [header] + report
+    widths = [max(len(r[i]) for r in rows) for i in range(len(header))]
+    for i, row in enumerate(rows):
+        print("  ".join(c.ljust(w) for c, w in zip(row, widths)).rstrip())
+        if i == 0:
+            print("  ".join("-" * w for w in widths))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline", help="JSON file or directory")
+    parser.add_argument("current", help="JSON file or directory")
+    parser.add_argument("--alpha", type=float, default=0.05,
+                        help="significance level of the U test")
+    parser.add_argument("--threshold", type=float, default=0.05,
+                        help="relative growth of the time which regresses")
+    parser.add_argument("--advisory-time", action="store_true",
+                        help="report the time regressions without failing")
+    parser.add_argument("--counter-threshold", type=float, default=0.0,
+                        help="relative growth of a counter which regresses")
+    parser.add_argument("--counter", dest="counters", action="append",
+                        default=None,
+                        help="counter to compare (default: %s)" %
+                        ", ".join(DEFAULT_COUNTERS))
+    parser.add_argument("-v", "--verbose", action="store_true",
+                        help="report the benchmarks which did not change")
+    args = parser.parse_args()
+    if args.counters is None:
+        args.counters = DEFAULT_COUNTERS
+    # Map each counter to its threshold.
+    counters = {}
+    for counter in args.counters:
+        name, _, threshold = counter.partition(":")
+        counters[name] = float(threshold) if threshold else \
+            args.counter_threshold
+    args.counters = counters
+
+    if os.path.isdir(args.baseline) != os.path.isdir(args.current):
+        print("error: compare two files or two directories", file=sys.stderr)
+        return 2
+    if os.path.isdir(args.baseline):
+        old_files = result_files(args.baseline)
+        new_files = result_files(args.current)
+        pairs = [(n, old_files[n], new_files[n]) for n in sorted(new_files)
+                 if n in old_files]
+        if not pairs:
+            print("error: no common benchmark results in '%s' and '%s'" %
+                  (args.baseline, args.current), file=sys.stderr)
+            return 2
+    else:
+        pairs = [(os.path.basename(args.current), args.baseline,
+                  args.current)]
+
+    regressions = 0
+    for name, old, new in pairs:
+        report = []
+        regressions += compare(load(old), load(new), args, report)
+        print("== %s" % name)
+        if report:
+            print_report(report)
+        else:
+            print("no significant changes")
+        print()
+
+    if regressions:
+        print("%d regression(s) beyond the threshold" % regressions)
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+"""Measures the compile cost of including the clad runtime headers.
+
+Each configuration is a translation unit which only includes a part of the
+runtime. It is compiled with -fsyntax-only the given number of times and the
+results are written in the JSON format of Google Benchmark, so that
+compare_benchmarks.py tracks them like the other benchmarks. The size of the
+preprocessed translation unit is reported as the PreprocessedBytes counter.
+"""
+
+import argparse
+import json
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+CORE = ["#define CLAD_MINIMAL_RUNTIME",
+        '#include "clad/Differentiator/Differentiator.h"']
+
+# The optional parts are measured together with the core they extend.
+CONFIGURATIONS = [
+    ("Full", ['#include "clad/Differentiator/Differentiator.h"']),
+    ("Core", CORE),
+] + [("Core+" + part, CORE + ['#include "clad/Differentiator/%s.h"' % part])
+     for part in ["Checkpointing", "Matrix", "NumericalDiff", "Profiling",
+                  "SoAAdjoints", "TapeState"]]
+
+
+def compile_once(args, source):
+    cmd = [args.compiler, "-std=" + args.std, "-fsyntax-only", "-w",
+           "-I", args.include_dir, source]
+    start = time.perf_counter()
+    subprocess.run(cmd, check=True)
+    return time.perf_counter() - start
+
+
+def preprocessed_size(args, source):
+    cmd = [args.compiler, "-std=" + args.std, "-E", "-P", "-w",
+           "-I", args.include_dir, source]
+    return len(subprocess.run(cmd, check=True, stdout=subprocess.PIPE).stdout)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--compiler", default="clang++")
+    parser.add_argument("--include-dir", required=True,
+                        help="the include directory of clad")
+    parser.add_argument("--std", default="c++14")
+    parser.add_argument("--repetitions", type=int, default=5)
+    parser.add_argument("--out", help="the JSON file to write")
+    args = parser.parse_args()
+
+    benchmarks = []
+    with tempfile.TemporaryDirectory() as tmp:
+        for name, lines in CONFIGURATIONS:
+            source = os.path.join(tmp, name.replace("+", "_") + ".cpp")
+            with open(source, "w") as f:
+                f.write("\n".join(lines) + "\n")
+            size = preprocessed_size(args, source)
+            # Warm up the file system caches.
+            compile_once(args, source)
+            times = [compile_once(args, source)
+                     for _ in range(max(args.repetitions, 1))]
+            for i, t in enumerate(times):
+                benchmarks.append({
+                    "name": "BM_Include%s" % name,
+                    "run_name": "BM_Include%s" % name,
+                    "run_type": "iteration",
+                    "repetitions": len(times),
+                    "repetition_index": i,
+                    "iterations": 1,
+                    "real_time": t * 1e3,
+                    "cpu_time": t * 1e3,
+                    "time_unit": "ms",
+                    "PreprocessedBytes": size,
+                })
+            print("%-24s %10.1f ms %12d bytes" %
+                  ("BM_Include" + name, sorted(times)[len(times) // 2] * 1e3,
+                   size))
+
+    result = {
+        "context": {"date": time.strftime("%Y-%m-%dT%H:%M:%S"),
+                    "executable": args.compiler},
+        "benchmarks": benchmarks,
+    }
+    if args.out:
+        with open(args.out, "w") as f:
+            json.dump(result, f, indent=2)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
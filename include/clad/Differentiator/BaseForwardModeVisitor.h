@@ -20,6 +20,9 @@ class BaseForwardModeVisitor
 protected:
   const clang::ValueDecl* m_IndependentVar = nullptr;
   unsigned m_IndependentVarIndex = ~0;
+  /// The parameter holding the index of the independent element of an array,
+  /// see DiffRequest::SeedIndexAsParam.
+  clang::ParmVarDecl* m_IndependentVarIndexParam = nullptr;
   unsigned m_DerivativeOrder = ~0;
   unsigned m_ArgIndex = ~0;
 
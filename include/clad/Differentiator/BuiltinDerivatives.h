@@ -152,20 +152,20 @@ max_pushforward(const T& a, const T& b, const T& d_a, const T& d_b) {
   return {::std::max(a, b), a < b ? d_b : d_a};
 }
 
-template <typename T, typename U>
-CUDA_HOST_DEVICE void min_pullback(const T& a, const T& b, U d_y,
-                                   clad::array_ref<decltype(T())> d_a,
-                                   clad::array_ref<decltype(T())> d_b) {
+// The adjoints of the arguments passed by reference may be stored in another
+// type than the arguments, see clad::opts::double_adjoints.
+template <typename T, typename U, typename DA, typename DB>
+CUDA_HOST_DEVICE void min_pullback(const T& a, const T& b, U d_y, DA* d_a,
+                                   DB* d_b) {
   if (a < b)
     *d_a += d_y;
   else
     *d_b += d_y;
 }
 
-template <typename T, typename U>
-CUDA_HOST_DEVICE void max_pullback(const T& a, const T& b, U d_y,
-                                   clad::array_ref<decltype(T())> d_a,
-                                   clad::array_ref<decltype(T())> d_b) {
+template <typename T, typename U, typename DA, typename DB>
+CUDA_HOST_DEVICE void max_pullback(const T& a, const T& b, U d_y, DA* d_a,
+                                   DB* d_b) {
   if (a < b)
     *d_b += d_y;
   else
@@ -180,12 +180,10 @@ clamp_pushforward(const T& v, const T& lo, const T& hi, const T& d_v,
   return {::std::clamp(v, lo, hi), v < lo ? d_lo : hi < v ? d_hi : d_v};
 }
 
-template <typename T, typename U>
+template <typename T, typename U, typename DV, typename DL, typename DH>
 CUDA_HOST_DEVICE void clamp_pullback(const T& v, const T& lo, const T& hi,
-                                     const U& d_y,
-                                     clad::array_ref<decltype(T())> d_v,
-                                     clad::array_ref<decltype(T())> d_lo,
-                                     clad::array_ref<decltype(T())> d_hi) {
+                                     const U& d_y, DV* d_v, DL* d_lo,
+                                     DH* d_hi) {
   if (v < lo)
     *d_lo += d_y;
   else if (hi < v)
@@ -0,0 +1,168 @@
+#ifndef CLAD_CHECKPOINTING_H
+#define CLAD_CHECKPOINTING_H
+
+#include "clad/Differentiator/CladConfig.h"
+
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <tuple>
+
+#ifndef CLAD_LOOP_CHECKPOINTS
+/// The number of snapshots of the variables of a checkpointed loop which are
+/// kept at most, see clad::loop_checkpoints.
+#define CLAD_LOOP_CHECKPOINTS 64
+#endif
+
+namespace clad {
+/// Online checkpointing of the while and do loops of gradients generated with
+/// `-enable-loop-checkpointing`. The number of iterations of such loops is
+/// only known when they end, so the iterations to store cannot be planned
+/// ahead. Instead of taping every iteration, the gradient keeps snapshots of
+/// the variables modified by the loop, at most `capacity` of them, and
+/// recomputes the iterations from them in the reverse sweep:
+///
+/// \code
+/// while (cond) {            // forward sweep
+///   _cp.store(_t0, x, y);
+///   <iteration, taped>;     // increments _t0
+///   <clear the tapes of the iteration>;
+/// }
+/// while (_t0) {             // reverse sweep
+///   _t0 = _cp.restore(_t0 - 1, x, y);
+///   while (_cp.replay(_t0, x, y)) {
+///     <iteration, taped>;
+///     <clear the tapes of the iteration>;
+///   }
+///   <iteration, taped>;
+///   <adjoint of the iteration>; // decrements _t0
+/// }
+/// \endcode
+///
+/// The forward sweep snapshots the iterations which are multiples of a
+/// stride. When half of the snapshots are used, every other one is dropped and
+/// the stride doubles, so that the snapshots stay evenly spread whatever the
+/// number of iterations. The reverse sweep recomputes an iteration from the
+/// closest snapshot before it, and snapshots the recomputed iterations which
+/// binomial checkpointing places with the free snapshots, so that the
+/// iterations are recomputed a number of times logarithmic in their count.
+template <typename... T> class loop_checkpoints {
+  struct snapshot {
+    std::size_t Iteration;
+    std::tuple<T...> Values;
+  };
+  std::unique_ptr<snapshot[]> m_Snapshots;
+  std::size_t m_Capacity;
+  std::size_t m_Size = 0;
+  /// The forward sweep snapshots the iterations which are multiples of it.
+  std::size_t m_Stride = 1;
+  /// The replay snapshots iteration m_Split, if any, and stops at m_Target.
+  std::size_t m_Split = 0;
+  std::size_t m_Target = 0;
+
+  void push(std::size_t i, const T&... values) {
+    m_Snapshots[m_Size].Iteration = i;
+    m_Snapshots[m_Size].Values = std::tuple<T...>(values...);
+    ++m_Size;
+  }
+
+  /// Drops every other snapshot and doubles the stride.
+  void thin() {
+    m_Stride *= 2;
+    std::size_t kept = 0;
+    for (std::size_t j = 0; j < m_Size; ++j)
+      if (m_Snapshots[j].Iteration % m_Stride == 0)
+        m_Snapshots[kept++] = m_Snapshots[j];
+    m_Size = kept;
+  }
+
+  /// Returns the number of iterations after which the next snapshot is taken
+  /// when `steps` iterations are reversed from a snapshot with `snaps`
+  /// snapshots including it, as in Griewank's and Walther's binomial
+  /// checkpointing (Algorithm 799: revolve).
+  static std::size_t advance(std::size_t steps, std::size_t snaps) {
+    if (steps < 2)
+      return steps;
+    std::size_t reps = 0, range = 1;
+    while (range < steps) {
+      ++reps;
+      range = range * (reps + snaps) / reps;
+    }
+    std::size_t bino1 = range * reps / (snaps + reps);
+    std::size_t bino2 = snaps > 1 ? bino1 * snaps / (snaps + reps - 1) : 1;
+    std::size_t bino3 = 0;
+    if (snaps > 2)
+      bino3 = bino2 * (snaps - 1) / (snaps + reps - 2);
+    else if (snaps == 2)
+      bino3 = 1;
+    std::size_t bino4 = bino2 * (reps - 1) / snaps;
+    std::size_t bino5 = 0;
+    if (snaps > 3)
+      bino5 = bino3 * (snaps - 2) / reps;
+    else if (snaps == 3)
+      bino5 = 1;
+    if (steps <= bino1 + bino3)
+      return bino4;
+    if (steps >= range - bino5)
+      return bino1;
+    return steps - bino2 - bino3;
+  }
+
+public:
+  loop_checkpoints() : loop_checkpoints(CLAD_LOOP_CHECKPOINTS) {}
+  explicit loop_checkpoints(std::size_t capacity)
+      : m_Snapshots(new snapshot[capacity ? capacity : 1]),
+        m_Capacity(capacity ? capacity : 1) {}
+  loop_checkpoints(const loop_checkpoints&) = delete;
+  loop_checkpoints& operator=(const loop_checkpoints&) = delete;
+
+  /// The number of snapshots currently kept.
+  std::size_t size() const { return m_Size; }
+  std::size_t capacity() const { return m_Capacity; }
+
+  /// Called by the forward sweep at the beginning of iteration i.
+  void store(std::size_t i, const T&... values) {
+    if (i % m_Stride)
+      return;
+    // Leave half of the snapshots to the reverse sweep.
+    if (m_Size == (m_Capacity + 1) / 2) {
+      thin();
+      if (i % m_Stride)
+        return;
+    }
+    push(i, values...);
+  }
+
+  /// Called by the reverse sweep before reversing iteration i. Sets values to
+  /// the last snapshot taken before or at iteration i and returns the
+  /// iteration of the snapshot.
+  std::size_t restore(std::size_t i, T&... values) {
+    // The snapshots after i are not needed anymore.
+    while (m_Size > 1 && m_Snapshots[m_Size - 1].Iteration > i)
+      --m_Size;
+    assert(m_Size && m_Snapshots[m_Size - 1].Iteration <= i &&
+           "no snapshot of the loop, store() was not called");
+    const snapshot& s = m_Snapshots[m_Size - 1];
+    std::tie(values...) = s.Values;
+    m_Target = i;
+    m_Split =
+        s.Iteration + advance(i + 1 - s.Iteration, m_Capacity - m_Size + 1);
+    return s.Iteration;
+  }
+
+  /// Called by the reverse sweep at the beginning of each iteration i which
+  /// is recomputed after restore(). \returns false when i is the iteration
+  /// to reverse.
+  bool replay(std::size_t i, const T&... values) {
+    if (i >= m_Target)
+      return false;
+    if (i == m_Split && m_Size < m_Capacity) {
+      push(i, values...);
+      m_Split = i + advance(m_Target + 1 - i, m_Capacity - m_Size + 1);
+    }
+    return true;
+  }
+};
+} // namespace clad
+
+#endif // CLAD_CHECKPOINTING_H
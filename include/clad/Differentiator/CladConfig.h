@@ -29,6 +29,20 @@ enum opts : unsigned {
   // 00 - default, 01 - enable, 10 - disable, 11 - not used / invalid
   enable_tbr = 1 << (ORDER_BITS + 2),
   disable_tbr = 1 << (ORDER_BITS + 3),
+
+  // Layout of the matrices computed by clad::jacobian and clad::hessian.
+  // Stores the matrix column by column instead of row by row.
+  column_major = 1 << (ORDER_BITS + 4),
+  // Takes the leading dimension of the matrix, i.e. the distance between the
+  // first elements of two consecutive rows (or columns), as an extra last
+  // parameter of the derivative.
+  strided = 1 << (ORDER_BITS + 5),
+
+  // Scalar type of the adjoints of clad::gradient, independent of the type of
+  // the primal values. For instance, float functions can accumulate their
+  // adjoints in double.
+  float_adjoints = 1 << (ORDER_BITS + 6),
+  double_adjoints = 1 << (ORDER_BITS + 7),
 }; // enum opts
 
 constexpr unsigned GetDerivativeOrder(const unsigned bitmasked_opts) {
@@ -56,6 +70,14 @@ constexpr unsigned GetBitmaskedOpts(const unsigned first, Opts... opts) {
 #define CUDA_HOST_DEVICE
 #endif
 
+// Define CLAD_CONSTEXPR_CXX14 for functions which can only be constexpr since
+// C++14, e.g. the ones modifying their arguments.
+#if __cplusplus >= 201402L
+#define CLAD_CONSTEXPR_CXX14 constexpr
+#else
+#define CLAD_CONSTEXPR_CXX14
+#endif
+
 // Define trap function that is a CUDA compatible replacement for
 // exit(int code) function
 #ifdef __CUDACC__
@@ -181,6 +181,16 @@ namespace clad {
     /// expressions.
     bool IsReferenceOrPointerArg(const clang::Expr* arg);
 
+    /// Returns true if the object of record type `RD` can be assigned field by
+    /// field, i.e. all its fields are public, non-const and are neither
+    /// references nor arrays.
+    bool IsFieldwiseAssignable(const clang::RecordDecl* RD);
+
+    /// Returns true if `E` is a call to a trivial copy or move assignment
+    /// operator assigning an lvalue to another lvalue, such that the
+    /// assignment can be performed field by field.
+    bool IsFieldwiseAssignment(const clang::Expr* E);
+
     /// Returns true if `T1` and `T2` have same cononical type; otherwise
     /// returns false.
     bool SameCanonicalType(clang::QualType T1, clang::QualType T2);
@@ -327,6 +337,16 @@ namespace clad {
 
     bool ContainsFunctionCalls(const clang::Stmt* E);
 
+    /// Returns true if FD calls itself, directly or through the functions
+    /// whose definitions are available.
+    bool IsRecursive(const clang::FunctionDecl* FD);
+
+    /// Collects the calls in S whose values are not directly returned by a
+    /// return statement, ignoring parentheses and implicit casts.
+    void
+    GetCallsNotReturned(const clang::Stmt* S,
+                        llvm::SmallVectorImpl<const clang::CallExpr*>& Calls);
+
     void SetSwitchCaseSubStmt(clang::SwitchCase* SC, clang::Stmt* subStmt);
 
     bool IsLiteral(const clang::Expr* E);
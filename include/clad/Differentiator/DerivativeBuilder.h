@@ -15,6 +15,8 @@
 #include "clad/Differentiator/DiffPlanner.h"
 
 #include <array>
+#include <map>
+#include <set>
 #include <stack>
 #include <unordered_map>
 
@@ -65,6 +67,17 @@ namespace clad {
         : derivative(p_derivative), overload(p_overload) {}
   };
 
+  /// The results of the TBR analysis of a function.
+  struct TBRAnalysisResult {
+    /// The locations of the expressions whose values have to be stored.
+    std::set<clang::SourceLocation> ToBeRecorded;
+    /// The required fields of the objects which do not have to be stored as a
+    /// whole.
+    std::map<clang::SourceLocation,
+             llvm::SmallVector<const clang::FieldDecl*, 4>>
+        ToBeRecordedFields;
+  };
+
   using VectorOutputs =
       std::vector<std::unordered_map<const clang::ValueDecl*, clang::Expr*>>;
 
@@ -98,6 +111,15 @@ namespace clad {
     // A pointer to a the handler to be used for estimation requests.
     llvm::SmallVector<std::unique_ptr<ErrorEstimationHandler>, 4>
         m_ErrorEstHandler;
+    /// The TBR analysis results of the differentiated functions. The analysis
+    /// only depends on the function body, so a function is analyzed once for
+    /// all of its reverse-mode derivatives, e.g. a gradient and a pullback or
+    /// the same Hessian column requested w.r.t. different parameters. The
+    /// distinct columns of a Hessian are distinct functions and share nothing.
+    std::map<const clang::FunctionDecl*, TBRAnalysisResult> m_TBRResults;
+    /// The number of TBR analyses run and of their results which were reused.
+    unsigned m_NumTBRAnalyses = 0;
+    unsigned m_NumTBRReuses = 0;
     DeclWithContext cloneFunction(const clang::FunctionDecl* FD,
                                   clad::VisitorBase& VB, clang::DeclContext* DC,
                                   clang::SourceLocation& noLoc,
@@ -123,6 +145,9 @@ namespace clad {
         bool forCustomDerv = true, bool namespaceShouldExist = true);
     bool noOverloadExists(clang::Expr* UnresolvedLookup,
                           llvm::MutableArrayRef<clang::Expr*> ARargs);
+    /// Returns the result of the TBR analysis of FD, running the analysis if
+    /// FD was not analyzed yet.
+    const TBRAnalysisResult& getTBRAnalysisResult(const clang::FunctionDecl* FD);
     /// Shorthand to issues a warning or error.
     template <std::size_t N>
     void diag(clang::DiagnosticsEngine::Level level, // Warning or Error
@@ -166,6 +191,8 @@ namespace clad {
     /// context.
     ///
     DerivativeAndOverload Derive(const DiffRequest& request);
+    /// Prints the number of TBR analyses run and reused to \p Out.
+    void PrintStats(llvm::raw_ostream& Out) const;
     /// Find the derived function if present in the DerivedFnCollector.
     ///
     /// \param[in] request The request to find the derived function.
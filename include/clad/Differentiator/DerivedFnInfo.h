@@ -17,8 +17,13 @@ struct DerivedFnInfo {
   DiffMode m_Mode = DiffMode::unknown;
   unsigned m_DerivativeOrder = 0;
   DiffInputVarsInfo m_DiffVarsInfo;
+  ConstantArgsInfo m_ConstantArgs;
   bool m_UsesEnzyme = false;
   bool m_DeclarationOnly = false;
+  bool m_ColumnMajorOutput = false;
+  bool m_StridedOutput = false;
+  bool m_SeedIndexAsParam = false;
+  clang::QualType m_AdjointType;
 
   DerivedFnInfo() = default;
   DerivedFnInfo(const DiffRequest& request, clang::FunctionDecl* derivedFn,
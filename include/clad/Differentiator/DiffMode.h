@@ -13,6 +13,7 @@ enum class DiffMode {
   hessian,
   jacobian,
   reverse_mode_forward_pass,
+  reverse_mode_recording_pass,
   error_estimation
 };
 }
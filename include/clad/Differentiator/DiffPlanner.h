@@ -34,6 +34,9 @@ struct DiffRequest {
   /// Context in which the function is being called, or a call to
   /// clad::gradient/differentiate, where function is the first arg.
   clang::CallExpr* CallContext = nullptr;
+  /// The function containing the call to clad::gradient/differentiate, if
+  /// the call is not at namespace scope.
+  const clang::FunctionDecl* EnclosingFunction = nullptr;
   /// Args provided to the call to clad::gradient/differentiate.
   const clang::Expr* Args = nullptr;
   /// Requested differentiation mode, forward or reverse.
@@ -45,6 +48,35 @@ struct DiffRequest {
   bool VerboseDiags = false;
   /// A flag to enable TBR analysis during reverse-mode differentiation.
   bool EnableTBRAnalysis = false;
+  /// A flag to narrow the scopes of the declarations hoisted to the function
+  /// scope during reverse-mode differentiation.
+  bool EnableLifetimeAnalysis = false;
+  /// A flag to build the adjoints of stencil loops in gather form during
+  /// reverse-mode differentiation.
+  bool EnableStencilGather = false;
+  /// A flag to make the tape state of gradients capturable and restorable
+  /// between their forward and reverse sweeps.
+  bool EnableTapeCheckpoint = false;
+  /// A flag to recompute the iterations of while and do loops from snapshots
+  /// during reverse-mode differentiation.
+  bool EnableLoopCheckpointing = false;
+  /// A flag to emit timing probes in the derivative.
+  bool EnableSweepProfiling = false;
+  /// A flag to lay out the adjoints of the arrays of structs passed to the
+  /// gradient as one array per floating-point field.
+  bool EnableSoAAdjoints = false;
+  /// A flag to store the Jacobian matrix column by column.
+  bool ColumnMajorOutput = false;
+  /// A flag to take the leading dimension of the Jacobian or Hessian matrix
+  /// as an extra last parameter of the derivative.
+  bool StridedOutput = false;
+  /// A flag to differentiate in forward mode w.r.t. the element of the
+  /// requested range of an array whose index is passed as an extra last
+  /// parameter of the derivative, instead of a fixed element.
+  bool SeedIndexAsParam = false;
+  /// The floating-point type of the adjoints of a gradient and of its
+  /// pullbacks, if it is not the type of the primal values.
+  clang::QualType AdjointType;
   /// Puts the derived function and its code in the diff call
   void updateCall(clang::FunctionDecl* FD, clang::FunctionDecl* OverloadedFD,
                   clang::Sema& SemaRef);
@@ -61,6 +93,10 @@ struct DiffRequest {
   /// member information for record (class) type parameters.
   DiffInputVarsInfo DVI;
 
+  /// The parameters bound to constants in the args, on which the derivative
+  /// is specialized.
+  ConstantArgsInfo ConstantArgs;
+
   // A flag to enable the use of enzyme for backend instead of clad
   bool use_enzyme = false;
 
@@ -89,6 +125,8 @@ struct DiffRequest {
   ///      the parameter corresponding to literal's value index.
   ///   3) If no argument is provided, a default argument is used. The
   ///      function will be differentiated w.r.t. to its every parameter.
+  /// In reverse mode, the string literal may also bind integral parameters
+  /// to constants, e.g. "x, n = 3". They are stored in `ConstantArgs`.
   void UpdateDiffParamsInfo(clang::Sema& semaRef);
 };
 
@@ -99,6 +137,26 @@ struct DiffRequest {
     /// This is a flag to indicate the default behaviour to enable/disable
     /// TBR analysis during reverse-mode differentiation.
     bool EnableTBRAnalysis = false;
+    /// This is a flag to indicate whether the scopes of the declarations
+    /// hoisted to the function scope are narrowed in reverse-mode derivatives.
+    bool EnableLifetimeAnalysis = false;
+    /// This is a flag to indicate whether the adjoints of stencil loops are
+    /// built in gather form in reverse-mode derivatives.
+    bool EnableStencilGather = false;
+    /// This is a flag to indicate whether gradients synchronize their tape
+    /// state with `clad::sync_tape_state` between their sweeps.
+    bool EnableTapeCheckpoint = false;
+    /// This is a flag to indicate whether the iterations of while and do
+    /// loops are recomputed from `clad::loop_checkpoints` in reverse-mode
+    /// derivatives.
+    bool EnableLoopCheckpointing = false;
+    /// This is a flag to indicate whether derivatives call `clad::prof_begin`
+    /// and `clad::prof_end` around their sweeps, loops and nested derivative
+    /// calls.
+    bool EnableSweepProfiling = false;
+    /// This is a flag to indicate whether gradients take the adjoints of
+    /// arrays of structs as one array per floating-point field.
+    bool EnableSoAAdjoints = false;
   };
 
   class DiffCollector: public clang::RecursiveASTVisitor<DiffCollector> {
@@ -114,6 +172,8 @@ struct DiffRequest {
     /// add them for implicit diff.
     ///
     const clang::FunctionDecl* m_TopMostFD = nullptr;
+    /// The function whose body is being visited, if any.
+    const clang::FunctionDecl* m_EnclosingFD = nullptr;
     clang::Sema& m_Sema;
 
     RequestOptions& m_Options;
@@ -121,6 +181,7 @@ struct DiffRequest {
   public:
     DiffCollector(clang::DeclGroupRef DGR, DiffInterval& Interval,
                   DiffSchedule& plans, clang::Sema& S, RequestOptions& opts);
+    bool TraverseDecl(clang::Decl* D);
     bool VisitCallExpr(clang::CallExpr* E);
 
   private:
@@ -12,12 +12,23 @@
 #include "BuiltinDerivatives.h"
 #include "CladConfig.h"
 #include "FunctionTraits.h"
+#include "Tape.h"
+
+// The parts of the runtime which only some derivatives use. With
+// CLAD_MINIMAL_RUNTIME they are included only by the translation units which
+// need them, and clad reports a missing part when a derivative requires it.
+#ifndef CLAD_MINIMAL_RUNTIME
+#include "Checkpointing.h"
 #include "Matrix.h"
 #include "NumericalDiff.h"
-#include "Tape.h"
+#include "Profiling.h"
+#include "SoAAdjoints.h"
+#include "TapeState.h"
+#endif // CLAD_MINIMAL_RUNTIME
 
 #include <assert.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <cstring>
 
 namespace clad {
@@ -74,6 +85,74 @@ inline CUDA_HOST_DEVICE unsigned int GetLength(const char* code) {
     return of.back();
   }
 
+  /// Add value to the end of the static tape, return the same value.
+  template <typename T, std::size_t N, typename U>
+  CUDA_HOST_DEVICE CLAD_CONSTEXPR_CXX14 T push(static_tape<T, N>& to, U val) {
+    to.push_back(val);
+    return to.back();
+  }
+
+  /// Remove the last value from the static tape, return it.
+  template <typename T, std::size_t N>
+  CUDA_HOST_DEVICE CLAD_CONSTEXPR_CXX14 T pop(static_tape<T, N>& to) {
+    T val = to.back();
+    to.pop_back();
+    return val;
+  }
+
+  /// Access return the last value in the static tape.
+  template <typename T, std::size_t N>
+  CUDA_HOST_DEVICE CLAD_CONSTEXPR_CXX14 T& back(static_tape<T, N>& of) {
+    return of.back();
+  }
+
+  /// Checks that a derivative specialized on a parameter bound to a constant,
+  /// e.g. with `clad::gradient(f, "x, n = 3")`, is called with that value.
+  inline CUDA_HOST_DEVICE void check_bound_arg(long long value,
+                                               long long bound) {
+    if (value != bound) {
+      printf("The derivative is specialized on the value %lld but was called "
+             "with %lld! Aborting.\n",
+             bound, value);
+      trap(EXIT_FAILURE);
+    }
+  }
+
+  /// Checks that the variable index of an element of an array or pointer
+  /// parameter of a Jacobian is one of its `size` differentiated elements.
+  /// The adjoints of the elements are columns of the Jacobian, so another
+  /// index would write into the columns of the other parameters.
+  /// \returns \p idx.
+  inline CUDA_HOST_DEVICE long long check_jacobian_index(long long idx,
+                                                         long long size) {
+    if (idx < 0 || idx >= size) {
+      printf("Jacobian index %lld is outside of [0, %lld)! Aborting.\n", idx,
+             size);
+      trap(EXIT_FAILURE);
+    }
+    return idx;
+  }
+
+  /// Checks that the elements read by a stencil loop differentiated in gather
+  /// form, `[inBegin, inEnd)`, do not overlap with the elements it writes,
+  /// `[outBegin, outEnd)`. The same check is done for their adjoints, since
+  /// the gather form reads the adjoints of the written elements while
+  /// accumulating into those of the read ones.
+  inline CUDA_HOST_DEVICE void check_stencil_alias(const void* inBegin,
+                                                   const void* inEnd,
+                                                   const void* outBegin,
+                                                   const void* outEnd) {
+    auto ib = reinterpret_cast<uintptr_t>(inBegin);
+    auto ie = reinterpret_cast<uintptr_t>(inEnd);
+    auto ob = reinterpret_cast<uintptr_t>(outBegin);
+    auto oe = reinterpret_cast<uintptr_t>(outEnd);
+    if (ib < ie && ob < oe && ib < oe && ob < ie) {
+      printf("The stencil loop reads the elements it writes, which is not "
+             "supported with -enable-stencil-gather! Aborting.\n");
+      trap(EXIT_FAILURE);
+    }
+  }
+
   /// The purpose of this function is to initialize adjoints
   /// (or all of its differentiable fields) with 0.
   // FIXME: Add support for objects.
@@ -426,7 +505,11 @@ inline CUDA_HOST_DEVICE unsigned int GetLength(const char* code) {
   /// \returns `CladFunction` object to access the corresponding derived
   /// function.
   template <unsigned... BitMaskedOpts, typename ArgSpec = const char*,
-            typename F, typename DerivedFnType = HessianDerivedFnTraits_t<F>,
+            typename F,
+            typename DerivedFnType = AddLeadingDimension_t<
+                HessianDerivedFnTraits_t<F>,
+                clad::HasOption(GetBitmaskedOpts(BitMaskedOpts...),
+                                opts::strided)>,
             typename = typename std::enable_if<
                 !std::is_class<remove_reference_and_pointer_t<F>>::value>::type>
   CladFunction<DerivedFnType, ExtractFunctorTraits_t<F>> __attribute__((
@@ -443,7 +526,11 @@ inline CUDA_HOST_DEVICE unsigned int GetLength(const char* code) {
   /// The specialization is needed because objects have to be passed
   /// by reference whereas functions have to be passed by value.
   template <unsigned... BitMaskedOpts, typename ArgSpec = const char*,
-            typename F, typename DerivedFnType = HessianDerivedFnTraits_t<F>,
+            typename F,
+            typename DerivedFnType = AddLeadingDimension_t<
+                HessianDerivedFnTraits_t<F>,
+                clad::HasOption(GetBitmaskedOpts(BitMaskedOpts...),
+                                opts::strided)>,
             typename = typename std::enable_if<
                 std::is_class<remove_reference_and_pointer_t<F>>::value>::type>
   CladFunction<DerivedFnType, ExtractFunctorTraits_t<F>> __attribute__((
@@ -463,7 +550,11 @@ inline CUDA_HOST_DEVICE unsigned int GetLength(const char* code) {
   /// \returns `CladFunction` object to access the corresponding derived
   /// function.
   template <unsigned... BitMaskedOpts, typename ArgSpec = const char*,
-            typename F, typename DerivedFnType = JacobianDerivedFnTraits_t<F>,
+            typename F,
+            typename DerivedFnType = AddLeadingDimension_t<
+                JacobianDerivedFnTraits_t<F>,
+                clad::HasOption(GetBitmaskedOpts(BitMaskedOpts...),
+                                opts::strided)>,
             typename = typename std::enable_if<
                 !std::is_class<remove_reference_and_pointer_t<F>>::value>::type>
   CladFunction<DerivedFnType, ExtractFunctorTraits_t<F>> __attribute__((
@@ -480,7 +571,11 @@ inline CUDA_HOST_DEVICE unsigned int GetLength(const char* code) {
   /// The specialization is needed because objects have to be passed
   /// by reference whereas functions have to be passed by value.
   template <unsigned... BitMaskedOpts, typename ArgSpec = const char*,
-            typename F, typename DerivedFnType = JacobianDerivedFnTraits_t<F>,
+            typename F,
+            typename DerivedFnType = AddLeadingDimension_t<
+                JacobianDerivedFnTraits_t<F>,
+                clad::HasOption(GetBitmaskedOpts(BitMaskedOpts...),
+                                opts::strided)>,
             typename = typename std::enable_if<
                 std::is_class<remove_reference_and_pointer_t<F>>::value>::type>
   CladFunction<DerivedFnType, ExtractFunctorTraits_t<F>> __attribute__((
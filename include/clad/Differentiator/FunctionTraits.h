@@ -3,6 +3,7 @@
 
 #include "clad/Differentiator/ArrayRef.h"
 
+#include <cstddef>
 #include <type_traits>
 
 namespace clad {
@@ -706,6 +707,53 @@ namespace clad {
     using type = NoFunction*;
   };
 
+  /// Appends the leading dimension parameter of the Jacobians and Hessians
+  /// computed with `clad::opts::strided` to the derived function type `T`,
+  /// if `Strided` is true. Otherwise, defines member typedef `type` as `T`.
+  template <class T, bool Strided> struct AddLeadingDimension {
+    using type = T;
+  };
+
+  template <class T, bool Strided>
+  using AddLeadingDimension_t = typename AddLeadingDimension<T, Strided>::type;
+
+  template <class ReturnType, class... Args>
+  struct AddLeadingDimension<ReturnType (*)(Args...), true> {
+    using type = ReturnType (*)(Args..., std::size_t);
+  };
+
+  /// These macro expansions are used to cover all possible cases of
+  /// qualifiers in member functions when declaring AddLeadingDimension, see
+  /// HessianDerivedFnTraits.
+#define AddLeadingDimension_AddSPECS(var, cv, vol, ref, noex)                  \
+  template <typename R, typename C, typename... Args>                          \
+  struct AddLeadingDimension<R (C::*)(Args...) cv vol ref noex, true> {        \
+    using type = R (C::*)(Args..., std::size_t) cv vol ref noex;               \
+  };
+
+#if __cpp_noexcept_function_type > 0
+#define AddLeadingDimension_AddNOEX(var, con, vol, ref)                        \
+  AddLeadingDimension_AddSPECS(var, con, vol, ref, )                           \
+      AddLeadingDimension_AddSPECS(var, con, vol, ref, noexcept)
+#else
+#define AddLeadingDimension_AddNOEX(var, con, vol, ref)                        \
+  AddLeadingDimension_AddSPECS(var, con, vol, ref, )
+#endif
+
+#define AddLeadingDimension_AddREF(var, con, vol)                              \
+  AddLeadingDimension_AddNOEX(var, con, vol, )                                 \
+      AddLeadingDimension_AddNOEX(var, con, vol, &)                            \
+          AddLeadingDimension_AddNOEX(var, con, vol, &&)
+
+#define AddLeadingDimension_AddVOL(var, con)                                   \
+  AddLeadingDimension_AddREF(var, con, )                                       \
+      AddLeadingDimension_AddREF(var, con, volatile)
+
+#define AddLeadingDimension_AddCON(var)                                        \
+  AddLeadingDimension_AddVOL(var, ) AddLeadingDimension_AddVOL(var, const)
+
+  AddLeadingDimension_AddCON(()); // Declares all the specializations
+
   /// Compute type of derived function of function, method or functor when
   /// differentiated using forward differentiation mode
   /// (`clad::differentiate`). Computed type is provided as member typedef
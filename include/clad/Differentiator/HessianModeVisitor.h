@@ -26,11 +26,15 @@ namespace clad {
   private:
     /// A helper method that combines all the generated second derivatives
     /// (contained within a vector) obtained from Derive
-    /// into a single FunctionDecl f_hessian
+    /// into a single FunctionDecl f_hessian. The second derivatives w.r.t. the
+    /// elements of an array take the index of the element as a parameter and
+    /// are called for each index in the corresponding secDerivSeeds interval.
     DerivativeAndOverload
     Merge(std::vector<clang::FunctionDecl*> secDerivFuncs,
+          const IndexIntervalTable& secDerivSeeds,
           llvm::SmallVector<size_t, 16> IndependentArgsSize,
-          size_t TotalIndependentArgsSize, std::string hessianFuncName);
+          size_t TotalIndependentArgsSize, std::string hessianFuncName,
+          bool stridedOutput);
 
   public:
     HessianModeVisitor(DerivativeBuilder& builder);
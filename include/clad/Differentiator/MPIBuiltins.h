@@ -0,0 +1,238 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+//
+// Custom derivatives of MPI point-to-point and collective operations. This
+// header is not included by Differentiator.h and has to be included after
+// <mpi.h> by the code differentiating functions which communicate.
+//------------------------------------------------------------------------------
+
+#ifndef CLAD_MPI_BUILTINS_H
+#define CLAD_MPI_BUILTINS_H
+
+#include "clad/Differentiator/BuiltinDerivatives.h"
+
+#include <mpi.h>
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace clad {
+namespace mpi {
+/// Only the adjoints of floating-point buffers are communicated. The check
+/// gives the same answer on both sides of a communication, so the adjoint
+/// messages always match.
+inline bool IsDifferentiable(MPI_Datatype datatype) {
+  return datatype == MPI_DOUBLE || datatype == MPI_FLOAT ||
+         datatype == MPI_LONG_DOUBLE;
+}
+
+/// Reports a communication whose derivative cannot be computed and aborts
+/// all the ranks of `comm`, instead of producing wrong adjoints.
+inline void Fail(MPI_Comm comm, const char* msg, int code) {
+  ::std::fprintf(stderr, "clad: %s\n", msg);
+  MPI_Abort(comm, code);
+}
+
+/// Only sums propagate the derivatives of their operands unchanged.
+inline void CheckOp(MPI_Op op, MPI_Comm comm) {
+  if (op != MPI_SUM)
+    Fail(comm, "only MPI_SUM reductions are differentiable", MPI_ERR_OP);
+}
+
+/// Converts the adjoint argument of a buffer to an untyped pointer. Adjoints of
+/// arguments which are not buffers, such as `MPI_IN_PLACE`, are ignored.
+template <typename T> void* AsBuffer(T* p) {
+  return const_cast<void*>(static_cast<const void*>(p));
+}
+template <typename T> void* AsBuffer(T) { return nullptr; }
+
+template <typename T> void Accumulate(void* dst, const void* src, int count) {
+  T* d = static_cast<T*>(dst);
+  const T* s = static_cast<const T*>(src);
+  for (int i = 0; i < count; ++i)
+    d[i] += s[i];
+}
+
+/// Adds `count` elements of `src` to `dst`.
+inline void Accumulate(void* dst, const void* src, int count,
+                       MPI_Datatype datatype) {
+  if (datatype == MPI_DOUBLE)
+    Accumulate<double>(dst, src, count);
+  else if (datatype == MPI_FLOAT)
+    Accumulate<float>(dst, src, count);
+  else if (datatype == MPI_LONG_DOUBLE)
+    Accumulate<long double>(dst, src, count);
+}
+
+inline void Zero(void* buf, int count, MPI_Datatype datatype) {
+  int size = 0;
+  MPI_Type_size(datatype, &size);
+  ::std::memset(buf, 0, static_cast<size_t>(count) * size);
+}
+
+inline ::std::vector<char> MakeBuffer(int count, MPI_Datatype datatype) {
+  int size = 0;
+  MPI_Type_size(datatype, &size);
+  return ::std::vector<char>(static_cast<size_t>(count) * size);
+}
+} // namespace mpi
+
+namespace custom_derivatives {
+// The derivatives of a communication are sent along the same route as the
+// values, right after them and with the same tag.
+template <typename... Rest>
+ValueAndPushforward<int, int>
+MPI_Send_pushforward(const void* buf, int count, MPI_Datatype datatype,
+                     int dest, int tag, MPI_Comm comm, const void* d_buf,
+                     Rest...) {
+  int err = MPI_Send(buf, count, datatype, dest, tag, comm);
+  if (err == MPI_SUCCESS && clad::mpi::IsDifferentiable(datatype))
+    err = MPI_Send(d_buf, count, datatype, dest, tag, comm);
+  return {err, 0};
+}
+
+template <typename... Rest>
+ValueAndPushforward<int, int>
+MPI_Recv_pushforward(void* buf, int count, MPI_Datatype datatype, int source,
+                     int tag, MPI_Comm comm, MPI_Status* status, void* d_buf,
+                     Rest...) {
+  int err = MPI_Recv(buf, count, datatype, source, tag, comm, status);
+  if (err == MPI_SUCCESS && clad::mpi::IsDifferentiable(datatype))
+    err = MPI_Recv(d_buf, count, datatype, source, tag, comm,
+                   MPI_STATUS_IGNORE);
+  return {err, 0};
+}
+
+template <typename... Rest>
+ValueAndPushforward<int, int>
+MPI_Allreduce_pushforward(const void* sendbuf, void* recvbuf, int count,
+                          MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                          const void* d_sendbuf, void* d_recvbuf, Rest...) {
+  clad::mpi::CheckOp(op, comm);
+  int err = MPI_Allreduce(sendbuf, recvbuf, count, datatype, op, comm);
+  if (err == MPI_SUCCESS && clad::mpi::IsDifferentiable(datatype))
+    err = MPI_Allreduce(sendbuf == MPI_IN_PLACE ? MPI_IN_PLACE : d_sendbuf,
+                        d_recvbuf, count, datatype, op, comm);
+  return {err, 0};
+}
+
+// The adjoints of the arguments follow the arguments. When the returned error
+// code is kept, e.g. `int err = MPI_Send(...)`, its adjoint is passed before
+// them. It carries no derivative and the overloads taking it ignore it.
+
+// The adjoint of a send is a receive of the adjoint from the destination,
+// which is accumulated into the adjoint of the sent buffer.
+template <typename DBuf, typename... Rest>
+void MPI_Send_pullback(const void* buf, int count, MPI_Datatype datatype,
+                       int dest, int tag, MPI_Comm comm, DBuf d_buf, Rest...) {
+  if (!clad::mpi::IsDifferentiable(datatype))
+    return;
+  ::std::vector<char> tmp = clad::mpi::MakeBuffer(count, datatype);
+  MPI_Recv(tmp.data(), count, datatype, dest, tag, comm, MPI_STATUS_IGNORE);
+  clad::mpi::Accumulate(clad::mpi::AsBuffer(d_buf), tmp.data(), count,
+                        datatype);
+}
+
+// The adjoint of a receive sends the adjoint of the received buffer back to
+// its source. The received buffer was overwritten, so its adjoint is reset.
+template <typename DBuf, typename... Rest>
+void MPI_Recv_pullback(void* buf, int count, MPI_Datatype datatype, int source,
+                       int tag, MPI_Comm comm, MPI_Status* status, DBuf d_buf,
+                       Rest...) {
+  if (!clad::mpi::IsDifferentiable(datatype))
+    return;
+  // Wildcards are resolved from the status of the original receive.
+  if (status != MPI_STATUS_IGNORE) {
+    if (source == MPI_ANY_SOURCE)
+      source = status->MPI_SOURCE;
+    if (tag == MPI_ANY_TAG)
+      tag = status->MPI_TAG;
+  }
+  if (source == MPI_ANY_SOURCE || tag == MPI_ANY_TAG)
+    clad::mpi::Fail(comm,
+                    "wildcard receives need a status to be differentiated",
+                    MPI_ERR_ARG);
+  void* adjoint = clad::mpi::AsBuffer(d_buf);
+  MPI_Send(adjoint, count, datatype, source, tag, comm);
+  clad::mpi::Zero(adjoint, count, datatype);
+}
+
+// `recvbuf = sum(sendbuf)` over all ranks, hence every rank has to add the sum
+// of the adjoints of `recvbuf` to the adjoint of its `sendbuf`.
+template <typename DSendBuf, typename DRecvBuf, typename... Rest>
+void MPI_Allreduce_pullback(const void* sendbuf, void* recvbuf, int count,
+                            MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                            DSendBuf d_sendbuf, DRecvBuf d_recvbuf, Rest...) {
+  clad::mpi::CheckOp(op, comm);
+  if (!clad::mpi::IsDifferentiable(datatype))
+    return;
+  void* d_recv = clad::mpi::AsBuffer(d_recvbuf);
+  if (sendbuf == MPI_IN_PLACE) {
+    MPI_Allreduce(MPI_IN_PLACE, d_recv, count, datatype, op, comm);
+    return;
+  }
+  ::std::vector<char> tmp = clad::mpi::MakeBuffer(count, datatype);
+  MPI_Allreduce(d_recv, tmp.data(), count, datatype, op, comm);
+  clad::mpi::Accumulate(clad::mpi::AsBuffer(d_sendbuf), tmp.data(), count,
+                        datatype);
+  clad::mpi::Zero(d_recv, count, datatype);
+}
+
+template <typename DBuf, typename... Rest>
+void MPI_Send_pullback(const void* buf, int count, MPI_Datatype datatype,
+                       int dest, int tag, MPI_Comm comm, int /*d_y*/,
+                       DBuf d_buf, Rest... rest) {
+  MPI_Send_pullback(buf, count, datatype, dest, tag, comm, d_buf, rest...);
+}
+
+template <typename DBuf, typename... Rest>
+void MPI_Recv_pullback(void* buf, int count, MPI_Datatype datatype, int source,
+                       int tag, MPI_Comm comm, MPI_Status* status,
+                       int /*d_y*/, DBuf d_buf, Rest... rest) {
+  MPI_Recv_pullback(buf, count, datatype, source, tag, comm, status, d_buf,
+                    rest...);
+}
+
+template <typename DSendBuf, typename DRecvBuf, typename... Rest>
+void MPI_Allreduce_pullback(const void* sendbuf, void* recvbuf, int count,
+                            MPI_Datatype datatype, MPI_Op op, MPI_Comm comm,
+                            int /*d_y*/, DSendBuf d_sendbuf,
+                            DRecvBuf d_recvbuf, Rest... rest) {
+  MPI_Allreduce_pullback(sendbuf, recvbuf, count, datatype, op, comm,
+                         d_sendbuf, d_recvbuf, rest...);
+}
+
+// Queries and synchronization do not carry derivatives.
+template <typename... Rest>
+ValueAndPushforward<int, int> MPI_Comm_rank_pushforward(MPI_Comm comm,
+                                                        int* rank, Rest...) {
+  return {MPI_Comm_rank(comm, rank), 0};
+}
+
+template <typename... Rest>
+ValueAndPushforward<int, int> MPI_Comm_size_pushforward(MPI_Comm comm,
+                                                        int* size, Rest...) {
+  return {MPI_Comm_size(comm, size), 0};
+}
+
+template <typename... Rest>
+ValueAndPushforward<int, int> MPI_Barrier_pushforward(MPI_Comm comm, Rest...) {
+  return {MPI_Barrier(comm), 0};
+}
+
+template <typename... Rest>
+void MPI_Comm_rank_pullback(MPI_Comm comm, int* rank, Rest...) {}
+
+template <typename... Rest>
+void MPI_Comm_size_pullback(MPI_Comm comm, int* size, Rest...) {}
+
+// The barrier of the forward pass also orders the communications of the
+// reverse pass.
+template <typename... Rest> void MPI_Barrier_pullback(MPI_Comm comm, Rest...) {
+  MPI_Barrier(comm);
+}
+} // namespace custom_derivatives
+} // namespace clad
+
+#endif // CLAD_MPI_BUILTINS_H
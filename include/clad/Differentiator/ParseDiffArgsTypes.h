@@ -11,6 +11,7 @@
 #include "llvm/ADT/StringRef.h"
 
 #include <cstddef>
+#include <cstdint>
 #include <utility>
 
 
@@ -81,6 +82,11 @@ namespace clad {
 
   using DiffParams = llvm::SmallVector<const clang::ValueDecl*, 16>;
   using DiffParamsWithIndices = std::pair<DiffParams, IndexIntervalTable>;
+
+  /// The parameters bound to constant values at the call site, e.g.
+  /// `clad::gradient(f, "x, n = 3")`, together with their values.
+  using ConstantArgsInfo =
+      llvm::SmallVector<std::pair<const clang::ParmVarDecl*, std::int64_t>, 2>;
   } // namespace clad
 
 #endif
\ No newline at end of file
@@ -0,0 +1,286 @@
+// Probes emitted by clad in the derivatives produced with the
+// `-enable-sweep-profiling` plugin flag, and a runtime aggregating them.
+//
+// The derivatives call `clad::prof_begin(site)` and `clad::prof_end(site)`
+// around their forward sweep, their reverse sweep, each loop and each call to
+// another derivative produced by clad. These expand to the `CLAD_PROF_BEGIN`
+// and `CLAD_PROF_END` macros, which do nothing by default. They can be
+// defined before including clad to use an external profiler, or bound to the
+// runtime below by defining `CLAD_ENABLE_PROFILING`.
+
+#ifndef CLAD_PROFILING_H
+#define CLAD_PROFILING_H
+
+#include "clad/Differentiator/CladConfig.h"
+
+#if defined(CLAD_ENABLE_PROFILING) && !defined(__CUDA_ARCH__)
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#endif
+
+#ifndef CLAD_PROF_BEGIN
+#if defined(CLAD_ENABLE_PROFILING) && !defined(__CUDA_ARCH__)
+#define CLAD_PROF_BEGIN(site) ::clad::profiler::begin(site)
+#else
+#define CLAD_PROF_BEGIN(site) ((void)(site))
+#endif
+#endif
+
+#ifndef CLAD_PROF_END
+#if defined(CLAD_ENABLE_PROFILING) && !defined(__CUDA_ARCH__)
+#define CLAD_PROF_END(site) ::clad::profiler::end(site)
+#else
+#define CLAD_PROF_END(site) ((void)(site))
+#endif
+#endif
+
+#ifndef CLAD_PROF_MAX_EVENTS
+/// The maximum number of events kept per thread for the Chrome trace. The
+/// aggregated statistics are updated past it.
+#define CLAD_PROF_MAX_EVENTS (1 << 20)
+#endif
+
+namespace clad {
+#if defined(CLAD_ENABLE_PROFILING) && !defined(__CUDA_ARCH__)
+  namespace profiler {
+    /// The time spent in a profiled site, in microseconds.
+    struct site_stats {
+      std::string site;
+      unsigned long long count = 0;
+      /// The time between the begin and end probes of the site.
+      double total_us = 0;
+      /// The total time minus the time of the nested sites.
+      double self_us = 0;
+      double max_us = 0;
+    };
+
+    namespace detail {
+      using clock = std::chrono::steady_clock;
+
+      struct frame {
+        const char* site;
+        clock::time_point start;
+        double children_us;
+      };
+
+      struct event {
+        const char* site;
+        double ts_us;
+        double dur_us;
+      };
+
+      /// The data recorded by a thread. It is owned by the registry as well,
+      /// so that it outlives the thread.
+      struct thread_data {
+        std::mutex lock;
+        unsigned tid = 0;
+        std::vector<frame> stack;
+        std::unordered_map<const char*, site_stats> sites;
+        std::vector<event> events;
+        unsigned long long dropped_events = 0;
+      };
+
+      struct registry {
+        std::mutex lock;
+        clock::time_point epoch = clock::now();
+        std::vector<std::shared_ptr<thread_data>> threads;
+      };
+
+      inline registry& get_registry() {
+        static registry R;
+        return R;
+      }
+
+      inline thread_data& get_thread_data() {
+        static thread_local std::shared_ptr<thread_data> TD = [] {
+          auto D = std::make_shared<thread_data>();
+          registry& R = get_registry();
+          std::lock_guard<std::mutex> guard(R.lock);
+          D->tid = static_cast<unsigned>(R.threads.size());
+          R.threads.push_back(D);
+          return D;
+        }();
+        return *TD;
+      }
+
+      inline double elapsed_us(clock::time_point from, clock::time_point to) {
+        return std::chrono::duration<double, std::micro>(to - from).count();
+      }
+
+      inline void write_json_string(std::FILE* out, const std::string& s) {
+        std::fputc('"', out);
+        for (char c : s) {
+          if (c == '"' || c == '\\')
+            std::fputc('\\', out);
+          std::fputc(c, out);
+        }
+        std::fputc('"', out);
+      }
+    } // namespace detail
+
+    /// Starts timing `site` on the calling thread.
+    inline void begin(const char* site) {
+      detail::thread_data& TD = detail::get_thread_data();
+      std::lock_guard<std::mutex> guard(TD.lock);
+      TD.stack.push_back({site, detail::clock::now(), 0});
+    }
+
+    /// Stops timing the innermost active `site` on the calling thread. Sites
+    /// started after it and not ended, e.g. because of a jump out of a loop,
+    /// are discarded and their time is attributed to `site`.
+    inline void end(const char* site) {
+      detail::clock::time_point now = detail::clock::now();
+      detail::thread_data& TD = detail::get_thread_data();
+      std::lock_guard<std::mutex> guard(TD.lock);
+      std::size_t i = TD.stack.size();
+      while (i && std::strcmp(TD.stack[i - 1].site, site))
+        --i;
+      if (!i)
+        return;
+      detail::frame F = TD.stack[i - 1];
+      TD.stack.resize(i - 1);
+      double dur = detail::elapsed_us(F.start, now);
+      if (!TD.stack.empty())
+        TD.stack.back().children_us += dur;
+      site_stats& S = TD.sites[site];
+      ++S.count;
+      S.total_us += dur;
+      S.self_us += dur - F.children_us;
+      S.max_us = std::max(S.max_us, dur);
+      if (TD.events.size() < CLAD_PROF_MAX_EVENTS)
+        TD.events.push_back(
+            {site, detail::elapsed_us(detail::get_registry().epoch, F.start),
+             dur});
+      else
+        ++TD.dropped_events;
+    }
+
+    /// \returns the statistics of every site over all threads, sorted by
+    /// decreasing self time.
+    inline std::vector<site_stats> summary() {
+      std::map<std::string, site_stats> merged;
+      detail::registry& R = detail::get_registry();
+      std::lock_guard<std::mutex> guard(R.lock);
+      for (const auto& TD : R.threads) {
+        std::lock_guard<std::mutex> threadGuard(TD->lock);
+        for (const auto& entry : TD->sites) {
+          site_stats& S = merged[entry.first];
+          S.site = entry.first;
+          S.count += entry.second.count;
+          S.total_us += entry.second.total_us;
+          S.self_us += entry.second.self_us;
+          S.max_us = std::max(S.max_us, entry.second.max_us);
+        }
+      }
+      std::vector<site_stats> result;
+      for (auto& entry : merged)
+        result.push_back(std::move(entry.second));
+      std::stable_sort(result.begin(), result.end(),
+                       [](const site_stats& a, const site_stats& b) {
+                         return a.self_us > b.self_us;
+                       });
+      return result;
+    }
+
+    /// Prints the statistics of every site, the hottest first.
+    inline void report(std::FILE* out = stderr) {
+      std::fprintf(out, "%12s %12s %12s %12s  %s\n", "self(us)", "total(us)",
+                   "max(us)", "count", "site");
+      for (const site_stats& S : summary())
+        std::fprintf(out, "%12.3f %12.3f %12.3f %12llu  %s\n", S.self_us,
+                     S.total_us, S.max_us, S.count, S.site.c_str());
+      unsigned long long dropped = 0;
+      detail::registry& R = detail::get_registry();
+      std::lock_guard<std::mutex> guard(R.lock);
+      for (const auto& TD : R.threads) {
+        std::lock_guard<std::mutex> threadGuard(TD->lock);
+        dropped += TD->dropped_events;
+      }
+      if (dropped)
+        std::fprintf(out, "%llu events exceeding CLAD_PROF_MAX_EVENTS are not "
+                          "in the trace\n", dropped);
+    }
+
+    /// Writes the recorded events in the Chrome trace event format, which can
+    /// be loaded in chrome://tracing or Perfetto.
+    /// \returns false if the file could not be written.
+    inline bool write_chrome_trace(const char* path) {
+      std::FILE* out = std::fopen(path, "w");
+      if (!out)
+        return false;
+      std::fputs("{\"traceEvents\":[", out);
+      bool first = true;
+      detail::registry& R = detail::get_registry();
+      std::lock_guard<std::mutex> guard(R.lock);
+      for (const auto& TD : R.threads) {
+        std::lock_guard<std::mutex> threadGuard(TD->lock);
+        for (const detail::event& E : TD->events) {
+          std::fputs(first ? "\n" : ",\n", out);
+          first = false;
+          std::fputs("{\"name\":", out);
+          detail::write_json_string(out, E.site);
+          std::fprintf(out,
+                       ",\"cat\":\"clad\",\"ph\":\"X\",\"ts\":%.3f,"
+                       "\"dur\":%.3f,\"pid\":0,\"tid\":%u}",
+                       E.ts_us, E.dur_us, TD->tid);
+        }
+      }
+      std::fputs("\n],\"displayTimeUnit\":\"ns\"}\n", out);
+      return std::fclose(out) == 0;
+    }
+
+    /// Clears the data recorded by all threads.
+    inline void reset() {
+      detail::registry& R = detail::get_registry();
+      std::lock_guard<std::mutex> guard(R.lock);
+      for (const auto& TD : R.threads) {
+        std::lock_guard<std::mutex> threadGuard(TD->lock);
+        TD->sites.clear();
+        TD->events.clear();
+        TD->dropped_events = 0;
+      }
+    }
+  } // namespace profiler
+#endif
+
+  /// Marks the beginning of a profiled site in a derivative.
+  inline CUDA_HOST_DEVICE void prof_begin(const char* site) {
+    CLAD_PROF_BEGIN(site);
+  }
+
+  /// Marks the end of a profiled site in a derivative.
+  inline CUDA_HOST_DEVICE void prof_end(const char* site) {
+    CLAD_PROF_END(site);
+  }
+
+  /// Marks the end of a profiled site after the evaluation of `value`, which
+  /// is forwarded to the caller.
+  template <typename T>
+  CUDA_HOST_DEVICE T&& prof_end(const char* site, T&& value) {
+    CLAD_PROF_END(site);
+    return static_cast<T&&>(value);
+  }
+
+  /// Profiles the enclosing scope of a derivative as `site`.
+  class prof_scope {
+    const char* m_Site;
+
+  public:
+    CUDA_HOST_DEVICE prof_scope(const char* site) : m_Site(site) {
+      CLAD_PROF_BEGIN(site);
+    }
+    prof_scope(const prof_scope&) = delete;
+    prof_scope& operator=(const prof_scope&) = delete;
+    CUDA_HOST_DEVICE ~prof_scope() { CLAD_PROF_END(m_Site); }
+  };
+} // namespace clad
+
+#endif // CLAD_PROFILING_H
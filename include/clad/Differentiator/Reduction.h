@@ -0,0 +1,147 @@
+#ifndef CLAD_REDUCTION_H
+#define CLAD_REDUCTION_H
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#ifndef CLAD_REDUCTION_BLOCK_SIZE
+/// The number of items whose adjoints are accumulated sequentially into the
+/// same partial buffer in `clad::reduction_mode::deterministic`.
+#define CLAD_REDUCTION_BLOCK_SIZE 64
+#endif
+
+#ifndef CLAD_REDUCTION_MAX_BLOCKS
+/// The number of blocks whose partial buffers are kept at the same time in
+/// `clad::reduction_mode::deterministic`. This bounds the memory used for the
+/// partials independently of the number of items.
+#define CLAD_REDUCTION_MAX_BLOCKS 256
+#endif
+
+namespace clad {
+  /// Selects how `clad::accumulate_adjoints` combines the adjoints of
+  /// independent evaluations.
+  enum class reduction_mode {
+    /// Each thread accumulates into its own buffer and the buffers are added
+    /// to the result in the order in which the threads finish. The rounding
+    /// of the result depends on the number of threads and on the scheduling.
+    fast,
+    /// The items are split into blocks of `CLAD_REDUCTION_BLOCK_SIZE`, each
+    /// accumulated in item order into its own buffer. The blocks are
+    /// processed in waves of `CLAD_REDUCTION_MAX_BLOCKS`, whose buffers are
+    /// summed with a fixed pairwise tree, and the sums of the waves are again
+    /// summed pairwise. The result is bitwise identical across runs and
+    /// thread counts.
+    deterministic
+  };
+
+  /// Adds the rows `partials[0..n)` of length `len`, stored contiguously, into
+  /// `out`. The rows are summed pairwise, `(0 + 1) + (2 + 3)`, and so on, so
+  /// that the order of the additions depends only on `n`. The rows are
+  /// overwritten.
+  template <typename T>
+  void tree_reduce(T* partials, std::size_t n, std::size_t len, T* out) {
+    for (std::size_t stride = 1; stride < n; stride *= 2) {
+      auto pairs = static_cast<long long>((n + stride - 1) / (2 * stride));
+#ifdef _OPENMP
+#pragma omp parallel for if (pairs * len >= 4096)
+#endif
+      for (long long p = 0; p < pairs; ++p) {
+        T* dst = partials + 2 * stride * p * len;
+        const T* src = dst + stride * len;
+        for (std::size_t j = 0; j < len; ++j)
+          dst[j] += src[j];
+      }
+    }
+    if (n)
+      for (std::size_t j = 0; j < len; ++j)
+        out[j] += partials[j];
+  }
+
+  /// Accumulates the adjoints of `numItems` independent evaluations, such as
+  /// the gradients of a loss over the samples of a batch, into `adjoints`.
+  /// `body(i, d)` adds the adjoints of item `i` to the `numAdjoints` values
+  /// pointed to by `d`, e.g. by calling a gradient produced by clad. The items
+  /// are processed in parallel when compiled with OpenMP, so `body` must not
+  /// write to shared state.
+  template <reduction_mode Mode = reduction_mode::deterministic, typename T,
+            typename F>
+  void accumulate_adjoints(std::size_t numItems, T* adjoints,
+                           std::size_t numAdjoints, F body) {
+    if (Mode == reduction_mode::fast) {
+#ifdef _OPENMP
+#pragma omp parallel
+#endif
+      {
+        std::vector<T> local(numAdjoints, T());
+#ifdef _OPENMP
+#pragma omp for schedule(dynamic, CLAD_REDUCTION_BLOCK_SIZE)
+#endif
+        for (long long i = 0; i < static_cast<long long>(numItems); ++i)
+          body(static_cast<std::size_t>(i), local.data());
+#ifdef _OPENMP
+#pragma omp critical(clad_accumulate_adjoints)
+#endif
+        for (std::size_t j = 0; j < numAdjoints; ++j)
+          adjoints[j] += local[j];
+      }
+      return;
+    }
+
+    const std::size_t B = CLAD_REDUCTION_BLOCK_SIZE;
+    const std::size_t W = CLAD_REDUCTION_MAX_BLOCKS;
+    std::size_t numBlocks = (numItems + B - 1) / B;
+    std::size_t numWaves = (numBlocks + W - 1) / W;
+    std::size_t wavePartials = numBlocks < W ? numBlocks : W;
+    std::vector<T> partials(wavePartials * numAdjoints);
+    // The sums of the waves are combined like a binary counter: levels[k]
+    // holds the sum of 2^k consecutive waves while bit k of the number of
+    // completed waves is set. This yields the same pairwise tree over the
+    // waves as `tree_reduce`, keeping only a logarithmic number of sums.
+    std::vector<std::vector<T>> levels;
+    for (std::size_t w = 0; w < numWaves; ++w) {
+      std::size_t first = w * W;
+      std::size_t last = first + W < numBlocks ? first + W : numBlocks;
+      std::fill(partials.begin(), partials.end(), T());
+#ifdef _OPENMP
+#pragma omp parallel for schedule(dynamic)
+#endif
+      for (long long b = static_cast<long long>(first);
+           b < static_cast<long long>(last); ++b) {
+        auto ub = static_cast<std::size_t>(b);
+        T* d = partials.data() + (ub - first) * numAdjoints;
+        std::size_t end = (ub + 1) * B < numItems ? (ub + 1) * B : numItems;
+        for (std::size_t i = ub * B; i < end; ++i)
+          body(i, d);
+      }
+      std::vector<T> sum(numAdjoints, T());
+      tree_reduce(partials.data(), last - first, numAdjoints, sum.data());
+      std::size_t k = 0;
+      for (; (w >> k) & 1; ++k) {
+        for (std::size_t j = 0; j < numAdjoints; ++j)
+          levels[k][j] += sum[j];
+        sum.swap(levels[k]);
+        levels[k].clear();
+      }
+      if (k == levels.size())
+        levels.emplace_back();
+      levels[k].swap(sum);
+    }
+    // Fold the remaining sums from the earliest waves to the latest.
+    std::vector<T> total;
+    for (std::size_t k = levels.size(); k-- > 0;) {
+      if (levels[k].empty())
+        continue;
+      if (total.empty()) {
+        total.swap(levels[k]);
+        continue;
+      }
+      for (std::size_t j = 0; j < numAdjoints; ++j)
+        total[j] += levels[k][j];
+    }
+    for (std::size_t j = 0; j < total.size(); ++j)
+      adjoints[j] += total[j];
+  }
+} // namespace clad
+
+#endif // CLAD_REDUCTION_H
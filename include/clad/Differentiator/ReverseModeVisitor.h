@@ -14,8 +14,11 @@
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/AST/StmtVisitor.h"
 #include "clang/Sema/Sema.h"
+#include "llvm/ADT/DenseMap.h"
 
 #include <array>
+#include <cstdint>
+#include <map>
 #include <memory>
 #include <stack>
 #include <unordered_map>
@@ -56,21 +59,62 @@ namespace clad {
     /// tells UsefulToStoreGlobal whether a variable with a given
     /// SourceLocation has to be stored before being changed or not.
     std::set<clang::SourceLocation> m_ToBeRecorded;
+    /// The fields which have to be stored for the objects at the given
+    /// locations, if storing these objects as a whole is not necessary.
+    std::map<clang::SourceLocation,
+             llvm::SmallVector<const clang::FieldDecl*, 4>>
+        m_ToBeRecordedFields;
     /// A flag indicating if the Stmt we are currently visiting is inside loop.
     bool isInsideLoop = false;
     /// Output variable of vector-valued function
     std::string outputArrayStr;
     std::vector<Stmts> m_LoopBlock;
     unsigned outputArrayCursor = 0;
+    /// The number of columns of the Jacobian.
     unsigned numParams = 0;
+    /// The first Jacobian column of each of m_IndependentVars. An array or
+    /// pointer parameter spans one column per element.
+    llvm::SmallVector<unsigned, 16> m_IndependentVarColumns;
     bool isVectorValued = false;
+    /// Whether the Jacobian is stored column by column. It is always strided.
+    bool columnMajorOutput = false;
+    /// Whether the Jacobian takes its leading dimension as a parameter.
+    bool stridedOutput = false;
+    /// The leading dimension parameter of a strided Jacobian.
+    clang::ParmVarDecl* m_LeadingDim = nullptr;
     bool use_enzyme = false;
     bool enableTBR = false;
+    bool enableLifetimeAnalysis = false;
+    bool enableStencilGather = false;
+    bool enableTapeCheckpoint = false;
+    bool enableLoopCheckpointing = false;
+    /// The tapes created while differentiating the body of a checkpointed
+    /// loop, which are cleared after each of its iterations.
+    llvm::SmallVectorImpl<clang::VarDecl*>* m_LoopTapes = nullptr;
+    /// The floating-point type of the adjoints, if it is not the type of the
+    /// primal values.
+    clang::QualType m_AdjointType;
+    /// The values of the parameters bound to constants at the call site. Their
+    /// uses are replaced by the values and the branches on them are folded.
+    llvm::DenseMap<const clang::ValueDecl*, std::int64_t> m_ConstantArgs;
+    /// The pointer and array parameters whose adjoints are passed as one
+    /// array per floating-point field of their elements, and these fields.
+    llvm::DenseMap<const clang::ValueDecl*,
+                   llvm::SmallVector<const clang::FieldDecl*, 8>>
+        m_SoAAdjoints;
     // FIXME: Should we make this an object instead of a pointer?
     // Downside of making it an object: We will need to include
     // 'MultiplexExternalRMVSource.h' file
     MultiplexExternalRMVSource* m_ExternalSource = nullptr;
     clang::Expr* m_Pullback = nullptr;
+    /// The clad::recursion_frame which records the values of the calls to
+    /// recursive functions or from which they are popped. Created on first use.
+    clang::VarDecl* m_RecursionFrame = nullptr;
+    /// The value of the return statement being visited, without parentheses
+    /// and implicit casts.
+    const clang::Expr* m_ReturnedValue = nullptr;
+    /// Caches the results of IsRecordableRecursiveFn.
+    llvm::DenseMap<const clang::FunctionDecl*, bool> m_RecordableRecursiveFns;
     const char* funcPostfix() const {
       if (isVectorValued)
         return "_jac";
@@ -94,6 +138,94 @@ namespace clad {
     // Function to Differentiate with Enzyme as Backend
     void DifferentiateWithEnzyme();
 
+    /// Moves the declarations hoisted to the function scope (`m_Globals`)
+    /// into the only top-level statement of the current block that uses them
+    /// and drops the unused ones, based on the results of LifetimeAnalyzer.
+    void NarrowHoistedDeclScopes();
+
+    /// Returns true if FD is recursive and the values of its calls can be
+    /// recorded by a clad::recursion_frame: FD is a free function returning a
+    /// floating-point value which takes only scalars by value.
+    bool IsRecordableRecursiveFn(const clang::FunctionDecl* FD);
+    /// Returns true if FD is a recordable recursive function which uses the
+    /// value of a call to a recordable function with the same return type
+    /// other than by returning it. The recording pass of FD (f_record) records
+    /// these values and the pullback of FD pops them instead of recomputing
+    /// them.
+    bool HasRecordingPass(const clang::FunctionDecl* FD);
+    /// Returns the recording pass of FD, requesting its definition if needed.
+    clang::FunctionDecl* GetRecordingPass(const clang::FunctionDecl* FD);
+    /// Returns a reference to m_RecursionFrame, creating it on first use.
+    clang::Expr* GetRecursionFrame();
+    /// Builds the value of the call \p CE to the recursive function \p FD
+    /// with the arguments \p args: the recorded value in the pullback of a
+    /// function with a recording pass, the recording of the value in the
+    /// recording pass, or a call to the recording pass of FD whose values are
+    /// popped by the pullback of FD called in the reverse sweep.
+    ///
+    /// \returns nullptr if the call is differentiated as any other call.
+    clang::Expr*
+    BuildRecursiveCallValue(const clang::CallExpr* CE,
+                            const clang::FunctionDecl* FD,
+                            llvm::MutableArrayRef<clang::Expr*> args);
+
+    /// Makes the tape state of the gradient capturable and restorable between
+    /// its forward and its reverse sweep (see clad/Differentiator/TapeState.h).
+    /// The forward sweep is guarded by `clad::restoring_tape_state()` and is
+    /// followed by a call to `clad::sync_tape_state` with the stored values,
+    /// the parameters modified by the function and its top-level local
+    /// variables, whose declarations are moved before the guard.
+    ///
+    /// \param[in,out] Forward The statements of the forward sweep.
+    /// \returns false, leaving Forward unchanged, if the state of the gradient
+    /// cannot be serialized.
+    bool AddTapeStateSync(clang::Stmt*& Forward);
+    /// Finds the parameters in `args` which point to structs and are only
+    /// accessed through the fields of their elements, e.g. `p[i].x`, and
+    /// records the floating-point fields of these structs in m_SoAAdjoints.
+    /// Their adjoints are passed as `T**`, one array of `T` per field.
+    void FindSoAAdjointParams(const DiffParams& args);
+    /// Builds `jacobianMatrix[idx]`, the element of the Jacobian at `row`
+    /// and `col` in the layout requested by `clad::opts::column_major` and
+    /// `clad::opts::strided`.
+    clang::Expr* BuildJacobianElement(unsigned row, unsigned col);
+    /// Builds `jacobianMatrix + idx`, the contiguous elements of the Jacobian
+    /// at `row` starting from `col`. These are the adjoints of an array or
+    /// pointer parameter for the output at `row`.
+    clang::Expr* BuildJacobianRow(unsigned row, unsigned col);
+    /// Builds the index of the element of the Jacobian at `row` and `col`.
+    clang::Expr* BuildJacobianIndex(unsigned row, unsigned col);
+    /// Checks the index \p Idx of an element of \p VD. If \p VD is an
+    /// independent array or pointer parameter of a Jacobian, a constant index
+    /// out of its columns is an error.
+    /// \returns the number of columns of \p VD if \p Idx is a variable index
+    /// which has to be checked at runtime, 0 otherwise.
+    unsigned CheckJacobianColumnIndex(const clang::ValueDecl* VD,
+                                      const clang::Expr* Idx);
+    /// Builds `clad::check_jacobian_index(idx, size)`.
+    clang::Expr* BuildJacobianIndexCheck(clang::Expr* idx, unsigned size);
+    /// Computes the number of Jacobian columns of each of the independent
+    /// variables `args` and records them in m_IndependentVars. The number of
+    /// elements of an array or pointer parameter is given by its requested
+    /// range, e.g. "u[0:2]", its array type or the constant indices used.
+    /// \returns false if the number of elements of an array or pointer
+    /// parameter cannot be determined.
+    bool ComputeJacobianColumns(const DiffParams& args,
+                                const DiffRequest& request);
+    /// Adds the probes timing the forward and the reverse sweep of the
+    /// derivative. The forward sweep ends before the jumps into the reverse
+    /// sweep, see VisitReturnStmt, or at its end if it falls through.
+    ///
+    /// \param[in,out] Forward The statements of the forward sweep.
+    /// \param[in,out] Reverse The statements of the reverse sweep.
+    void AddSweepProbes(clang::Stmt*& Forward, clang::Stmt*& Reverse);
+    /// Builds `clad::prof_end("f_grad:forward")` followed by
+    /// `clad::prof_begin("f_grad:reverse")`.
+    void AddSweepSwitchProbes(Stmts& block);
+    /// Wraps the forward and the reverse statements of a loop into probes
+    /// named after its line.
+    StmtDiff ProfileLoop(const clang::Stmt* Loop, StmtDiff LoopDiff);
+
   public:
     using direction = rmv::direction;
     clang::Expr* dfdx() {
@@ -365,6 +497,11 @@ namespace clad {
                                  const DiffRequest& request);
     DerivativeAndOverload DerivePullback(const clang::FunctionDecl* FD,
                                          const DiffRequest& request);
+    /// Builds the recording pass of a recursive function f, f_record, which
+    /// has the signature of f and runs the forward sweep of the pullback of f,
+    /// recording the values of the recursive calls which the pullback pops.
+    DerivativeAndOverload DeriveRecordingPass(const clang::FunctionDecl* FD,
+                                              const DiffRequest& request);
     StmtDiff VisitArraySubscriptExpr(const clang::ArraySubscriptExpr* ASE);
     StmtDiff VisitBinaryOperator(const clang::BinaryOperator* BinOp);
     StmtDiff VisitCallExpr(const clang::CallExpr* CE);
@@ -386,6 +523,12 @@ namespace clad {
     StmtDiff VisitInitListExpr(const clang::InitListExpr* ILE);
     StmtDiff VisitIntegerLiteral(const clang::IntegerLiteral* IL);
     StmtDiff VisitMemberExpr(const clang::MemberExpr* ME);
+    /// Differentiates `p[i].x`, where the adjoints of `p` are laid out as one
+    /// array per field in `fields`, into `_d_p[k][i]`, `k` being the index of
+    /// `x` in `fields`.
+    StmtDiff VisitSoAMemberExpr(clang::MemberExpr* clonedME,
+                                StmtDiff& baseDiff,
+                                llvm::ArrayRef<const clang::FieldDecl*> fields);
     StmtDiff VisitParenExpr(const clang::ParenExpr* PE);
     virtual StmtDiff VisitReturnStmt(const clang::ReturnStmt* RS);
     StmtDiff VisitStmt(const clang::Stmt* S);
@@ -503,6 +646,31 @@ namespace clad {
       }
     };
 
+    /// Differentiates loops of the form
+    /// `for (int i = lower; i < upper; ++i) out[i] = c0 * in[i + k0] + ...;`
+    /// where the right-hand side is a linear combination of array elements
+    /// with constant offsets and literal coefficients. The default adjoint
+    /// of such a stencil scatters into the elements of `_d_in` and has
+    /// loop-carried write conflicts. Instead, the adjoint is built in gather
+    /// form, where each iteration only updates a single element of `_d_in`,
+    /// so it can be vectorized or parallelized like the original loop.
+    ///
+    /// \returns {forward pass, reverse pass} statements, or an empty StmtDiff
+    /// if the loop is not a stencil.
+    StmtDiff DifferentiateStencilLoop(const clang::ForStmt* FS);
+    /// Differentiates a while or do loop whose number of iterations is only
+    /// known when it ends, recomputing its iterations in the reverse sweep
+    /// from at most CLAD_LOOP_CHECKPOINTS snapshots of the variables it
+    /// assigns instead of taping all of them, see clad::loop_checkpoints.
+    ///
+    /// \returns {forward pass, reverse pass} statements, or an empty StmtDiff
+    /// if the iterations cannot be recomputed.
+    StmtDiff DifferentiateCheckpointedLoop(const clang::Stmt* Loop);
+    /// Rebuilds the expression E of a stencil loop body, replacing the
+    /// references to the loop counter with `counterRef`.
+    clang::Expr* RebuildStencilExpr(const clang::Expr* E,
+                                    const clang::VarDecl* counter,
+                                    clang::Expr* counterRef);
     /// Helper function to differentiate a loop body.
     ///
     ///\param[in] body body of the loop
@@ -647,6 +815,12 @@ namespace clad {
 
     clang::QualType ComputeAdjointType(clang::QualType T);
     clang::QualType ComputeParamType(clang::QualType T);
+    /// Replaces the floating-point types in T, including its element and
+    /// pointee types, with m_AdjointType if it is set.
+    clang::QualType UseAdjointType(clang::QualType T);
+    /// The suffix of the names of the derivatives whose adjoints are stored in
+    /// m_AdjointType, e.g. f_grad_adj_double.
+    std::string AdjointTypeSuffix() const;
     /// Stores data required for differentiating a switch statement.
     struct SwitchStmtInfo {
       llvm::SmallVector<clang::SwitchCase*, 16> cases;
@@ -0,0 +1,95 @@
+#ifndef CLAD_SOA_ADJOINTS_H
+#define CLAD_SOA_ADJOINTS_H
+
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace clad {
+/// The adjoints of an array of structs, laid out as one contiguous array per
+/// floating-point field. Gradients generated with `-enable-soa-adjoints` take
+/// such adjoints for the pointer and array parameters of struct type which
+/// are only accessed through the fields of their elements, e.g. `ps[i].x`:
+///
+/// \code
+/// struct Particle { int id; double x, v; };
+/// double energy(const Particle* ps, int n);
+///
+/// clad::soa_adjoints<double> d_ps(/*numFields=*/2, n); // x and v
+/// int d_n = 0;
+/// auto grad = clad::gradient(energy);
+/// grad.execute(ps, n, d_ps.data(), &d_n);
+/// d_ps.field(1)[i]; // the adjoint of ps[i].v
+/// \endcode
+///
+/// The floating-point fields of the struct are numbered in declaration order,
+/// including those which the differentiated function does not use, so that
+/// the numbering depends only on the struct. The other fields, such as `id`,
+/// take no adjoint memory.
+template <typename T> class soa_adjoints {
+  std::size_t m_NumFields;
+  std::size_t m_Size;
+  std::vector<T> m_Values;
+  std::vector<T*> m_Fields;
+
+public:
+  /// Allocates zeroed adjoints for `size` structs with `numFields`
+  /// floating-point fields.
+  soa_adjoints(std::size_t numFields, std::size_t size)
+      : m_NumFields(numFields), m_Size(size), m_Values(numFields * size, T()),
+        m_Fields(numFields) {
+    for (std::size_t k = 0; k < numFields; ++k)
+      m_Fields[k] = m_Values.data() + k * size;
+  }
+  soa_adjoints(const soa_adjoints&) = delete;
+  soa_adjoints& operator=(const soa_adjoints&) = delete;
+
+  /// \returns the array of field arrays passed to the gradient.
+  T** data() { return m_Fields.data(); }
+  /// \returns the adjoints of the `k`-th floating-point field.
+  T* field(std::size_t k) { return m_Fields[k]; }
+  const T* field(std::size_t k) const { return m_Fields[k]; }
+  std::size_t num_fields() const { return m_NumFields; }
+  std::size_t size() const { return m_Size; }
+
+  /// Sets all the adjoints to zero.
+  void clear() {
+    for (T& v : m_Values)
+      v = T();
+  }
+
+  /// Copies the adjoints stored as an array of structs in `aos`. The members
+  /// are the floating-point fields of `S`, in declaration order.
+  template <typename S, typename... M>
+  void load(const S* aos, M S::*... fields) {
+    assert(sizeof...(fields) == m_NumFields && "wrong number of fields");
+    std::size_t k = 0;
+    int expand[] = {0, (load_field(aos, fields, m_Fields[k++]), 0)...};
+    (void)expand;
+  }
+
+  /// Adds the adjoints to the array of structs `aos`. The members are the
+  /// floating-point fields of `S`, in declaration order.
+  template <typename S, typename... M>
+  void add_to(S* aos, M S::*... fields) const {
+    assert(sizeof...(fields) == m_NumFields && "wrong number of fields");
+    std::size_t k = 0;
+    int expand[] = {0, (add_field(aos, fields, m_Fields[k++]), 0)...};
+    (void)expand;
+  }
+
+private:
+  template <typename S, typename M>
+  void load_field(const S* aos, M S::*field, T* values) const {
+    for (std::size_t i = 0; i < m_Size; ++i)
+      values[i] = aos[i].*field;
+  }
+  template <typename S, typename M>
+  void add_field(S* aos, M S::*field, const T* values) const {
+    for (std::size_t i = 0; i < m_Size; ++i)
+      aos[i].*field += values[i];
+  }
+};
+} // namespace clad
+
+#endif // CLAD_SOA_ADJOINTS_H
@@ -8,6 +8,23 @@
 #include <utility>
 #include "clad/Differentiator/CladConfig.h"
 
+#if defined(CLAD_TAPE_HUGE_PAGES) && defined(__linux__) && !defined(__CUDACC__)
+#include <sys/mman.h>
+#endif
+
+#ifndef CLAD_TAPE_PREFETCH_DISTANCE
+/// The distance in bytes below the top of a tape which pop_back() prefetches,
+/// so that the reverse sweep finds the next values in the cache. 0 disables
+/// the prefetches.
+#define CLAD_TAPE_PREFETCH_DISTANCE 0
+#endif
+
+#ifndef CLAD_TAPE_HUGE_PAGE_THRESHOLD
+/// The size in bytes from which the storage of a tape is backed by
+/// transparent huge pages, when CLAD_TAPE_HUGE_PAGES is defined.
+#define CLAD_TAPE_HUGE_PAGE_THRESHOLD (2 << 20)
+#endif
+
 namespace clad {
   /// Dynamically-sized array (std::vector-like), primarily used for storing
   /// values in reverse-mode AD inside loops.
@@ -31,12 +48,22 @@ namespace clad {
     CUDA_HOST_DEVICE ~tape_impl(){
       destroy(begin(), end());
       // delete the old data here to make sure we do not leak anything.
-      ::operator delete(const_cast<void*>(
-            static_cast<const volatile void*>(_data)));
+      DeallocateRawStorage(_data, _capacity);
     }
 
     /// Move values from old to new storage
     CUDA_HOST_DEVICE T* AllocateRawStorage(std::size_t _capacity) {
+#if defined(CLAD_TAPE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+      if (UsesHugePages(_capacity)) {
+        // Align to the huge page size, so that the kernel can back all of the
+        // storage with huge pages and the TLB covers long reverse sweeps.
+        void* new_data = nullptr;
+        if (posix_memalign(&new_data, _huge_page_size, _capacity * sizeof(T)))
+          return nullptr;
+        madvise(new_data, _capacity * sizeof(T), MADV_HUGEPAGE);
+        return static_cast<T*>(new_data);
+      }
+#endif
       #ifdef __CUDACC__
         // Allocate raw storage (without calling constructors of T) of new capacity.
         T* new_data = static_cast<T*>(::operator new(_capacity * sizeof(T)));
@@ -47,6 +74,20 @@ namespace clad {
       return new_data;
     }
 
+    /// Free storage of the given capacity from AllocateRawStorage.
+    CUDA_HOST_DEVICE void DeallocateRawStorage(T* data, std::size_t capacity) {
+#if defined(CLAD_TAPE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+      if (UsesHugePages(capacity)) {
+        free(data);
+        return;
+      }
+#else
+      (void)capacity;
+#endif
+      ::operator delete(const_cast<void*>(
+            static_cast<const volatile void*>(data)));
+    }
+
     /// Add new value of type T constructed from args to the end of the tape.
     template <typename... ArgsT>
     CUDA_HOST_DEVICE void emplace_back(ArgsT&&... args) {
@@ -91,14 +132,38 @@ namespace clad {
       return begin()[i];
     }
 
+    /// Remove all values from the tape, keeping its storage.
+    CUDA_HOST_DEVICE void clear() {
+      destroy(begin(), end());
+      _size = 0;
+    }
+
     /// Remove the last value from the tape.
     CUDA_HOST_DEVICE void pop_back() {
       assert(_size);
       _size -= 1;
       end()->~T();
+#if CLAD_TAPE_PREFETCH_DISTANCE && !defined(__CUDA_ARCH__) &&                  \
+    (defined(__GNUC__) || defined(__clang__))
+      // The reverse sweep reads the tape towards its beginning, prefetch the
+      // values which it reads next.
+      if (_size > _prefetch_distance)
+        __builtin_prefetch(end() - _prefetch_distance - 1, /*rw=*/0,
+                           /*locality=*/3);
+#endif
     }
 
   private:
+    /// The prefetch distance in values, at least one value if enabled.
+    constexpr static std::size_t _prefetch_distance =
+        (CLAD_TAPE_PREFETCH_DISTANCE + sizeof(T) - 1) / sizeof(T);
+#if defined(CLAD_TAPE_HUGE_PAGES) && defined(MADV_HUGEPAGE)
+    constexpr static std::size_t _huge_page_size = 2 << 20;
+    static bool UsesHugePages(std::size_t capacity) {
+      return capacity * sizeof(T) >= CLAD_TAPE_HUGE_PAGE_THRESHOLD;
+    }
+#endif
+
     // Copies the data from a storage to another.
     // Implementation taken from std::uninitialized_copy
     template <class InputIt, class NoThrowForwardIt>
@@ -117,6 +182,7 @@ namespace clad {
     /// Initial capacity (allocated whenever a value is pushed into empty tape).
     constexpr static std::size_t _init_capacity = 32;
     CUDA_HOST_DEVICE void grow() {
+      std::size_t old_capacity = _capacity;
       // If empty, use initial capacity.
       if (!_capacity)
         _capacity = _init_capacity;
@@ -139,8 +205,7 @@ namespace clad {
       // Destroy all values in the old storage.
       destroy(begin(), end());
       // delete the old data here to make sure we do not leak anything.
-      ::operator delete(const_cast<void*>(
-            static_cast<const volatile void*>(_data)));
+      DeallocateRawStorage(_data, old_capacity);
       _data = new_data;
     }
 
@@ -163,6 +228,117 @@ namespace clad {
     CUDA_HOST_DEVICE
     destroy(It B, It E) {}
   };
+
+#ifndef CLAD_STATIC_TAPE_SIZE
+/// The capacity of the tapes of the derivatives of constexpr functions.
+#define CLAD_STATIC_TAPE_SIZE 64
+#endif
+
+  /// Fixed-capacity array, used instead of tape_impl by the derivatives of
+  /// constexpr functions. It does not allocate as long as it holds at most N
+  /// values, so that these derivatives can be evaluated in constant
+  /// expressions. At runtime, the values pushed beyond the capacity are stored
+  /// in a tape_impl, which is released once they are popped. The reverse sweep
+  /// pops all the values it pushed, therefore the storage does not leak and
+  /// the tape needs no destructor, which would make it a non-literal type.
+  template <typename T, std::size_t N = CLAD_STATIC_TAPE_SIZE>
+  class static_tape {
+    T _data[N] = {};
+    std::size_t _size = 0;
+    tape_impl<T>* _overflow = nullptr;
+
+  public:
+    using value_type = T;
+
+    CUDA_HOST_DEVICE constexpr std::size_t size() const { return _size; }
+    CUDA_HOST_DEVICE constexpr std::size_t capacity() const { return N; }
+
+    /// Add value to the end of the tape.
+    CUDA_HOST_DEVICE CLAD_CONSTEXPR_CXX14 void push_back(const T& val) {
+      if (_size >= N) {
+        if (!_overflow)
+          _overflow = new tape_impl<T>();
+        _overflow->emplace_back(val);
+        ++_size;
+        return;
+      }
+      _data[_size++] = val;
+    }
+
+    /// Access last value (must not be empty).
+    CUDA_HOST_DEVICE CLAD_CONSTEXPR_CXX14 T& back() {
+      assert(_size);
+      if (_size > N)
+        return _overflow->back();
+      return _data[_size - 1];
+    }
+
+    /// Remove the last value from the tape.
+    CUDA_HOST_DEVICE CLAD_CONSTEXPR_CXX14 void pop_back() {
+      assert(_size);
+      if (_size > N) {
+        _overflow->pop_back();
+        if (_size == N + 1) {
+          delete _overflow;
+          _overflow = nullptr;
+        }
+      }
+      _size -= 1;
+    }
+  };
+
+  /// Stores the values of the calls between recursive functions, so that the
+  /// pullbacks do not recompute them. Every invocation of the recording pass
+  /// of a recursive function (f_record) owns a frame and records the values of
+  /// its calls with record(). When the invocation returns, the frame moves its
+  /// values to the stack shared by the functions returning T, so that the
+  /// values of the last returned invocation are on top. The invocations of the
+  /// pullbacks run in the reverse order and pop() their values in the order in
+  /// which they were recorded.
+  template <typename T> class recursion_frame {
+    std::size_t m_Begin;
+
+    static tape_impl<T>& stack() {
+      static thread_local tape_impl<T> s;
+      return s;
+    }
+    /// The values recorded by the frames which did not return yet.
+    static tape_impl<T>& pending() {
+      static thread_local tape_impl<T> s;
+      return s;
+    }
+
+  public:
+    recursion_frame() : m_Begin(pending().size()) {}
+    recursion_frame(const recursion_frame&) = delete;
+    recursion_frame& operator=(const recursion_frame&) = delete;
+    ~recursion_frame() {
+      tape_impl<T>& values = pending();
+      for (std::size_t i = values.size(); i > m_Begin; --i) {
+        stack().emplace_back(values.back());
+        values.pop_back();
+      }
+    }
+
+    /// Records the value of a call made by this invocation.
+    T record(T value) {
+      pending().emplace_back(value);
+      return value;
+    }
+
+    /// Returns the next value recorded by the matching invocation.
+    T pop() {
+      tape_impl<T>& values = stack();
+      if (!values.size()) {
+        printf("No recorded value to pop, the recording pass of the recursive "
+               "function was not called! Aborting.\n");
+        trap(EXIT_FAILURE);
+      }
+      T value = values.back();
+      values.pop_back();
+      return value;
+    }
+  };
 }
 
 #endif // CLAD_TAPE_H
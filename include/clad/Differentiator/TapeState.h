@@ -0,0 +1,217 @@
+#ifndef CLAD_TAPE_STATE_H
+#define CLAD_TAPE_STATE_H
+
+#include "clad/Differentiator/CladConfig.h"
+#include "clad/Differentiator/Tape.h"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+
+namespace clad {
+/// Gradients generated with `-enable-tape-checkpoint` call
+/// `sync_tape_state` between the forward and the reverse sweep with the
+/// tapes, the stored values and the local variables used by the reverse
+/// sweep. Depending on the active session, the state is written to or read
+/// from a binary stream:
+///
+/// \code
+/// { // process 1
+///   clad::tape_state_capture capture(file, /*stop=*/true);
+///   grad.execute(x, &d_x); // runs the forward sweep and saves its state
+/// }
+/// { // process 2
+///   clad::tape_state_restore restore(file);
+///   grad.execute(x, &d_x); // skips the forward sweep and resumes
+/// }
+/// \endcode
+///
+/// The stream starts with a header of the form
+/// `"CLTS" <version> <name length> <name> <number of entries>` followed by
+/// the entries `<element size> <element count> <bytes>`, where all integers
+/// are 32-bit or 64-bit unsigned values in the native byte order.
+namespace tape_state {
+constexpr char kMagic[4] = {'C', 'L', 'T', 'S'};
+constexpr std::uint32_t kVersion = 1;
+
+enum class mode { none, capture, restore };
+
+struct session {
+  mode Mode = mode::none;
+  std::FILE* Stream = nullptr;
+  /// Whether the derivative returns right after the state was captured.
+  bool Stop = false;
+  /// Whether the last synchronization succeeded.
+  bool Ok = false;
+};
+
+/// The session of the current thread, if any. Sessions are single-use: the
+/// first gradient synchronizing with a session closes it.
+inline session*& current() {
+  static thread_local session* s = nullptr;
+  return s;
+}
+
+inline bool write(std::FILE* f, const void* p, std::size_t n) {
+  return std::fwrite(p, 1, n, f) == n;
+}
+inline bool read(std::FILE* f, void* p, std::size_t n) {
+  return std::fread(p, 1, n, f) == n;
+}
+
+template <typename T> struct serializer {
+  static_assert(std::is_trivially_copyable<T>::value &&
+                    !std::is_pointer<T>::value,
+                "only trivially copyable values can be serialized");
+  static bool save(std::FILE* f, const T& v) {
+    std::uint64_t header[2] = {sizeof(T), 1};
+    return write(f, header, sizeof(header)) && write(f, &v, sizeof(T));
+  }
+  static bool load(std::FILE* f, T& v) {
+    std::uint64_t header[2];
+    return read(f, header, sizeof(header)) && header[0] == sizeof(T) &&
+           header[1] == 1 && read(f, &v, sizeof(T));
+  }
+};
+
+template <typename T> struct serializer<tape_impl<T>> {
+  static_assert(std::is_trivially_copyable<T>::value &&
+                    !std::is_pointer<T>::value,
+                "only tapes of trivially copyable values can be serialized");
+  static bool save(std::FILE* f, const tape_impl<T>& t) {
+    std::uint64_t header[2] = {sizeof(T), t.size()};
+    return write(f, header, sizeof(header)) &&
+           (!t.size() || write(f, t.begin(), t.size() * sizeof(T)));
+  }
+  static bool load(std::FILE* f, tape_impl<T>& t) {
+    std::uint64_t header[2];
+    if (!read(f, header, sizeof(header)) || header[0] != sizeof(T))
+      return false;
+    while (t.size())
+      t.pop_back();
+    for (std::uint64_t i = 0; i < header[1]; ++i) {
+      T v;
+      if (!read(f, &v, sizeof(T)))
+        return false;
+      t.emplace_back(v);
+    }
+    return true;
+  }
+};
+
+inline bool save_all(std::FILE*) { return true; }
+template <typename T, typename... Rest>
+bool save_all(std::FILE* f, const T& v, const Rest&... rest) {
+  return serializer<T>::save(f, v) && save_all(f, rest...);
+}
+
+inline bool load_all(std::FILE*) { return true; }
+template <typename T, typename... Rest>
+bool load_all(std::FILE* f, T& v, Rest&... rest) {
+  return serializer<T>::load(f, v) && load_all(f, rest...);
+}
+
+inline bool save_header(std::FILE* f, const char* name, std::uint32_t count) {
+  std::uint32_t length = std::strlen(name);
+  return write(f, kMagic, sizeof(kMagic)) &&
+         write(f, &kVersion, sizeof(kVersion)) &&
+         write(f, &length, sizeof(length)) && write(f, name, length) &&
+         write(f, &count, sizeof(count));
+}
+
+inline bool load_header(std::FILE* f, const char* name, std::uint32_t count) {
+  char magic[sizeof(kMagic)];
+  std::uint32_t version = 0, length = 0, entries = 0;
+  if (!read(f, magic, sizeof(magic)) ||
+      std::memcmp(magic, kMagic, sizeof(kMagic)) ||
+      !read(f, &version, sizeof(version)) || version != kVersion ||
+      !read(f, &length, sizeof(length)) || length != std::strlen(name))
+    return false;
+  for (std::uint32_t i = 0; i < length; ++i) {
+    char c = 0;
+    if (!read(f, &c, 1) || c != name[i])
+      return false;
+  }
+  return read(f, &entries, sizeof(entries)) && entries == count;
+}
+} // namespace tape_state
+
+/// Makes the next gradient of the current thread which synchronizes its tape
+/// state write the state to `stream`. If `stop` is true, that gradient
+/// returns without running its reverse sweep.
+class tape_state_capture {
+  tape_state::session m_Session;
+  tape_state::session* m_Prev;
+
+public:
+  explicit tape_state_capture(std::FILE* stream, bool stop = false)
+      : m_Prev(tape_state::current()) {
+    m_Session.Mode = tape_state::mode::capture;
+    m_Session.Stream = stream;
+    m_Session.Stop = stop;
+    tape_state::current() = &m_Session;
+  }
+  ~tape_state_capture() { tape_state::current() = m_Prev; }
+  tape_state_capture(const tape_state_capture&) = delete;
+  tape_state_capture& operator=(const tape_state_capture&) = delete;
+
+  /// \returns true if the state was captured successfully.
+  bool ok() const { return m_Session.Ok; }
+};
+
+/// Makes the next gradient of the current thread which synchronizes its tape
+/// state skip its forward sweep and read the state from `stream` instead.
+class tape_state_restore {
+  tape_state::session m_Session;
+  tape_state::session* m_Prev;
+
+public:
+  explicit tape_state_restore(std::FILE* stream)
+      : m_Prev(tape_state::current()) {
+    m_Session.Mode = tape_state::mode::restore;
+    m_Session.Stream = stream;
+    tape_state::current() = &m_Session;
+  }
+  ~tape_state_restore() { tape_state::current() = m_Prev; }
+  tape_state_restore(const tape_state_restore&) = delete;
+  tape_state_restore& operator=(const tape_state_restore&) = delete;
+
+  /// \returns true if the state was restored successfully.
+  bool ok() const { return m_Session.Ok; }
+};
+
+/// \returns true if the forward sweep has to be skipped because its state is
+/// going to be restored.
+inline bool restoring_tape_state() {
+  tape_state::session* s = tape_state::current();
+  return s && s->Mode == tape_state::mode::restore;
+}
+
+/// Writes or reads the state of the gradient `name` depending on the active
+/// session. \returns true if the gradient has to return without running its
+/// reverse sweep.
+template <typename... T> bool sync_tape_state(const char* name, T&... vars) {
+  tape_state::session* s = tape_state::current();
+  if (!s || s->Mode == tape_state::mode::none)
+    return false;
+  tape_state::mode m = s->Mode;
+  s->Mode = tape_state::mode::none;
+  if (m == tape_state::mode::capture) {
+    s->Ok = tape_state::save_header(s->Stream, name, sizeof...(T)) &&
+            tape_state::save_all(s->Stream, vars...) &&
+            !std::fflush(s->Stream);
+    return s->Stop;
+  }
+  s->Ok = tape_state::load_header(s->Stream, name, sizeof...(T)) &&
+          tape_state::load_all(s->Stream, vars...);
+  if (!s->Ok) {
+    // The forward sweep was skipped, the reverse sweep cannot run.
+    printf("Failed to restore the tape state of '%s'! Aborting.\n", name);
+    trap(EXIT_FAILURE);
+  }
+  return false;
+}
+} // namespace clad
+
+#endif // CLAD_TAPE_STATE_H
@@ -120,6 +120,8 @@ namespace clad {
     /// The function that is currently differentiated.
     const clang::FunctionDecl* m_Function;
     DiffMode m_Mode;
+    /// Whether timing probes are emitted in the derivative.
+    bool m_EnableProfiling = false;
     /// Map used to keep track of variable declarations and match them
     /// with their derivatives.
     std::unordered_map<const clang::ValueDecl*, clang::Expr*> m_Variables;
@@ -466,6 +468,10 @@ namespace clad {
     clang::LookupResult& GetCladTapeBack();
     /// Instantiate clad::tape<T> type.
     clang::QualType GetCladTapeOfType(clang::QualType T);
+    /// Find declaration of clad::static_tape templated type.
+    clang::TemplateDecl* GetCladStaticTapeDecl();
+    /// Instantiate clad::static_tape<T> type, with the default capacity.
+    clang::QualType GetCladStaticTapeOfType(clang::QualType T);
 
     clang::DeclRefExpr* GetCladTapePushDRE();
 
@@ -541,6 +547,25 @@ namespace clad {
         llvm::ArrayRef<clang::TemplateArgument> templateArgs,
         clang::SourceLocation loc);
 
+    /// \returns the name of the profiled site \p what of the derivative, e.g.
+    /// `f_grad:reverse`, or the name of the derivative if \p what is empty.
+    std::string GetProfilingSite(llvm::StringRef what);
+    /// \returns the name of the profiled site of a loop, `loop@<line>`.
+    std::string GetLoopProfilingSite(const clang::Stmt* Loop);
+    /// Builds `clad::prof_begin(site)` or `clad::prof_end(site)`, depending
+    /// on \p begin, for the site \p what of the derivative. The end probe
+    /// forwards \p value, if given.
+    clang::Expr* BuildProfilingProbe(bool begin, llvm::StringRef what,
+                                     clang::Expr* value = nullptr);
+    /// Builds `{ clad::prof_begin(site); S; clad::prof_end(site); }`.
+    clang::Stmt* BuildProfiledStmt(clang::Stmt* S, llvm::StringRef what);
+    /// Builds `(clad::prof_begin(site), clad::prof_end(site, E))`, or
+    /// `(clad::prof_begin(site), E, clad::prof_end(site))` if E is void.
+    clang::Expr* BuildProfiledExpr(clang::Expr* E, llvm::StringRef what);
+    /// Builds `clad::prof_scope _prof(site);`, which profiles the rest of the
+    /// enclosing block.
+    clang::Stmt* BuildProfilingScope(llvm::StringRef what);
+
     /// Find declaration of clad::array_ref templated type.
     clang::TemplateDecl* GetCladArrayRefDecl();
     /// Create clad::array_ref<T> type.
@@ -81,7 +81,8 @@ BaseForwardModeVisitor::Derive(const FunctionDecl* FD,
   // Check that only one arg is requested and if the arg requested is of array
   // or pointer type, only one of the indices have been requested
   if (DVI.size() > 1 || (isArrayOrPointerType(diffVarInfo.param->getType()) &&
-                         (diffVarInfo.paramIndexInterval.size() != 1))) {
+                         (diffVarInfo.paramIndexInterval.size() != 1) &&
+                         !request.SeedIndexAsParam)) {
     diag(DiagnosticsEngine::Error,
          request.Args ? request.Args->getEndLoc() : noLoc,
          "Forward mode differentiation w.r.t. several parameters at once is "
@@ -117,7 +118,10 @@ BaseForwardModeVisitor::Derive(const FunctionDecl* FD,
       return {};
     }
     m_IndependentVarIndex = diffVarInfo.paramIndexInterval.Start;
-    derivativeSuffix = "_" + std::to_string(m_IndependentVarIndex);
+    // The derivatives w.r.t. an element chosen at runtime are named after the
+    // parameter only, e.g. f_darg1.
+    if (!request.SeedIndexAsParam)
+      derivativeSuffix = "_" + std::to_string(m_IndependentVarIndex);
   } else {
     QualType T = m_IndependentVar->getType();
     bool isField = false;
@@ -167,10 +171,23 @@ BaseForwardModeVisitor::Derive(const FunctionDecl* FD,
   llvm::SaveAndRestore<Scope*> SaveScope(getCurrentScope());
   DeclContext* DC = const_cast<DeclContext*>(m_Function->getDeclContext());
   m_Sema.CurContext = DC;
+  QualType derivedFnType = FD->getType();
+  // The index of the independent element is the last parameter.
+  if (request.SeedIndexAsParam) {
+    const auto* FPT = cast<FunctionProtoType>(FD->getType());
+    llvm::SmallVector<QualType, 8> paramTypes(FPT->param_type_begin(),
+                                              FPT->param_type_end());
+    paramTypes.push_back(m_Context.getSizeType());
+    derivedFnType = m_Context.getFunctionType(
+        FPT->getReturnType(), paramTypes, FPT->getExtProtoInfo());
+  }
   DeclWithContext result =
-      m_Builder.cloneFunction(FD, *this, DC, validLoc, name, FD->getType());
+      m_Builder.cloneFunction(FD, *this, DC, validLoc, name, derivedFnType);
   FunctionDecl* derivedFD = result.first;
   m_Derivative = derivedFD;
+  // The probes cannot be evaluated in constant expressions.
+  m_EnableProfiling =
+      request.EnableSweepProfiling && !m_Derivative->isConstexpr();
 
   llvm::SmallVector<ParmVarDecl*, 4> params;
   ParmVarDecl* newPVD = nullptr;
@@ -206,6 +223,15 @@ BaseForwardModeVisitor::Derive(const FunctionDecl* FD,
                                /*AddToContext*/ false);
   }
 
+  if (request.SeedIndexAsParam) {
+    m_IndependentVarIndexParam = utils::BuildParmVarDecl(
+        m_Sema, derivedFD, CreateUniqueIdentifier("seed"),
+        m_Context.getSizeType());
+    params.push_back(m_IndependentVarIndexParam);
+    m_Sema.PushOnScopeChains(m_IndependentVarIndexParam, getCurrentScope(),
+                             /*AddToContext*/ false);
+  }
+
   llvm::ArrayRef<ParmVarDecl*> paramsRef =
       clad_compat::makeArrayRef(params.data(), params.size());
   derivedFD->setParams(paramsRef);
@@ -216,6 +242,8 @@ BaseForwardModeVisitor::Derive(const FunctionDecl* FD,
     beginScope(Scope::FnScope | Scope::DeclScope);
     m_DerivativeFnScope = getCurrentScope();
     beginBlock();
+    if (m_EnableProfiling)
+      addToCurrentBlock(BuildProfilingScope(""));
     // For each function parameter variable, store its derivative value.
     for (auto* param : params) {
       // We cannot create derivatives of reference type since seed value is
@@ -442,6 +470,8 @@ BaseForwardModeVisitor::DerivePushforward(const FunctionDecl* FD,
   DeclWithContext cloneFunctionResult = m_Builder.cloneFunction(
       m_Function, *this, DC, loc, derivedFnName, derivedFnType);
   m_Derivative = cloneFunctionResult.first;
+  m_EnableProfiling =
+      request.EnableSweepProfiling && !m_Derivative->isConstexpr();
 
   llvm::SmallVector<ParmVarDecl*, 16> params;
   llvm::SmallVector<ParmVarDecl*, 16> derivedParams;
@@ -504,6 +534,8 @@ BaseForwardModeVisitor::DerivePushforward(const FunctionDecl* FD,
     beginScope(Scope::FnScope | Scope::DeclScope);
     m_DerivativeFnScope = getCurrentScope();
     beginBlock();
+    if (m_EnableProfiling)
+      addToCurrentBlock(BuildProfilingScope(""));
 
     // execute the functor inside the function body.
     ExecuteInsidePushforwardFunctionBlock();
@@ -740,9 +772,10 @@ StmtDiff BaseForwardModeVisitor::VisitForStmt(const ForStmt* FS) {
   CompoundStmt* Block = endBlock();
   endScope();
 
-  StmtDiff Result =
-      (Block->size() == 1) ? StmtDiff(forStmtDiff) : StmtDiff(Block);
-  return Result;
+  Stmt* Result = (Block->size() == 1) ? forStmtDiff : Block;
+  if (m_EnableProfiling)
+    Result = BuildProfiledStmt(Result, GetLoopProfilingSite(FS));
+  return StmtDiff(Result);
 }
 
 StmtDiff BaseForwardModeVisitor::VisitReturnStmt(const ReturnStmt* RS) {
@@ -874,8 +907,11 @@ BaseForwardModeVisitor::VisitArraySubscriptExpr(const ArraySubscriptExpr* ASE) {
     Expr::EvalResult res;
     Expr::SideEffectsKind AllowSideEffects =
         Expr::SideEffectsKind::SE_NoSideEffects;
-    if (!clonedIndices.back()->EvaluateAsInt(res, m_Context,
-                                             AllowSideEffects)) {
+    if (m_IndependentVarIndexParam) {
+      diffExpr = BuildParens(BuildOp(BO_EQ, clonedIndices.back(),
+                                     BuildDeclRef(m_IndependentVarIndexParam)));
+    } else if (!clonedIndices.back()->EvaluateAsInt(res, m_Context,
+                                                    AllowSideEffects)) {
       diffExpr =
           BuildParens(BuildOp(BO_EQ, clonedIndices.back(),
                               ConstantFolder::synthesizeLiteral(
@@ -1097,6 +1133,9 @@ StmtDiff BaseForwardModeVisitor::VisitCallExpr(const CallExpr* CE) {
   Expr* callDiff = m_Builder.BuildCallToCustomDerivativeOrNumericalDiff(
       customPushforward, customDerivativeArgs, getCurrentScope(),
       const_cast<DeclContext*>(FD->getDeclContext()));
+  // Whether the derivative is produced by clad, as opposed to a custom or
+  // numerical derivative.
+  bool isCladDerivative = false;
 
   // Check if it is a recursive call.
   if (!callDiff && (FD == m_Function) && m_Mode == GetPushForwardMode()) {
@@ -1111,6 +1150,7 @@ StmtDiff BaseForwardModeVisitor::VisitCallExpr(const CallExpr* CE) {
             .ActOnCallExpr(m_Sema.getScopeForContext(m_Sema.CurContext),
                            derivativeRef, validLoc, pushforwardFnArgs, validLoc)
             .get();
+    isCladDerivative = true;
   }
 
   // If all arguments are constant literals, then this does not contribute to
@@ -1154,6 +1194,7 @@ StmtDiff BaseForwardModeVisitor::VisitCallExpr(const CallExpr* CE) {
     // pushforwardFnRequest.RequestedDerivativeOrder = m_DerivativeOrder;
     // Silence diag outputs in nested derivation process.
     pushforwardFnRequest.VerboseDiags = false;
+    pushforwardFnRequest.EnableSweepProfiling = m_EnableProfiling;
 
     // Check if request already derived in DerivedFunctions.
     FunctionDecl* pushforwardFD =
@@ -1172,6 +1213,7 @@ StmtDiff BaseForwardModeVisitor::VisitCallExpr(const CallExpr* CE) {
     }
 
     if (pushforwardFD) {
+      isCladDerivative = true;
       if (baseDiff.getExpr()) {
         callDiff =
             BuildCallExprToMemFn(baseDiff.getExpr(), pushforwardFD->getName(),
@@ -1217,6 +1259,12 @@ StmtDiff BaseForwardModeVisitor::VisitCallExpr(const CallExpr* CE) {
     return {call, callDiff};
   }
 
+  if (m_EnableProfiling && isCladDerivative) {
+    const FunctionDecl* derivative =
+        cast<CallExpr>(callDiff)->getDirectCallee();
+    callDiff =
+        BuildProfiledExpr(callDiff, "call:" + derivative->getNameAsString());
+  }
   if (FD->getReturnType()->isVoidType())
     return StmtDiff(callDiff, nullptr);
   auto valueAndPushforward =
@@ -1607,6 +1655,8 @@ StmtDiff BaseForwardModeVisitor::VisitWhileStmt(const WhileStmt* WS) {
       clad_compat::Sema_ActOnWhileStmt(m_Sema, condRes, bodyResult).get();
   // end scope for while loop
   endScope();
+  if (m_EnableProfiling)
+    WSDiff = BuildProfiledStmt(WSDiff, GetLoopProfilingSite(WS));
   return StmtDiff(WSDiff);
 }
 
@@ -1643,6 +1693,8 @@ StmtDiff BaseForwardModeVisitor::VisitDoStmt(const DoStmt* DS) {
 
   // end scope for do-while statement
   endScope();
+  if (m_EnableProfiling)
+    S = BuildProfiledStmt(S, GetLoopProfilingSite(DS));
   return StmtDiff(S);
 }
 
@@ -9,6 +9,7 @@
 #include "clang/Basic/Builtins.h"
 #include "clang/Basic/SourceLocation.h"
 #include "clang/Sema/Lookup.h"
+#include "llvm/ADT/SmallPtrSet.h"
 #include "llvm/ADT/SmallVector.h"
 #include "clad/Differentiator/Compatibility.h"
 
@@ -307,6 +308,40 @@ namespace clad {
       return isRefType || isArrayOrPointerType(arg->getType());
     }
 
+    bool IsFieldwiseAssignable(const RecordDecl* RD) {
+      if (!RD || RD->isUnion() || RD->field_empty())
+        return false;
+      if (const auto* CXXRD = dyn_cast<CXXRecordDecl>(RD))
+        if (!CXXRD->hasTrivialCopyAssignment())
+          return false;
+      for (const FieldDecl* FD : RD->fields()) {
+        QualType T = FD->getType();
+        if (FD->getAccess() != AS_public || FD->isAnonymousStructOrUnion() ||
+            T->isReferenceType() || T->isArrayType() || T.isConstQualified())
+          return false;
+      }
+      return true;
+    }
+
+    bool IsFieldwiseAssignment(const Expr* E) {
+      const auto* OCE = dyn_cast<CXXOperatorCallExpr>(E);
+      if (!OCE || OCE->getOperator() != OO_Equal || OCE->getNumArgs() != 2)
+        return false;
+      const auto* MD = dyn_cast_or_null<CXXMethodDecl>(OCE->getDirectCallee());
+      if (!MD || !MD->isTrivial() ||
+          !(MD->isCopyAssignmentOperator() || MD->isMoveAssignmentOperator()))
+        return false;
+      // Both sides are evaluated once per field.
+      for (const Expr* arg : OCE->arguments()) {
+        const Expr* B = arg->IgnoreParenImpCasts();
+        if (!isa<DeclRefExpr>(B) && !isa<MemberExpr>(B))
+          return false;
+        if (B->HasSideEffects(MD->getASTContext()))
+          return false;
+      }
+      return IsFieldwiseAssignable(MD->getParent());
+    }
+
     bool SameCanonicalType(clang::QualType T1, clang::QualType T2) {
       return T1.getCanonicalType() == T2.getCanonicalType();
     }
@@ -639,6 +674,63 @@ namespace clad {
       return finder.hasCallExpr;
     }
 
+    bool IsRecursive(const FunctionDecl* FD) {
+      class CalleeFinder : public RecursiveASTVisitor<CalleeFinder> {
+      public:
+        llvm::SmallVector<const FunctionDecl*, 8> Callees;
+
+        bool VisitCallExpr(CallExpr* CE) {
+          if (const FunctionDecl* Callee = CE->getDirectCallee())
+            Callees.push_back(Callee->getCanonicalDecl());
+          return true;
+        }
+      };
+      const FunctionDecl* Target = FD->getCanonicalDecl();
+      llvm::SmallPtrSet<const FunctionDecl*, 16> Visited;
+      llvm::SmallVector<const FunctionDecl*, 16> Worklist{Target};
+      while (!Worklist.empty()) {
+        const FunctionDecl* Definition = nullptr;
+        if (!Worklist.pop_back_val()->hasBody(Definition))
+          continue;
+        CalleeFinder finder;
+        finder.TraverseStmt(Definition->getBody());
+        for (const FunctionDecl* Callee : finder.Callees) {
+          if (Callee == Target)
+            return true;
+          if (Visited.insert(Callee).second)
+            Worklist.push_back(Callee);
+        }
+      }
+      return false;
+    }
+
+    void GetCallsNotReturned(const Stmt* S,
+                             llvm::SmallVectorImpl<const CallExpr*>& Calls) {
+      class CallFinder : public RecursiveASTVisitor<CallFinder> {
+      public:
+        llvm::SmallVectorImpl<const CallExpr*>& Calls;
+        llvm::SmallPtrSet<const Expr*, 8> Returned;
+
+        CallFinder(llvm::SmallVectorImpl<const CallExpr*>& Calls)
+            : Calls(Calls) {}
+
+        // Return statements are visited before their values.
+        bool VisitReturnStmt(ReturnStmt* RS) {
+          if (const Expr* value = RS->getRetValue())
+            Returned.insert(value->IgnoreParenImpCasts());
+          return true;
+        }
+
+        bool VisitCallExpr(CallExpr* CE) {
+          if (!Returned.count(CE))
+            Calls.push_back(CE);
+          return true;
+        }
+      };
+      CallFinder finder(Calls);
+      finder.TraverseStmt(const_cast<Stmt*>(S));
+    }
+
     void SetSwitchCaseSubStmt(SwitchCase* SC, Stmt* subStmt) {
       if (auto* caseStmt = dyn_cast<CaseStmt>(SC))
         caseStmt->setSubStmt(subStmt);
@@ -6,8 +6,11 @@
 
 #include "clad/Differentiator/DerivativeBuilder.h"
 
+#include "TBRAnalyzer.h"
+
 #include "clang/AST/ASTContext.h"
 #include "clang/AST/TemplateBase.h"
+#include "clang/Lex/Preprocessor.h"
 #include "clang/Sema/Lookup.h"
 #include "clang/Sema/Overload.h"
 #include "clang/Sema/Scope.h"
@@ -26,6 +29,7 @@
 #include "clad/Differentiator/StmtClone.h"
 #include "clad/Differentiator/VectorForwardModeVisitor.h"
 #include "clad/Differentiator/VectorPushForwardModeVisitor.h"
+#include "llvm/Support/raw_ostream.h"
 
 #include <algorithm>
 
@@ -169,6 +173,28 @@ static void registerDerivative(FunctionDecl* derivedFD, Sema& semaRef) {
     return false;
   }
 
+  const TBRAnalysisResult&
+  DerivativeBuilder::getTBRAnalysisResult(const FunctionDecl* FD) {
+    auto it = m_TBRResults.find(FD->getCanonicalDecl());
+    if (it != m_TBRResults.end()) {
+      ++m_NumTBRReuses;
+      return it->second;
+    }
+    ++m_NumTBRAnalyses;
+    TBRAnalyzer analyzer(m_Context);
+    analyzer.Analyze(FD);
+    TBRAnalysisResult& result = m_TBRResults[FD->getCanonicalDecl()];
+    result.ToBeRecorded = analyzer.getResult();
+    result.ToBeRecordedFields = analyzer.getFieldsResult();
+    return result;
+  }
+
+  void DerivativeBuilder::PrintStats(llvm::raw_ostream& Out) const {
+    Out << "*** INFORMATION ABOUT THE TBR ANALYSES\n";
+    Out << "   " << m_NumTBRAnalyses << " functions analyzed, "
+        << m_NumTBRReuses << " results reused\n";
+  }
+
   Expr* DerivativeBuilder::BuildCallToCustomDerivativeOrNumericalDiff(
       const std::string& Name, llvm::SmallVectorImpl<Expr*>& CallArgs,
       clang::Scope* S, clang::DeclContext* originalFnDC,
@@ -192,6 +218,18 @@ static void registerDerivative(FunctionDecl* derivedFD, Sema& semaRef) {
     }
     if (!NSD) {
       NSD = utils::LookupNSD(m_Sema, namespaceID, namespaceShouldExist);
+      // With CLAD_MINIMAL_RUNTIME, the numerical differentiation is declared
+      // by a header which may not be included.
+      if (!forCustomDerv && !NSD &&
+          !m_Sema.getPreprocessor().isMacroDefined("CLAD_NO_NUM_DIFF")) {
+        diag(DiagnosticsEngine::Warning, noLoc,
+             "Numerical differentiation needs "
+             "'clad/Differentiator/NumericalDiff.h', which is not included by "
+             "'clad/Differentiator/Differentiator.h' when "
+             "CLAD_MINIMAL_RUNTIME is defined. Include it or compile with "
+             "-DCLAD_NO_NUM_DIFF.");
+        return nullptr;
+      }
       if (!forCustomDerv && !NSD) {
         diag(DiagnosticsEngine::Warning, noLoc,
              "Numerical differentiation is diabled using the "
@@ -285,6 +323,37 @@ static void registerDerivative(FunctionDecl* derivedFD, Sema& semaRef) {
     handler.pop_back();
   }
 
+  /// \returns the runtime header which declares a part of the runtime that
+  /// the derivative of \p request uses but which is not included, e.g. when
+  /// CLAD_MINIMAL_RUNTIME is defined, or null.
+  static const char* FindMissingRuntimeHeader(Sema& S,
+                                              const DiffRequest& request) {
+    llvm::SmallVector<std::pair<const char*, const char*>, 4> required;
+    if (request.Mode == DiffMode::vector_forward_mode ||
+        request.Mode == DiffMode::experimental_vector_pushforward)
+      required.push_back({"matrix", "clad/Differentiator/Matrix.h"});
+    if (request.EnableSweepProfiling)
+      required.push_back({"prof_begin", "clad/Differentiator/Profiling.h"});
+    if (request.EnableTapeCheckpoint)
+      required.push_back(
+          {"sync_tape_state", "clad/Differentiator/TapeState.h"});
+    if (request.EnableLoopCheckpointing)
+      required.push_back(
+          {"loop_checkpoints", "clad/Differentiator/Checkpointing.h"});
+    if (required.empty())
+      return nullptr;
+
+    NamespaceDecl* CladNS = utils::LookupNSD(S, "clad", /*shouldExist=*/true);
+    for (const auto& decl : required) {
+      LookupResult R(S, &S.getASTContext().Idents.get(decl.first), noLoc,
+                     Sema::LookupOrdinaryName);
+      S.LookupQualifiedName(R, CladNS);
+      if (R.empty())
+        return decl.second;
+    }
+    return nullptr;
+  }
+
   DerivativeAndOverload
   DerivativeBuilder::Derive(const DiffRequest& request) {
     const FunctionDecl* FD = request.Function;
@@ -326,6 +395,16 @@ static void registerDerivative(FunctionDecl* derivedFD, Sema& semaRef) {
       }
     }
 
+    if (const char* header = FindMissingRuntimeHeader(m_Sema, request)) {
+      diag(DiagnosticsEngine::Error,
+           request.CallContext ? request.CallContext->getBeginLoc() : noLoc,
+           "the derivative of '%0' needs '%1', which is not included by "
+           "'clad/Differentiator/Differentiator.h' when CLAD_MINIMAL_RUNTIME "
+           "is defined",
+           {FD->getNameAsString(), header});
+      return {};
+    }
+
     DerivativeAndOverload result{};
     if (request.Mode == DiffMode::forward) {
       BaseForwardModeVisitor V(*this);
@@ -354,6 +433,9 @@ static void registerDerivative(FunctionDecl* derivedFD, Sema& semaRef) {
     } else if (request.Mode == DiffMode::reverse_mode_forward_pass) {
       ReverseModeForwPassVisitor V(*this);
       result = V.Derive(FD, request);
+    } else if (request.Mode == DiffMode::reverse_mode_recording_pass) {
+      ReverseModeVisitor V(*this);
+      result = V.DeriveRecordingPass(FD, request);
     } else if (request.Mode == DiffMode::hessian) {
       HessianModeVisitor H(*this);
       result = H.Derive(FD, request);
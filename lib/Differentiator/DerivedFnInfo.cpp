@@ -10,14 +10,25 @@ DerivedFnInfo::DerivedFnInfo(const DiffRequest& request,
     : m_OriginalFn(request.Function), m_DerivedFn(derivedFn),
       m_OverloadedDerivedFn(overloadedDerivedFn), m_Mode(request.Mode),
       m_DerivativeOrder(request.CurrentDerivativeOrder),
-      m_DiffVarsInfo(request.DVI), m_UsesEnzyme(request.use_enzyme),
-      m_DeclarationOnly(request.DeclarationOnly) {}
+      m_DiffVarsInfo(request.DVI), m_ConstantArgs(request.ConstantArgs),
+      m_UsesEnzyme(request.use_enzyme),
+      m_DeclarationOnly(request.DeclarationOnly),
+      m_ColumnMajorOutput(request.ColumnMajorOutput),
+      m_StridedOutput(request.StridedOutput),
+      m_SeedIndexAsParam(request.SeedIndexAsParam),
+      m_AdjointType(request.AdjointType) {}
 
 bool DerivedFnInfo::SatisfiesRequest(const DiffRequest& request) const {
   return (request.Function == m_OriginalFn && request.Mode == m_Mode &&
           request.CurrentDerivativeOrder == m_DerivativeOrder &&
-          request.DVI == m_DiffVarsInfo && request.use_enzyme == m_UsesEnzyme &&
-          request.DeclarationOnly == m_DeclarationOnly);
+          request.DVI == m_DiffVarsInfo &&
+          request.ConstantArgs == m_ConstantArgs &&
+          request.use_enzyme == m_UsesEnzyme &&
+          request.DeclarationOnly == m_DeclarationOnly &&
+          request.ColumnMajorOutput == m_ColumnMajorOutput &&
+          request.StridedOutput == m_StridedOutput &&
+          request.SeedIndexAsParam == m_SeedIndexAsParam &&
+          request.AdjointType == m_AdjointType);
 }
 
 bool DerivedFnInfo::IsValid() const { return m_OriginalFn && m_DerivedFn; }
@@ -27,7 +38,12 @@ bool DerivedFnInfo::RepresentsSameDerivative(const DerivedFnInfo& lhs,
   return lhs.m_OriginalFn == rhs.m_OriginalFn &&
          lhs.m_DerivativeOrder == rhs.m_DerivativeOrder &&
          lhs.m_Mode == rhs.m_Mode && lhs.m_DiffVarsInfo == rhs.m_DiffVarsInfo &&
+         lhs.m_ConstantArgs == rhs.m_ConstantArgs &&
          lhs.m_UsesEnzyme == rhs.m_UsesEnzyme &&
-         lhs.m_DeclarationOnly == rhs.m_DeclarationOnly;
+         lhs.m_DeclarationOnly == rhs.m_DeclarationOnly &&
+         lhs.m_ColumnMajorOutput == rhs.m_ColumnMajorOutput &&
+         lhs.m_StridedOutput == rhs.m_StridedOutput &&
+         lhs.m_SeedIndexAsParam == rhs.m_SeedIndexAsParam &&
+         lhs.m_AdjointType == rhs.m_AdjointType;
 }
 } // namespace clad
\ No newline at end of file
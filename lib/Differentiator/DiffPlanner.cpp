@@ -8,6 +8,7 @@
 #include "clang/Sema/SemaDiagnostic.h"
 #include "clang/Sema/TemplateDeduction.h"
 
+#include "llvm/Support/MathExtras.h"
 #include "llvm/Support/SaveAndRestore.h"
 
 #include "clad/Differentiator/CladConfig.h"
@@ -245,6 +246,15 @@ namespace clad {
     }
   }
 
+  bool DiffCollector::TraverseDecl(Decl* D) {
+    const FunctionDecl* enclosingFD = m_EnclosingFD;
+    if (auto* FD = dyn_cast_or_null<FunctionDecl>(D))
+      enclosingFD = FD;
+    llvm::SaveAndRestore<const FunctionDecl*> saveEnclosing(m_EnclosingFD,
+                                                            enclosingFD);
+    return RecursiveASTVisitor<DiffCollector>::TraverseDecl(D);
+  }
+
   /// Returns true if `FD` is a call operator; otherwise returns false.
   static bool isCallOperator(ASTContext& Context, const FunctionDecl* FD) {
     if (auto method = dyn_cast<CXXMethodDecl>(FD)) {
@@ -297,6 +307,7 @@ namespace clad {
       return;
     }
     DVI.clear();
+    ConstantArgs.clear();
     auto& C = semaRef.getASTContext();
     const Expr* diffArgs = Args;
     const FunctionDecl* FD = Function;
@@ -322,6 +333,92 @@ namespace clad {
         std::tie(pInfo, string) = string.split(',');
         diffParamsSpec.push_back(pInfo.trim());
       } while (!string.empty());
+
+      // Parameters bound to constants, e.g. "n = 3", are not independent.
+      auto* bindingsEnd = std::stable_partition(
+          diffParamsSpec.begin(), diffParamsSpec.end(),
+          [](llvm::StringRef spec) { return !spec.contains('='); });
+      for (llvm::StringRef binding : llvm::make_range(bindingsEnd,
+                                                      diffParamsSpec.end())) {
+        llvm::StringRef name, valueStr;
+        std::tie(name, valueStr) = binding.split('=');
+        name = name.trim();
+        valueStr = valueStr.trim();
+        if (Mode != DiffMode::reverse) {
+          utils::EmitDiag(semaRef, DiagnosticsEngine::Error,
+                          diffArgs->getEndLoc(),
+                          "Parameters can only be bound to constants in "
+                          "reverse mode, '%0' is not supported",
+                          {binding});
+          return;
+        }
+        const auto* pIt = std::find_if(
+            FD->param_begin(), FD->param_end(),
+            [name](const ParmVarDecl* PVD) { return PVD->getName() == name; });
+        if (pIt == FD->param_end()) {
+          utils::EmitDiag(semaRef, DiagnosticsEngine::Error,
+                          diffArgs->getEndLoc(),
+                          "Requested parameter name '%0' was not found among "
+                          "function parameters",
+                          {name});
+          return;
+        }
+        if (!(*pIt)->getType()->isIntegralType(C)) {
+          utils::EmitDiag(semaRef, DiagnosticsEngine::Error,
+                          diffArgs->getEndLoc(),
+                          "Only parameters of integral type can be bound to "
+                          "constants, '%0' is not supported",
+                          {binding});
+          return;
+        }
+        std::int64_t value = 0;
+        if (valueStr == "true" || valueStr == "false") {
+          value = valueStr == "true";
+        } else if (valueStr.getAsInteger(/*Radix=*/10, value)) {
+          utils::EmitDiag(semaRef, DiagnosticsEngine::Error,
+                          diffArgs->getEndLoc(),
+                          "Could not parse the constant bound in '%0'",
+                          {binding});
+          return;
+        }
+        // The derivative folds the bound value in the type of the parameter.
+        QualType paramTy = (*pIt)->getType();
+        unsigned width = C.getIntWidth(paramTy);
+        if (paramTy->isUnsignedIntegerOrEnumerationType()
+                ? value < 0 || !llvm::isUIntN(width, value)
+                : !llvm::isIntN(width, value)) {
+          utils::EmitDiag(semaRef, DiagnosticsEngine::Error,
+                          diffArgs->getEndLoc(),
+                          "The constant bound in '%0' is not representable "
+                          "in the type of '%1'",
+                          {binding, name});
+          return;
+        }
+        for (const auto& CA : ConstantArgs) {
+          if (CA.first == *pIt) {
+            utils::EmitDiag(
+                semaRef, DiagnosticsEngine::Error, diffArgs->getEndLoc(),
+                "Requested parameter '%0' was specified multiple times",
+                {name});
+            return;
+          }
+        }
+        ConstantArgs.emplace_back(*pIt, value);
+      }
+      diffParamsSpec.erase(bindingsEnd, diffParamsSpec.end());
+      // Keep the bindings in the order of the parameters, so that equal
+      // requests are recognized.
+      std::sort(ConstantArgs.begin(), ConstantArgs.end(),
+                [](const std::pair<const ParmVarDecl*, std::int64_t>& a,
+                   const std::pair<const ParmVarDecl*, std::int64_t>& b) {
+                  return a.first->getFunctionScopeIndex() <
+                         b.first->getFunctionScopeIndex();
+                });
+      if (diffParamsSpec.empty()) {
+        utils::EmitDiag(semaRef, DiagnosticsEngine::Error,
+                        diffArgs->getEndLoc(), "No parameters were provided");
+        return;
+      }
       // Stores parameters and field declarations to be used as candidates for
       // independent arguments.
       // If we are differentiating a call operator that have no parameters,
@@ -402,7 +499,17 @@ namespace clad {
         }
 
         dVarInfo.param = it->second;
-        
+        for (const auto& CA : ConstantArgs) {
+          if (CA.first == dVarInfo.param) {
+            utils::EmitDiag(semaRef, DiagnosticsEngine::Error,
+                            diffArgs->getEndLoc(),
+                            "Requested parameter '%0' cannot be both "
+                            "independent and bound to a constant",
+                            {pName});
+            return;
+          }
+        }
+
         std::size_t lSqBracketIdx = diffSpec.find("[");
         if (lSqBracketIdx != llvm::StringRef::npos) {
           llvm::StringRef interval(diffSpec.slice(lSqBracketIdx + 1, diffSpec.find(']')));
@@ -583,6 +690,12 @@ namespace clad {
       if (!DRE)
         return true;
       DiffRequest request{};
+      request.EnableLifetimeAnalysis = m_Options.EnableLifetimeAnalysis;
+      request.EnableStencilGather = m_Options.EnableStencilGather;
+      request.EnableTapeCheckpoint = m_Options.EnableTapeCheckpoint;
+      request.EnableLoopCheckpointing = m_Options.EnableLoopCheckpointing;
+      request.EnableSweepProfiling = m_Options.EnableSweepProfiling;
+      request.EnableSoAAdjoints = m_Options.EnableSoAAdjoints;
 
       // bitmask_opts is a template pack of unsigned integers, so we need to
       // do bitwise or of all the values to get the final value.
@@ -617,6 +730,42 @@ namespace clad {
         }
       }
 
+      if ((clad::HasOption(bitmasked_opts_value, clad::opts::column_major) ||
+           clad::HasOption(bitmasked_opts_value, clad::opts::strided)) &&
+          !A->getAnnotation().equals("H") && !A->getAnnotation().equals("J")) {
+        utils::EmitDiag(m_Sema, DiagnosticsEngine::Error, endLoc,
+                        "Output layout options are only supported by "
+                        "clad::jacobian and clad::hessian.");
+        return true;
+      }
+
+      bool float_adjoints_in_req =
+          clad::HasOption(bitmasked_opts_value, clad::opts::float_adjoints);
+      bool double_adjoints_in_req =
+          clad::HasOption(bitmasked_opts_value, clad::opts::double_adjoints);
+      if (float_adjoints_in_req || double_adjoints_in_req) {
+        if (!A->getAnnotation().equals("G")) {
+          utils::EmitDiag(m_Sema, DiagnosticsEngine::Error, endLoc,
+                          "Adjoint precision options are only supported by "
+                          "clad::gradient.");
+          return true;
+        }
+        if (float_adjoints_in_req && double_adjoints_in_req) {
+          utils::EmitDiag(m_Sema, DiagnosticsEngine::Error, endLoc,
+                          "Both float and double adjoint options are "
+                          "specified.");
+          return true;
+        }
+        if (clad::HasOption(bitmasked_opts_value, clad::opts::use_enzyme)) {
+          utils::EmitDiag(m_Sema, DiagnosticsEngine::Error, endLoc,
+                          "Adjoint precision options are not supported with "
+                          "Enzyme.");
+          return true;
+        }
+        ASTContext& C = m_Sema.getASTContext();
+        request.AdjointType = float_adjoints_in_req ? C.FloatTy : C.DoubleTy;
+      }
+
       if (A->getAnnotation().equals("D")) {
         request.Mode = DiffMode::forward;
         unsigned derivative_order =
@@ -651,8 +800,25 @@ namespace clad {
         }
       } else if (A->getAnnotation().equals("H")) {
         request.Mode = DiffMode::hessian;
+        // The Hessian is symmetric, so its row-major and column-major
+        // layouts are the same.
+        request.StridedOutput =
+            clad::HasOption(bitmasked_opts_value, clad::opts::strided);
       } else if (A->getAnnotation().equals("J")) {
         request.Mode = DiffMode::jacobian;
+        request.ColumnMajorOutput =
+            clad::HasOption(bitmasked_opts_value, clad::opts::column_major);
+        request.StridedOutput =
+            clad::HasOption(bitmasked_opts_value, clad::opts::strided);
+        // Only the caller knows the number of rows of the Jacobian, which
+        // separates its columns.
+        if (request.ColumnMajorOutput && !request.StridedOutput) {
+          utils::EmitDiag(m_Sema, DiagnosticsEngine::Error, endLoc,
+                          "clad::opts::column_major requires "
+                          "clad::opts::strided, whose leading dimension is "
+                          "the number of rows of the Jacobian.");
+          return true;
+        }
       } else if (A->getAnnotation().equals("G")) {
         request.Mode = DiffMode::reverse;
         if (clad::HasOption(bitmasked_opts_value, clad::opts::use_enzyme))
@@ -667,6 +833,7 @@ namespace clad {
         request.Mode = DiffMode::error_estimation;
       }
       request.CallContext = E;
+      request.EnclosingFunction = m_EnclosingFD;
       request.CallUpdateRequired = true;
       request.VerboseDiags = true;
       request.Args = E->getArg(1);
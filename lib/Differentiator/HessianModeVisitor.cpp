@@ -63,6 +63,7 @@ namespace clad {
 
     // Further derives function w.r.t to ReverseModeArgs
     IndependentArgRequest.Mode = DiffMode::reverse;
+    IndependentArgRequest.SeedIndexAsParam = false;
     IndependentArgRequest.Function = firstDerivative;
     IndependentArgRequest.Args = ReverseModeArgs;
     IndependentArgRequest.BaseFunctionName = firstDerivative->getNameAsString();
@@ -99,6 +100,9 @@ namespace clad {
       std::copy(FD->param_begin(), FD->param_end(), std::back_inserter(args));
 
     std::vector<FunctionDecl*> secondDerivativeColumns;
+    // The requested elements of each array, whose index is passed to the
+    // corresponding second derivative, or an empty interval for scalars.
+    IndexIntervalTable secondDerivativeSeeds;
     llvm::SmallVector<size_t, 16> IndependentArgsSize{};
     size_t TotalIndependentArgsSize = 0;
 
@@ -118,6 +122,8 @@ namespace clad {
         hessianFuncName += ('_' + std::to_string(idx));
       }
     }
+    if (request.StridedOutput)
+      hessianFuncName += "_strided";
 
     // Ascertains the independent arguments and differentiates the function
     // in forward and reverse mode by calling ProcessDiffRequest twice each
@@ -165,24 +171,28 @@ namespace clad {
             return {};
           }
 
-          IndependentArgsSize.push_back(indexIntervalTable[argIndex].size());
-          TotalIndependentArgsSize += indexIntervalTable[argIndex].size();
-
-          // Derive the function w.r.t. to each requested index of the current
-          // array in forward mode and then in reverse mode w.r.t to all
-          // requested args
-          for (auto i = indexIntervalTable[argIndex].Start;
-               i < indexIntervalTable[argIndex].Finish; i++) {
-            auto independentArgString =
-                PVD->getNameAsString() + "[" + std::to_string(i) + "]";
-            auto ForwardModeIASL =
-                CreateStringLiteral(m_Context, independentArgString);
-            auto DFD =
-                DeriveUsingForwardAndReverseMode(m_Sema, m_CladPlugin, request,
-                                                 ForwardModeIASL, request.Args);
-            secondDerivativeColumns.push_back(DFD);
-          }
-
+          IndexInterval interval = indexIntervalTable[argIndex];
+          IndependentArgsSize.push_back(interval.size());
+          TotalIndependentArgsSize += interval.size();
+
+          // Derive the function once in forward mode w.r.t. the element of
+          // the current array whose index is passed at runtime, and then in
+          // reverse mode w.r.t to all requested args. The Hessian calls it
+          // for each requested index.
+          std::string independentArgString =
+              PVD->getNameAsString() + "[" + std::to_string(interval.Start);
+          if (interval.size() > 1)
+            independentArgString += ":" + std::to_string(interval.Finish - 1);
+          independentArgString += "]";
+          DiffRequest seededRequest = request;
+          seededRequest.SeedIndexAsParam = true;
+          auto ForwardModeIASL =
+              CreateStringLiteral(m_Context, independentArgString);
+          auto DFD = DeriveUsingForwardAndReverseMode(
+              m_Sema, m_CladPlugin, seededRequest, ForwardModeIASL,
+              request.Args);
+          secondDerivativeColumns.push_back(DFD);
+          secondDerivativeSeeds.push_back(interval);
         } else {
           IndependentArgsSize.push_back(1);
           TotalIndependentArgsSize++;
@@ -194,11 +204,14 @@ namespace clad {
                                                       request, ForwardModeIASL,
                                                       request.Args);
           secondDerivativeColumns.push_back(DFD);
+          secondDerivativeSeeds.push_back(IndexInterval());
         }
       }
     }
-    return Merge(secondDerivativeColumns, IndependentArgsSize,
-                 TotalIndependentArgsSize, hessianFuncName);
+    return Merge(secondDerivativeColumns, secondDerivativeSeeds,
+                 IndependentArgsSize,
+                 TotalIndependentArgsSize, hessianFuncName,
+                 request.StridedOutput);
   }
 
   // Combines all generated second derivative functions into a
@@ -206,9 +219,10 @@ namespace clad {
   // secon derivative function in FunctionBody.
   DerivativeAndOverload
   HessianModeVisitor::Merge(std::vector<FunctionDecl*> secDerivFuncs,
+                            const IndexIntervalTable& secDerivSeeds,
                             SmallVector<size_t, 16> IndependentArgsSize,
                             size_t TotalIndependentArgsSize,
-                            std::string hessianFuncName) {
+                            std::string hessianFuncName, bool stridedOutput) {
     DiffParams args;
     std::copy(m_Function->param_begin(),
               m_Function->param_end(),
@@ -225,6 +239,9 @@ namespace clad {
                    [](const ParmVarDecl* PVD) { return PVD->getType(); });
 
     paramTypes.back() = m_Context.getPointerType(m_Function->getReturnType());
+    // The leading dimension of the matrix.
+    if (stridedOutput)
+      paramTypes.push_back(m_Context.getSizeType());
 
     auto originalFnProtoType = cast<FunctionProtoType>(m_Function->getType());
     QualType hessianFunctionType = m_Context.getFunctionType(
@@ -275,26 +292,40 @@ namespace clad {
                    });
 
     // The output parameter "hessianMatrix".
-    params.back() = ParmVarDecl::Create(
+    ParmVarDecl*& hessianPVD = params[m_Function->getNumParams()];
+    hessianPVD = ParmVarDecl::Create(
         m_Context,
         hessianFD,
         noLoc,
         noLoc,
         &m_Context.Idents.get("hessianMatrix"),
-        paramTypes.back(),
-        m_Context.getTrivialTypeSourceInfo(paramTypes.back(), noLoc),
+        paramTypes[m_Function->getNumParams()],
+        m_Context.getTrivialTypeSourceInfo(
+            paramTypes[m_Function->getNumParams()], noLoc),
         params.front()->getStorageClass(),
         /* No default value */ nullptr);
 
-    if (params.back()->getIdentifier())
-      m_Sema.PushOnScopeChains(params.back(),
+    if (hessianPVD->getIdentifier())
+      m_Sema.PushOnScopeChains(hessianPVD,
                                getCurrentScope(),
                                /*AddToContext*/ false);
 
+    ParmVarDecl* leadingDimPVD = nullptr;
+    if (stridedOutput) {
+      QualType sizeTy = m_Context.getSizeType();
+      leadingDimPVD = ParmVarDecl::Create(
+          m_Context, hessianFD, noLoc, noLoc, &m_Context.Idents.get("ld"),
+          sizeTy, m_Context.getTrivialTypeSourceInfo(sizeTy, noLoc),
+          SC_None, /* No default value */ nullptr);
+      params.back() = leadingDimPVD;
+      m_Sema.PushOnScopeChains(leadingDimPVD, getCurrentScope(),
+                               /*AddToContext*/ false);
+    }
+
     llvm::ArrayRef<ParmVarDecl*> paramsRef =
         clad_compat::makeArrayRef(params.data(), params.size());
     hessianFD->setParams(paramsRef);
-    Expr* m_Result = BuildDeclRef(params.back());
+    Expr* m_Result = BuildDeclRef(hessianPVD);
     std::vector<Stmt*> CompStmtSave;
 
     beginScope(Scope::FnScope | Scope::DeclScope);
@@ -302,22 +333,45 @@ namespace clad {
 
     // Creates callExprs to the second derivative functions genereated
     // and creates maps array elements to input array.
+    auto size_type = m_Context.getSizeType();
+    auto size_type_bits = m_Context.getIntWidth(size_type);
+    auto buildSizeLiteral = [&](size_t value) -> Expr* {
+      return IntegerLiteral::Create(
+          m_Context, llvm::APInt(size_type_bits, value), size_type, noLoc);
+    };
+    size_t rowIndex = 0;
     for (size_t i = 0, e = secDerivFuncs.size(); i < e; ++i) {
-      const size_t HessianMatrixStartIndex = i * TotalIndependentArgsSize;
-      auto size_type = m_Context.getSizeType();
-      auto size_type_bits = m_Context.getIntWidth(size_type);
+      const IndexInterval& seed = secDerivSeeds[i];
+      const size_t numSeeds = seed.Finish - seed.Start;
+
+      // The second derivatives w.r.t. the elements of an array are computed
+      // by the same function, called in a loop over the requested indices:
+      // for (size_t i = 0; i < size; ++i)
+      //   f_darg1_grad(x, p, start + i, hessianMatrix + ..., ...);
+      VarDecl* seedVD = nullptr;
+      if (numSeeds) {
+        beginScope(Scope::DeclScope | Scope::ControlScope |
+                   Scope::BreakScope | Scope::ContinueScope);
+        seedVD = BuildVarDecl(size_type, "i", buildSizeLiteral(0));
+      }
 
       // Transforms ParmVarDecls into Expr paramters for insertion into function
       std::vector<Expr*> DeclRefToParams;
-      DeclRefToParams.resize(params.size());
+      DeclRefToParams.resize(m_Function->getNumParams());
       std::transform(params.begin(),
-                     std::prev(params.end()),
+                     params.begin() + m_Function->getNumParams(),
                      std::begin(DeclRefToParams),
                      [&](ParmVarDecl* PVD) {
                        auto VD = BuildDeclRef(PVD);
                        return VD;
                      });
-      DeclRefToParams.pop_back();
+      // The index of the element of the array.
+      if (seedVD) {
+        Expr* seedIdx = BuildDeclRef(seedVD);
+        if (seed.Start)
+          seedIdx = BuildOp(BO_Add, buildSizeLiteral(seed.Start), seedIdx);
+        DeclRefToParams.push_back(seedIdx);
+      }
 
       /// If we are differentiating a member function then create a parameter
       /// that can represent the derivative for the implicit `this` pointer. It
@@ -350,11 +404,32 @@ namespace clad {
       size_t columnIndex = 0;
       // Create Expr parameters for each independent arg in the CallExpr
       for (size_t indArgSize : IndependentArgsSize) {
-        llvm::APInt offsetValue(size_type_bits,
-                                HessianMatrixStartIndex + columnIndex);
-        // Create the offset argument.
-        Expr* OffsetArg =
-            IntegerLiteral::Create(m_Context, offsetValue, size_type, noLoc);
+        Expr* OffsetArg = nullptr;
+        if (leadingDimPVD) {
+          // The rows of a strided matrix start at multiples of `ld`, the
+          // offset is row * ld + columnIndex.
+          Expr* row = rowIndex ? buildSizeLiteral(rowIndex) : nullptr;
+          if (seedVD)
+            row = row ? BuildParens(BuildOp(BO_Add, row,
+                                            BuildDeclRef(seedVD)))
+                      : BuildDeclRef(seedVD);
+          Expr* rowStart =
+              row ? BuildOp(BO_Mul, row, BuildDeclRef(leadingDimPVD))
+                  : nullptr;
+          OffsetArg = buildSizeLiteral(columnIndex);
+          if (rowStart)
+            OffsetArg =
+                columnIndex ? BuildOp(BO_Add, rowStart, OffsetArg) : rowStart;
+        } else {
+          OffsetArg = buildSizeLiteral(rowIndex * TotalIndependentArgsSize +
+                                       columnIndex);
+          // The rows of the elements of an array are consecutive.
+          if (seedVD)
+            OffsetArg = BuildOp(
+                BO_Add, OffsetArg,
+                BuildOp(BO_Mul, BuildDeclRef(seedVD),
+                        buildSizeLiteral(TotalIndependentArgsSize)));
+        }
         // Create the hessianMatrix + OffsetArg expression.
         Expr* SliceExpr = BuildOp(BO_Add, m_Result, OffsetArg);
 
@@ -362,7 +437,19 @@ namespace clad {
         columnIndex += indArgSize;
       }
       Expr* call = BuildCallExprToFunction(secDerivFuncs[i], DeclRefToParams);
-      CompStmtSave.push_back(call);
+      if (seedVD) {
+        Expr* cond = BuildOp(BO_LT, BuildDeclRef(seedVD),
+                             buildSizeLiteral(numSeeds));
+        Expr* inc = BuildOp(UO_PreInc, BuildDeclRef(seedVD));
+        CompStmtSave.push_back(new (m_Context) ForStmt(
+            m_Context, BuildDeclStmt(seedVD), cond, /*condVar=*/nullptr, inc,
+            call, noLoc, noLoc, noLoc));
+        endScope();
+        rowIndex += numSeeds;
+      } else {
+        CompStmtSave.push_back(call);
+        rowIndex += 1;
+      }
     }
 
     auto StmtsRef =
@@ -0,0 +1,121 @@
+#include "LifetimeAnalyzer.h"
+
+#include "clang/AST/Decl.h"
+#include "clang/AST/Expr.h"
+#include "clang/AST/Stmt.h"
+
+#include "llvm/ADT/STLExtras.h"
+
+using namespace clang;
+
+namespace clad {
+
+LifetimeAnalyzer::Result
+LifetimeAnalyzer::Analyze(llvm::ArrayRef<Stmt*> body,
+                          const llvm::SmallPtrSetImpl<Stmt*>& hoisted) {
+  Result res;
+  res.Sinkable.resize(body.size());
+
+  // Collect the candidates. Only single variable declarations are considered,
+  // static and reference variables have lifetimes that do not depend on their
+  // scope.
+  for (Stmt* S : body) {
+    auto* DS = dyn_cast<DeclStmt>(S);
+    if (!DS || !hoisted.count(DS) || !DS->isSingleDecl())
+      continue;
+    auto* VD = dyn_cast<VarDecl>(DS->getSingleDecl());
+    if (!VD || !VD->hasLocalStorage() || VD->getType()->isReferenceType())
+      continue;
+    m_Candidates.emplace_back(VD, DS);
+  }
+  if (m_Candidates.empty())
+    return res;
+
+  // Compute the top-level statements referencing each candidate.
+  llvm::SmallVector<bool, 16> hasLabel(body.size(), false);
+  for (unsigned i = 0, e = body.size(); i < e; ++i) {
+    m_CurIdx = i;
+    m_InHoisted = hoisted.count(body[i]);
+    m_CurHoisted = nullptr;
+    if (m_InHoisted)
+      if (auto* DS = dyn_cast<DeclStmt>(body[i]))
+        if (DS->isSingleDecl())
+          m_CurHoisted = dyn_cast<VarDecl>(DS->getSingleDecl());
+    m_HasLabel = false;
+    TraverseStmt(body[i]);
+    hasLabel[i] = m_HasLabel;
+  }
+
+  for (auto& candidate : m_Candidates) {
+    const VarDecl* VD = candidate.first;
+    if (m_Pinned.count(VD))
+      continue;
+    auto it = m_UseIdx.find(VD);
+    // Initializers which may have side effects, e.g. calls to non-trivial
+    // constructors, must run where and when they were written.
+    const Expr* init = VD->getInit();
+    bool mayHaveSideEffects =
+        init &&
+        init->HasSideEffects(m_Context, /*IncludePossibleEffects=*/true);
+    if (it == m_UseIdx.end()) {
+      if (!mayHaveSideEffects)
+        res.Dead.push_back(candidate.second);
+      continue;
+    }
+    unsigned idx = it->second;
+    if (idx == kManyUses || hasLabel[idx] || isa<DeclStmt>(body[idx]))
+      continue;
+    // The initializer is evaluated later once moved, so the variables it reads
+    // must keep their values until then. Non-local variables and references
+    // may be modified through other names.
+    auto readsIt = m_InitReads.find(VD);
+    if (readsIt != m_InitReads.end() &&
+        llvm::any_of(readsIt->second, [&](const VarDecl* V) {
+          if (!V->hasLocalStorage() || V->getType()->isReferenceType())
+            return true;
+          auto nonLoadIt = m_FirstNonLoad.find(V);
+          return nonLoadIt != m_FirstNonLoad.end() && nonLoadIt->second < idx;
+        }))
+      continue;
+    if (mayHaveSideEffects)
+      continue;
+    res.Sinkable[idx].push_back(candidate.second);
+  }
+  return res;
+}
+
+bool LifetimeAnalyzer::VisitDeclRefExpr(DeclRefExpr* DRE) {
+  const auto* VD = dyn_cast<VarDecl>(DRE->getDecl());
+  if (!VD)
+    return true;
+  if (!m_LoadedRefs.count(DRE))
+    m_FirstNonLoad.try_emplace(VD, m_CurIdx);
+  if (m_InHoisted) {
+    m_Pinned.insert(VD);
+    if (m_CurHoisted)
+      m_InitReads[m_CurHoisted].push_back(VD);
+    return true;
+  }
+  auto it = m_UseIdx.find(VD);
+  if (it == m_UseIdx.end())
+    m_UseIdx[VD] = m_CurIdx;
+  else if (it->second != m_CurIdx)
+    it->second = kManyUses;
+  return true;
+}
+
+bool LifetimeAnalyzer::VisitImplicitCastExpr(ImplicitCastExpr* ICE) {
+  // Casts are visited before their operands.
+  if (ICE->getCastKind() == CK_LValueToRValue)
+    if (const auto* DRE =
+            dyn_cast<DeclRefExpr>(ICE->getSubExpr()->IgnoreParens()))
+      m_LoadedRefs.insert(DRE);
+  return true;
+}
+
+bool LifetimeAnalyzer::VisitLabelStmt(LabelStmt* /*LS*/) {
+  m_HasLabel = true;
+  return true;
+}
+
+} // end namespace clad
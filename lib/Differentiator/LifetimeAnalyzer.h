@@ -0,0 +1,98 @@
+#ifndef CLAD_DIFFERENTIATOR_LIFETIMEANALYZER_H
+#define CLAD_DIFFERENTIATOR_LIFETIMEANALYZER_H
+
+#include "clang/AST/RecursiveASTVisitor.h"
+
+#include "llvm/ADT/ArrayRef.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+
+#include <vector>
+
+namespace clad {
+
+/// Reverse mode hoists every adjoint and every stored value to the function
+/// scope (see `ReverseModeVisitor::m_Globals`) so that they are visible from
+/// both the forward and the reverse sweep. Many of these declarations are,
+/// however, referenced from a single top-level statement of the generated
+/// body. For example, the adjoint of a variable local to a loop body is only
+/// used inside the reverse loop.
+///
+/// This class computes the live range of each hoisted declaration in terms of
+/// the top-level statements of the derivative body. Declarations used by a
+/// single statement can be moved into it and declarations which are never
+/// used can be dropped. Declarations whose initializers may have side effects,
+/// such as `clad::array` and `clad::tape` objects, are kept in place.
+///
+/// Narrower scopes allow the backend to reuse the stack slots of temporaries
+/// whose lifetimes do not overlap. The analysis itself does not merge the
+/// storage of such temporaries.
+class LifetimeAnalyzer : public clang::RecursiveASTVisitor<LifetimeAnalyzer> {
+public:
+  struct Result {
+    /// Hoisted declarations which are never referenced.
+    llvm::SmallVector<clang::DeclStmt*, 16> Dead;
+    /// For each top-level statement, the hoisted declarations which are
+    /// referenced only from within that statement.
+    std::vector<llvm::SmallVector<clang::DeclStmt*, 4>> Sinkable;
+  };
+
+private:
+  clang::ASTContext& m_Context;
+  /// The hoisted variables which are candidates for scope narrowing, in the
+  /// order of their declarations.
+  llvm::SmallVector<std::pair<const clang::VarDecl*, clang::DeclStmt*>, 16>
+      m_Candidates;
+  /// Index of the top-level statement referencing a candidate. `kManyUses`
+  /// marks variables referenced from more than one top-level statement.
+  llvm::DenseMap<const clang::VarDecl*, unsigned> m_UseIdx;
+  /// Candidates referenced by the initializer of another hoisted declaration.
+  /// These have to stay in the function scope.
+  llvm::SmallPtrSet<const clang::VarDecl*, 8> m_Pinned;
+  /// Index of the top-level statement being visited.
+  unsigned m_CurIdx = 0;
+  /// The variables read by the initializer of each candidate. Once moved, the
+  /// initializer is evaluated later, so these must not be modified before the
+  /// statement using the candidate.
+  llvm::DenseMap<const clang::VarDecl*,
+                 llvm::SmallVector<const clang::VarDecl*, 2>>
+      m_InitReads;
+  /// Index of the first top-level statement referencing a variable other than
+  /// by loading its value, i.e. which may modify it or take its address.
+  llvm::DenseMap<const clang::VarDecl*, unsigned> m_FirstNonLoad;
+  /// References whose values are loaded, found while visiting the enclosing
+  /// lvalue-to-rvalue casts.
+  llvm::SmallPtrSet<const clang::DeclRefExpr*, 16> m_LoadedRefs;
+  /// The hoisted variable being visited, if any.
+  const clang::VarDecl* m_CurHoisted = nullptr;
+  /// True while visiting a hoisted declaration.
+  bool m_InHoisted = false;
+  /// True if a label was found in the current top-level statement. Moving a
+  /// declaration into such a statement would allow a `goto` to bypass its
+  /// initialization.
+  bool m_HasLabel = false;
+
+  static constexpr unsigned kManyUses = ~0U;
+
+public:
+  LifetimeAnalyzer(clang::ASTContext& C) : m_Context(C) {}
+
+  LifetimeAnalyzer(const LifetimeAnalyzer&) = delete;
+  LifetimeAnalyzer& operator=(const LifetimeAnalyzer&) = delete;
+
+  /// Analyzes the top-level statements `body` of a derivative.
+  ///
+  /// \param[in] body The top-level statements of the derivative body.
+  /// \param[in] hoisted The statements of `body` which were hoisted to the
+  /// function scope.
+  Result Analyze(llvm::ArrayRef<clang::Stmt*> body,
+                 const llvm::SmallPtrSetImpl<clang::Stmt*>& hoisted);
+
+  bool VisitDeclRefExpr(clang::DeclRefExpr* DRE);
+  bool VisitImplicitCastExpr(clang::ImplicitCastExpr* ICE);
+  bool VisitLabelStmt(clang::LabelStmt* LS);
+};
+
+} // end namespace clad
+#endif // CLAD_DIFFERENTIATOR_LIFETIMEANALYZER_H
@@ -8,7 +8,7 @@
 
 #include "ConstantFolder.h"
 
-#include "TBRAnalyzer.h"
+#include "LifetimeAnalyzer.h"
 #include "clad/Differentiator/DerivativeBuilder.h"
 #include "clad/Differentiator/DiffPlanner.h"
 #include "clad/Differentiator/ErrorEstimator.h"
@@ -17,6 +17,7 @@
 #include "clad/Differentiator/StmtClone.h"
 
 #include "clang/AST/ASTContext.h"
+#include "clang/AST/Attr.h"
 #include "clang/AST/Expr.h"
 #include "clang/AST/Stmt.h"
 #include "clang/AST/TemplateBase.h"
@@ -31,6 +32,8 @@
 #include "llvm/Support/SaveAndRestore.h"
 
 #include <algorithm>
+#include <cstdlib>
+#include <limits>
 #include <numeric>
 
 #include "clad/Differentiator/CladUtils.h"
@@ -51,6 +54,670 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
   return nullptr;
 }
 
+namespace {
+/// A term of an affine stencil, i.e. the contribution of `in[i + Offset]` to
+/// the assigned value, scaled by the literal factors in `Coefs`.
+struct StencilTerm {
+  const VarDecl* In = nullptr;
+  const DeclRefExpr* InRef = nullptr;
+  int64_t Offset = 0;
+  bool Negate = false;
+  /// The literal factors, each tagged with true if it is a divisor.
+  llvm::SmallVector<std::pair<const Expr*, bool>, 2> Coefs;
+};
+
+bool isStencilCoef(const Expr* E) {
+  E = E->IgnoreParenImpCasts();
+  if (const auto* UO = dyn_cast<UnaryOperator>(E))
+    if (UO->getOpcode() == UO_Minus || UO->getOpcode() == UO_Plus)
+      E = UO->getSubExpr()->IgnoreParenImpCasts();
+  return isa<FloatingLiteral>(E) || isa<IntegerLiteral>(E);
+}
+
+/// Matches `i`, `i + k` and `i - k`, where `k` is an integer literal.
+bool matchStencilIndex(const Expr* E, const VarDecl* counter, int64_t& offset) {
+  E = E->IgnoreParenImpCasts();
+  if (const auto* DRE = dyn_cast<DeclRefExpr>(E)) {
+    offset = 0;
+    return DRE->getDecl() == counter;
+  }
+  const auto* BO = dyn_cast<BinaryOperator>(E);
+  if (!BO || (BO->getOpcode() != BO_Add && BO->getOpcode() != BO_Sub))
+    return false;
+  const auto* DRE = dyn_cast<DeclRefExpr>(BO->getLHS()->IgnoreParenImpCasts());
+  const auto* IL = dyn_cast<IntegerLiteral>(BO->getRHS()->IgnoreParenImpCasts());
+  if (!DRE || DRE->getDecl() != counter || !IL)
+    return false;
+  offset = IL->getValue().getSExtValue();
+  if (BO->getOpcode() == BO_Sub)
+    offset = -offset;
+  return true;
+}
+
+/// Returns true if E is an arithmetic expression of scalar variables and
+/// constants not involving the loop counter.
+bool isStencilBound(const Expr* E, const VarDecl* counter, ASTContext& C) {
+  E = E->IgnoreParenImpCasts();
+  if (E->isEvaluatable(C))
+    return true;
+  if (const auto* DRE = dyn_cast<DeclRefExpr>(E))
+    return DRE->getDecl() != counter &&
+           !utils::isArrayOrPointerType(DRE->getType());
+  if (const auto* BO = dyn_cast<BinaryOperator>(E))
+    return (BO->isAdditiveOp() || BO->isMultiplicativeOp()) &&
+           isStencilBound(BO->getLHS(), counter, C) &&
+           isStencilBound(BO->getRHS(), counter, C);
+  return false;
+}
+
+/// Decomposes E into a linear combination of the elements of arrays indexed
+/// by `counter` with constant offsets. Returns false if E is not of this form.
+bool collectStencilTerms(const Expr* E, const VarDecl* counter,
+                         StencilTerm term,
+                         llvm::SmallVectorImpl<StencilTerm>& terms) {
+  E = E->IgnoreParenImpCasts();
+  if (const auto* UO = dyn_cast<UnaryOperator>(E)) {
+    if (UO->getOpcode() == UO_Minus)
+      term.Negate = !term.Negate;
+    else if (UO->getOpcode() != UO_Plus)
+      return false;
+    return collectStencilTerms(UO->getSubExpr(), counter, term, terms);
+  }
+  if (const auto* BO = dyn_cast<BinaryOperator>(E)) {
+    const Expr* L = BO->getLHS();
+    const Expr* R = BO->getRHS();
+    switch (BO->getOpcode()) {
+    case BO_Add:
+      return collectStencilTerms(L, counter, term, terms) &&
+             collectStencilTerms(R, counter, term, terms);
+    case BO_Sub: {
+      if (!collectStencilTerms(L, counter, term, terms))
+        return false;
+      term.Negate = !term.Negate;
+      return collectStencilTerms(R, counter, term, terms);
+    }
+    case BO_Mul:
+      if (isStencilCoef(L)) {
+        term.Coefs.push_back({L, false});
+        return collectStencilTerms(R, counter, term, terms);
+      }
+      if (isStencilCoef(R)) {
+        term.Coefs.push_back({R, false});
+        return collectStencilTerms(L, counter, term, terms);
+      }
+      return false;
+    case BO_Div:
+      if (!isStencilCoef(R))
+        return false;
+      term.Coefs.push_back({R, true});
+      return collectStencilTerms(L, counter, term, terms);
+    default:
+      return false;
+    }
+  }
+  if (const auto* ASE = dyn_cast<ArraySubscriptExpr>(E)) {
+    const auto* DRE =
+        dyn_cast<DeclRefExpr>(ASE->getBase()->IgnoreParenImpCasts());
+    if (!DRE || !matchStencilIndex(ASE->getIdx(), counter, term.Offset))
+      return false;
+    term.In = dyn_cast<VarDecl>(DRE->getDecl());
+    term.InRef = DRE;
+    if (!term.In || !utils::isArrayOrPointerType(term.In->getType()))
+      return false;
+    terms.push_back(term);
+    return true;
+  }
+  return false;
+}
+
+/// Collects the return statements of S, excluding those of lambdas.
+void collectReturnStmts(const Stmt* S,
+                        llvm::SmallVectorImpl<const ReturnStmt*>& returns) {
+  if (!S || isa<LambdaExpr>(S))
+    return;
+  if (const auto* RS = dyn_cast<ReturnStmt>(S))
+    returns.push_back(RS);
+  for (const Stmt* child : S->children())
+    collectReturnStmts(child, returns);
+}
+
+/// Returns true if values of type T can be written by `clad::sync_tape_state`,
+/// i.e. T is a scalar, an array of scalars or a `clad::tape` of scalars.
+bool isTapeStateSerializable(QualType T) {
+  T = T.getCanonicalType();
+  if (const auto* AT = dyn_cast<ConstantArrayType>(T))
+    return isTapeStateSerializable(AT->getElementType());
+  if (T->isArithmeticType() || T->isEnumeralType())
+    return true;
+  const auto* TD = dyn_cast_or_null<ClassTemplateSpecializationDecl>(
+      T->getAsCXXRecordDecl());
+  if (!TD || TD->getName() != "tape_impl")
+    return false;
+  const auto* NS = dyn_cast<NamespaceDecl>(TD->getDeclContext());
+  if (!NS || NS->getName() != "clad")
+    return false;
+  QualType elemTy = TD->getTemplateArgs()[0].getAsType();
+  return elemTy->isArithmeticType() || elemTy->isEnumeralType();
+}
+
+/// Returns true if S assigns to, increments, decrements or takes the address
+/// of VD, passes it to a function by non-const reference or binds a non-const
+/// reference to it.
+bool isModified(const Stmt* S, const ValueDecl* VD) {
+  if (!S)
+    return false;
+  auto refersToVD = [VD](const Expr* E) {
+    const auto* DRE = dyn_cast<DeclRefExpr>(E->IgnoreParenImpCasts());
+    return DRE && DRE->getDecl() == VD;
+  };
+  auto isMutableRef = [](QualType T) {
+    return T->isReferenceType() && !T.getNonReferenceType().isConstQualified();
+  };
+  if (const auto* CE = dyn_cast<CallExpr>(S))
+    if (const FunctionDecl* FD = CE->getDirectCallee()) {
+      // The first argument of an operator method is the object.
+      unsigned skip = isa<CXXOperatorCallExpr>(CE) && isa<CXXMethodDecl>(FD);
+      for (unsigned i = skip, e = CE->getNumArgs(); i < e; ++i)
+        if (i - skip < FD->getNumParams() &&
+            isMutableRef(FD->getParamDecl(i - skip)->getType()) &&
+            refersToVD(CE->getArg(i)))
+          return true;
+    }
+  if (const auto* DS = dyn_cast<DeclStmt>(S))
+    for (const Decl* D : DS->decls())
+      if (const auto* Var = dyn_cast<VarDecl>(D))
+        if (Var->getInit() && isMutableRef(Var->getType()) &&
+            refersToVD(Var->getInit()))
+          return true;
+  if (const auto* BO = dyn_cast<BinaryOperator>(S))
+    if (BO->isAssignmentOp() && refersToVD(BO->getLHS()))
+      return true;
+  if (const auto* UO = dyn_cast<UnaryOperator>(S))
+    if ((UO->isIncrementDecrementOp() || UO->getOpcode() == UO_AddrOf) &&
+        refersToVD(UO->getSubExpr()))
+      return true;
+  for (const Stmt* child : S->children())
+    if (isModified(child, VD))
+      return true;
+  return false;
+}
+
+/// Returns true if E is VD, possibly offset, e.g. `p + 1`.
+bool isVarOrOffset(const Expr* E, const ValueDecl* VD) {
+  E = E->IgnoreParenImpCasts();
+  if (const auto* BO = dyn_cast<BinaryOperator>(E))
+    if (BO->isAdditiveOp())
+      return isVarOrOffset(BO->getLHS(), VD) ||
+             isVarOrOffset(BO->getRHS(), VD);
+  const auto* DRE = dyn_cast<DeclRefExpr>(E);
+  return DRE && DRE->getDecl() == VD;
+}
+
+/// Returns true if E designates memory reached through the pointer or array
+/// VD, e.g. `p[i]`, `*p` or `p->x`.
+bool isPointeeOf(const Expr* E, const ValueDecl* VD) {
+  E = E->IgnoreParenImpCasts();
+  const Expr* base = nullptr;
+  if (const auto* ASE = dyn_cast<ArraySubscriptExpr>(E))
+    base = ASE->getBase();
+  else if (const auto* UO = dyn_cast<UnaryOperator>(E)) {
+    if (UO->getOpcode() == UO_Deref)
+      base = UO->getSubExpr();
+  } else if (const auto* ME = dyn_cast<MemberExpr>(E)) {
+    if (!ME->isArrow())
+      return isPointeeOf(ME->getBase(), VD);
+    base = ME->getBase();
+  }
+  return base && (isVarOrOffset(base, VD) || isPointeeOf(base, VD));
+}
+
+/// Returns true if S may write to the memory which the pointer or array VD
+/// points to, e.g. `p[i] = 0`, `*p += 1`, `p->x++`, by passing `p` to a
+/// function taking a non-const pointer or reference or by copying `p` into
+/// another non-const pointer.
+bool mayWritePointee(const Stmt* S, const ValueDecl* VD) {
+  if (!S)
+    return false;
+  auto refersToVD = [VD](const Expr* E) {
+    return isVarOrOffset(E, VD) || isPointeeOf(E, VD);
+  };
+  auto isMutableIndirection = [](QualType T) {
+    if (T->isReferenceType())
+      return !T.getNonReferenceType().isConstQualified();
+    return T->isPointerType() && !T->getPointeeType().isConstQualified();
+  };
+  if (const auto* BO = dyn_cast<BinaryOperator>(S))
+    if (BO->isAssignmentOp() && isPointeeOf(BO->getLHS(), VD))
+      return true;
+  if (const auto* UO = dyn_cast<UnaryOperator>(S))
+    if (UO->isIncrementDecrementOp() && isPointeeOf(UO->getSubExpr(), VD))
+      return true;
+  if (const auto* CE = dyn_cast<CallExpr>(S)) {
+    const FunctionDecl* FD = CE->getDirectCallee();
+    unsigned skip =
+        FD && isa<CXXOperatorCallExpr>(CE) && isa<CXXMethodDecl>(FD);
+    for (unsigned i = skip, e = CE->getNumArgs(); i < e; ++i) {
+      const Expr* arg = CE->getArg(i);
+      if (!refersToVD(arg))
+        continue;
+      // Without a prototype, assume that the argument is written.
+      if (!FD || i - skip >= FD->getNumParams() ||
+          isMutableIndirection(FD->getParamDecl(i - skip)->getType()))
+        return true;
+    }
+  }
+  if (const auto* DS = dyn_cast<DeclStmt>(S))
+    for (const Decl* D : DS->decls())
+      if (const auto* Var = dyn_cast<VarDecl>(D))
+        if (Var->getInit() && isMutableIndirection(Var->getType()) &&
+            refersToVD(Var->getInit()))
+          return true;
+  for (const Stmt* child : S->children())
+    if (mayWritePointee(child, VD))
+      return true;
+  return false;
+}
+
+/// The variables which the body of a loop declares and those declared before
+/// it which it assigns, see collectLoopState.
+struct LoopState {
+  llvm::SmallPtrSet<const VarDecl*, 8> Locals;
+  /// A reference to each assigned variable declared before the body.
+  llvm::SmallVector<const DeclRefExpr*, 4> Assigned;
+};
+
+/// Returns the variable which E is or is an element or a field of, e.g. `a`
+/// for `a[i].x`, or null if E may designate memory outside of a variable,
+/// e.g. through a pointer or a reference.
+const DeclRefExpr* getDesignatedVar(const Expr* E) {
+  E = E->IgnoreParenImpCasts();
+  if (const auto* ASE = dyn_cast<ArraySubscriptExpr>(E)) {
+    if (!ASE->getBase()->IgnoreParenImpCasts()->getType()->isArrayType())
+      return nullptr;
+    return getDesignatedVar(ASE->getBase());
+  }
+  if (const auto* ME = dyn_cast<MemberExpr>(E))
+    return ME->isArrow() ? nullptr : getDesignatedVar(ME->getBase());
+  const auto* DRE = dyn_cast<DeclRefExpr>(E);
+  const auto* VD = DRE ? dyn_cast<VarDecl>(DRE->getDecl()) : nullptr;
+  if (!VD || VD->getType()->isReferenceType())
+    return nullptr;
+  return DRE;
+}
+
+/// Records in `state` the variable assigned by the assignment or the
+/// increment of E. \returns the reason why its value cannot be snapshotted,
+/// or an empty string.
+std::string collectAssignedVar(const Expr* E, LoopState& state) {
+  const DeclRefExpr* DRE = getDesignatedVar(E);
+  if (!DRE)
+    return "it assigns memory outside of its variables";
+  const auto* VD = cast<VarDecl>(DRE->getDecl());
+  if (state.Locals.count(VD))
+    return "";
+  if (E->IgnoreParenImpCasts() != DRE)
+    return ("it assigns a part of '" + VD->getName() + "'").str();
+  for (const DeclRefExpr* assigned : state.Assigned)
+    if (assigned->getDecl() == VD)
+      return "";
+  state.Assigned.push_back(DRE);
+  return "";
+}
+
+bool mayWriteGlobals(const FunctionDecl* FD,
+                     llvm::SmallPtrSetImpl<const FunctionDecl*>& visited);
+
+/// Returns true if S may write to memory other than the local variables of the
+/// function it belongs to, e.g. to a global or through a pointer.
+bool mayWriteGlobals(const Stmt* S,
+                     llvm::SmallPtrSetImpl<const FunctionDecl*>& visited) {
+  if (!S)
+    return false;
+  auto isLocal = [](const Expr* E) {
+    const DeclRefExpr* DRE = getDesignatedVar(E);
+    return DRE && cast<VarDecl>(DRE->getDecl())->hasLocalStorage();
+  };
+  if (const auto* BO = dyn_cast<BinaryOperator>(S))
+    if (BO->isAssignmentOp() && !isLocal(BO->getLHS()))
+      return true;
+  if (const auto* UO = dyn_cast<UnaryOperator>(S))
+    if (UO->isIncrementDecrementOp() && !isLocal(UO->getSubExpr()))
+      return true;
+  if (const auto* DS = dyn_cast<DeclStmt>(S))
+    for (const Decl* D : DS->decls())
+      if (const auto* VD = dyn_cast<VarDecl>(D))
+        if (!VD->hasLocalStorage())
+          return true;
+  if (const auto* CE = dyn_cast<CallExpr>(S)) {
+    const FunctionDecl* FD = CE->getDirectCallee();
+    if (!FD || mayWriteGlobals(FD, visited))
+      return true;
+  }
+  if (const auto* CE = dyn_cast<CXXConstructExpr>(S))
+    if (mayWriteGlobals(CE->getConstructor(), visited))
+      return true;
+  if (isa<CXXNewExpr>(S) || isa<CXXDeleteExpr>(S))
+    return true;
+  for (const Stmt* child : S->children())
+    if (mayWriteGlobals(child, visited))
+      return true;
+  return false;
+}
+
+/// Returns true if a call to FD may write to memory other than its local
+/// variables. The functions declared const or pure and the builtins, such as
+/// the math functions, do not. The others are analyzed if they are defined.
+bool mayWriteGlobals(const FunctionDecl* FD,
+                     llvm::SmallPtrSetImpl<const FunctionDecl*>& visited) {
+  if (FD->hasAttr<ConstAttr>() || FD->hasAttr<PureAttr>() ||
+      FD->getBuiltinID())
+    return false;
+  const FunctionDecl* def = nullptr;
+  if (!FD->hasBody(def))
+    return !(isa<CXXConstructorDecl>(FD) && FD->isTrivial());
+  // Recursive calls are analyzed once.
+  if (!visited.insert(def).second)
+    return false;
+  return mayWriteGlobals(def->getBody(), visited);
+}
+
+/// Collects in `state` the variables which the loop body S declares or
+/// assigns. `nestedLoop` and `nestedSwitch` tell whether S is nested in a
+/// loop or a switch of the body, which break and continue statements leave.
+/// \returns the reason why the iterations of the loop cannot be recomputed
+/// from snapshots of the assigned variables, or an empty string.
+std::string collectLoopState(const Stmt* S, LoopState& state,
+                             bool nestedLoop = false,
+                             bool nestedSwitch = false) {
+  if (!S)
+    return "";
+  if (isa<LambdaExpr>(S))
+    return "it contains a lambda";
+  if (isa<ReturnStmt>(S))
+    return "it returns from the function";
+  if (isa<GotoStmt>(S) || isa<IndirectGotoStmt>(S) || isa<LabelStmt>(S))
+    return "it contains a goto or a label";
+  if ((isa<BreakStmt>(S) && !nestedLoop && !nestedSwitch) ||
+      (isa<ContinueStmt>(S) && !nestedLoop))
+    return "it contains a break or a continue statement";
+  if (isa<CXXNewExpr>(S) || isa<CXXDeleteExpr>(S))
+    return "it allocates or frees memory";
+  const VarDecl* condVar = nullptr;
+  if (const auto* If = dyn_cast<IfStmt>(S))
+    condVar = If->getConditionVariable();
+  else if (const auto* WS = dyn_cast<WhileStmt>(S))
+    condVar = WS->getConditionVariable();
+  else if (const auto* FS = dyn_cast<ForStmt>(S))
+    condVar = FS->getConditionVariable();
+  else if (const auto* SS = dyn_cast<SwitchStmt>(S))
+    condVar = SS->getConditionVariable();
+  if (condVar)
+    return "it declares a condition variable";
+  if (const auto* DS = dyn_cast<DeclStmt>(S)) {
+    for (const Decl* D : DS->decls()) {
+      const auto* VD = dyn_cast<VarDecl>(D);
+      if (!VD)
+        continue;
+      if (!VD->hasLocalStorage())
+        return ("it declares the static variable '" + VD->getName() + "'")
+            .str();
+      if (isa<VariableArrayType>(VD->getType()))
+        return "it declares a variable length array";
+      state.Locals.insert(VD);
+    }
+  }
+  std::string reason;
+  if (const auto* BO = dyn_cast<BinaryOperator>(S)) {
+    if (BO->isAssignmentOp())
+      reason = collectAssignedVar(BO->getLHS(), state);
+  } else if (const auto* UO = dyn_cast<UnaryOperator>(S)) {
+    if (UO->isIncrementDecrementOp())
+      reason = collectAssignedVar(UO->getSubExpr(), state);
+    const DeclRefExpr* DRE = getDesignatedVar(UO->getSubExpr());
+    if (UO->getOpcode() == UO_AddrOf &&
+        (!DRE || !state.Locals.count(cast<VarDecl>(DRE->getDecl()))))
+      reason = "it takes the address of a variable declared before it";
+  } else if (const auto* CE = dyn_cast<CallExpr>(S)) {
+    const FunctionDecl* FD = CE->getDirectCallee();
+    if (!FD)
+      return "it calls a function indirectly";
+    const auto* MD = dyn_cast<CXXMethodDecl>(FD);
+    if (MD && MD->isInstance() && !MD->isConst())
+      return ("it calls the non-const method '" + FD->getName() + "'").str();
+    for (const ParmVarDecl* PVD : FD->parameters()) {
+      QualType T = PVD->getType();
+      if ((T->isReferenceType() || T->isPointerType()) &&
+          !T->getPointeeType().isConstQualified())
+        return ("it passes arguments to '" + FD->getName() +
+                "' by non-const reference or pointer")
+            .str();
+    }
+    // The writes of the callee are not snapshotted.
+    llvm::SmallPtrSet<const FunctionDecl*, 8> visited;
+    if (mayWriteGlobals(FD, visited))
+      return ("it calls '" + FD->getName() +
+              "', which may write to memory outside of its variables")
+          .str();
+  }
+  if (!reason.empty())
+    return reason;
+  nestedLoop |= isa<ForStmt>(S) || isa<WhileStmt>(S) || isa<DoStmt>(S);
+  nestedSwitch |= isa<SwitchStmt>(S);
+  for (const Stmt* child : S->children()) {
+    reason = collectLoopState(child, state, nestedLoop, nestedSwitch);
+    if (!reason.empty())
+      return reason;
+  }
+  return "";
+}
+
+/// Computes in `size` the number of elements of the array `VD` used in S,
+/// i.e. the largest constant index `k` of `VD[k]` plus one.
+/// \returns false if VD is used otherwise in S, e.g. with a variable index.
+bool countConstantIndices(const Stmt* S, const ValueDecl* VD,
+                          const ASTContext& C, unsigned& size) {
+  if (!S)
+    return true;
+  if (const auto* ASE = dyn_cast<ArraySubscriptExpr>(S)) {
+    const auto* DRE =
+        dyn_cast<DeclRefExpr>(ASE->getBase()->IgnoreParenImpCasts());
+    if (DRE && DRE->getDecl() == VD) {
+      Expr::EvalResult res;
+      if (!ASE->getIdx()->EvaluateAsInt(res, C))
+        return false;
+      size = std::max<unsigned>(size, res.Val.getInt().getZExtValue() + 1);
+      return true;
+    }
+  }
+  if (const auto* DRE = dyn_cast<DeclRefExpr>(S))
+    return DRE->getDecl() != VD;
+  for (const Stmt* child : S->children())
+    if (!countConstantIndices(child, VD, C, size))
+      return false;
+  return true;
+}
+
+/// Returns true if VD is only used in S as the base of member accesses to
+/// arithmetic fields of its elements, e.g. `p[i].x`. The accessed fields are
+/// added to `fields`.
+bool isOnlyAccessedByField(const Stmt* S, const ValueDecl* VD,
+                           llvm::SmallPtrSetImpl<const FieldDecl*>& fields) {
+  if (!S)
+    return true;
+  if (const auto* ME = dyn_cast<MemberExpr>(S)) {
+    const auto* ASE =
+        dyn_cast<ArraySubscriptExpr>(ME->getBase()->IgnoreParens());
+    const auto* FD = dyn_cast<FieldDecl>(ME->getMemberDecl());
+    if (ASE && FD && FD->getType()->isArithmeticType()) {
+      const auto* DRE =
+          dyn_cast<DeclRefExpr>(ASE->getBase()->IgnoreParenImpCasts());
+      if (DRE && DRE->getDecl() == VD) {
+        fields.insert(FD);
+        return isOnlyAccessedByField(ASE->getIdx(), VD, fields);
+      }
+    }
+  }
+  if (const auto* DRE = dyn_cast<DeclRefExpr>(S))
+    return DRE->getDecl() != VD;
+  for (const Stmt* child : S->children())
+    if (!isOnlyAccessedByField(child, VD, fields))
+      return false;
+  return true;
+}
+
+/// \returns \p value as an integer of the width and signedness of \p T.
+llvm::APSInt MakeIntOfType(std::int64_t value, QualType T, ASTContext& C) {
+  bool isUnsigned = T->isUnsignedIntegerOrEnumerationType();
+  return llvm::APSInt(
+      llvm::APInt(C.getIntWidth(T), static_cast<std::uint64_t>(value),
+                  /*isSigned=*/!isUnsigned),
+      isUnsigned);
+}
+
+/// Evaluates the integral expression E, in which the parameters bound to
+/// constants are replaced by their values. The operations are carried out
+/// in the width and signedness of the types of the subexpressions, so that
+/// unsigned arithmetic wraps around and conversions truncate as in C++.
+/// \returns false if E depends on other values or if a signed operation
+/// overflows.
+bool EvaluateWithConstantArgs(
+    const Expr* E,
+    const llvm::DenseMap<const ValueDecl*, std::int64_t>& constants,
+    ASTContext& C, llvm::APSInt& value) {
+  E = E->IgnoreParens();
+  QualType T = E->getType();
+  if (!T->isIntegralOrEnumerationType())
+    return false;
+  if (const auto* DRE = dyn_cast<DeclRefExpr>(E)) {
+    auto it = constants.find(DRE->getDecl());
+    if (it != constants.end()) {
+      value = MakeIntOfType(it->second, T, C);
+      return true;
+    }
+  }
+  if (const auto* CE = dyn_cast<CastExpr>(E)) {
+    switch (CE->getCastKind()) {
+    case CK_LValueToRValue:
+    case CK_NoOp:
+      return EvaluateWithConstantArgs(CE->getSubExpr(), constants, C, value);
+    case CK_IntegralCast:
+    case CK_IntegralToBoolean: {
+      llvm::APSInt sub;
+      if (!EvaluateWithConstantArgs(CE->getSubExpr(), constants, C, sub))
+        return false;
+      if (CE->getCastKind() == CK_IntegralToBoolean || T->isBooleanType()) {
+        value = MakeIntOfType(sub.getBoolValue(), T, C);
+        return true;
+      }
+      value = sub.extOrTrunc(C.getIntWidth(T));
+      value.setIsUnsigned(T->isUnsignedIntegerOrEnumerationType());
+      return true;
+    }
+    default:
+      break;
+    }
+  }
+  if (const auto* UO = dyn_cast<UnaryOperator>(E)) {
+    llvm::APSInt sub;
+    if (!EvaluateWithConstantArgs(UO->getSubExpr(), constants, C, sub))
+      return false;
+    switch (UO->getOpcode()) {
+    case UO_LNot:
+      value = MakeIntOfType(!sub.getBoolValue(), T, C);
+      return true;
+    case UO_Minus:
+      if (sub.isSigned() && sub.isMinSignedValue())
+        return false;
+      value = -sub;
+      return true;
+    case UO_Plus:
+      value = sub;
+      return true;
+    default:
+      return false;
+    }
+  }
+  if (const auto* BO = dyn_cast<BinaryOperator>(E)) {
+    llvm::APSInt L;
+    llvm::APSInt R;
+    if (!EvaluateWithConstantArgs(BO->getLHS(), constants, C, L) ||
+        !EvaluateWithConstantArgs(BO->getRHS(), constants, C, R))
+      return false;
+    BinaryOperatorKind op = BO->getOpcode();
+    if (op == BO_LAnd || op == BO_LOr) {
+      bool result = op == BO_LAnd ? L.getBoolValue() && R.getBoolValue()
+                                  : L.getBoolValue() || R.getBoolValue();
+      value = MakeIntOfType(result, T, C);
+      return true;
+    }
+    // The usual arithmetic conversions give both operands the same type.
+    if (L.getBitWidth() != R.getBitWidth() || L.isSigned() != R.isSigned())
+      return false;
+    bool overflow = false;
+    switch (op) {
+    case BO_Add:
+      value = llvm::APSInt(L.isSigned() ? L.sadd_ov(R, overflow) : L + R,
+                           L.isUnsigned());
+      return !overflow;
+    case BO_Sub:
+      value = llvm::APSInt(L.isSigned() ? L.ssub_ov(R, overflow) : L - R,
+                           L.isUnsigned());
+      return !overflow;
+    case BO_Mul:
+      value = llvm::APSInt(L.isSigned() ? L.smul_ov(R, overflow) : L * R,
+                           L.isUnsigned());
+      return !overflow;
+    case BO_Div:
+    case BO_Rem:
+      if (!R.getBoolValue())
+        return false;
+      // The quotient of the smallest value and -1 overflows.
+      if (L.isSigned())
+        (void)L.sdiv_ov(R, overflow);
+      if (overflow)
+        return false;
+      value = op == BO_Div ? L / R : L % R;
+      return true;
+    case BO_LT:
+      value = MakeIntOfType(L < R, T, C);
+      return true;
+    case BO_GT:
+      value = MakeIntOfType(L > R, T, C);
+      return true;
+    case BO_LE:
+      value = MakeIntOfType(L <= R, T, C);
+      return true;
+    case BO_GE:
+      value = MakeIntOfType(L >= R, T, C);
+      return true;
+    case BO_EQ:
+      value = MakeIntOfType(L == R, T, C);
+      return true;
+    case BO_NE:
+      value = MakeIntOfType(L != R, T, C);
+      return true;
+    case BO_And:
+      value = L & R;
+      return true;
+    case BO_Or:
+      value = L | R;
+      return true;
+    case BO_Xor:
+      value = L ^ R;
+      return true;
+    default:
+      return false;
+    }
+  }
+  Expr::EvalResult res;
+  if (E->EvaluateAsInt(res, C)) {
+    value = res.Val.getInt();
+    return true;
+  }
+  return false;
+}
+} // namespace
+
   Expr* ReverseModeVisitor::CladTapeResult::Last() {
     LookupResult& Back = V.GetCladTapeBack();
     CXXScopeSpec CSS;
@@ -69,8 +736,12 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
   ReverseModeVisitor::MakeCladTapeFor(Expr* E, llvm::StringRef prefix) {
     assert(E && "must be provided");
     E = E->IgnoreImplicit();
-    QualType TapeType =
-        GetCladTapeOfType(getNonConstType(E->getType(), m_Context, m_Sema));
+    QualType elemTy = getNonConstType(E->getType(), m_Context, m_Sema);
+    // The tapes of constexpr derivatives do not allocate, so that the
+    // derivatives can be evaluated in constant expressions.
+    QualType TapeType = m_Derivative && m_Derivative->isConstexpr()
+                            ? GetCladStaticTapeOfType(elemTy)
+                            : GetCladTapeOfType(elemTy);
     LookupResult& Push = GetCladTapePush();
     LookupResult& Pop = GetCladTapePop();
     Expr* TapeRef =
@@ -78,6 +749,8 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
     auto* VD = cast<VarDecl>(cast<DeclRefExpr>(TapeRef)->getDecl());
     // Add fake location, since Clang AST does assert(Loc.isValid()) somewhere.
     VD->setLocation(m_Function->getLocation());
+    if (m_LoopTapes)
+      m_LoopTapes->push_back(VD);
     CXXScopeSpec CSS;
     CSS.Extend(m_Context, GetCladNamespace(), noLoc, noLoc);
     auto* PopDRE = m_Sema
@@ -283,16 +956,46 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
       isVectorValued = true;
       unsigned lastArgN = m_Function->getNumParams() - 1;
       outputArrayStr = m_Function->getParamDecl(lastArgN)->getNameAsString();
+      columnMajorOutput = request.ColumnMajorOutput;
+      stridedOutput = request.StridedOutput;
+      if (!ComputeJacobianColumns(args, request))
+        return {};
     }
 
     // Check if DiffRequest asks for TBR analysis to be enabled
     if (request.EnableTBRAnalysis)
       enableTBR = true;
 
+    if (request.EnableLifetimeAnalysis)
+      enableLifetimeAnalysis = true;
+    if (request.EnableStencilGather)
+      enableStencilGather = true;
+    if (request.EnableTapeCheckpoint)
+      enableTapeCheckpoint = true;
+    if (request.EnableLoopCheckpointing)
+      enableLoopCheckpointing = true;
+    m_AdjointType = request.AdjointType;
+    for (const auto& CA : request.ConstantArgs) {
+      if (isModified(FD->getBody(), CA.first)) {
+        diag(DiagnosticsEngine::Error, request.Args->getEndLoc(),
+             "parameter '%0' cannot be bound to a constant because it is "
+             "modified in '%1'",
+             {CA.first->getName(), FD->getNameAsString()});
+        return {};
+      }
+      m_ConstantArgs[CA.first] = CA.second;
+    }
+
     // Check if DiffRequest asks for use of enzyme as backend
     if (request.use_enzyme)
       use_enzyme = true;
 
+    // The plugins and enzyme expect the adjoints in the layout of the
+    // parameters.
+    if (request.EnableSoAAdjoints && !isVectorValued && !use_enzyme &&
+        !m_ExternalSource)
+      FindSoAAdjointParams(args);
+
     auto derivativeBaseName = request.BaseFunctionName;
     std::string gradientName = derivativeBaseName + funcPostfix();
     // To be consistent with older tests, nothing is appended to 'f_grad' if
@@ -317,6 +1020,19 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
         }
       }
     }
+    // The Jacobians stored in other layouts are named after them, e.g.
+    // f_jac_colmajor_strided.
+    if (columnMajorOutput)
+      gradientName += "_colmajor";
+    if (stridedOutput)
+      gradientName += "_strided";
+    gradientName += AdjointTypeSuffix();
+    // Specialized derivatives are named after their bindings, e.g. f_grad_n3.
+    for (const auto& CA : request.ConstantArgs) {
+      gradientName += '_' + CA.first->getNameAsString();
+      gradientName += CA.second < 0 ? 'm' + std::to_string(-CA.second)
+                                    : std::to_string(CA.second);
+    }
 
     IdentifierInfo* II = &m_Context.Idents.get(gradientName);
     DeclarationNameInfo name(II, noLoc);
@@ -366,6 +1082,9 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
         m_Function, *this, DC, noLoc, name, gradientFunctionType);
     FunctionDecl* gradientFD = result.first;
     m_Derivative = gradientFD;
+    // The probes cannot be evaluated in constant expressions.
+    m_EnableProfiling =
+        request.EnableSweepProfiling && !m_Derivative->isConstexpr();
 
     if (m_ExternalSource)
       m_ExternalSource->ActBeforeCreatingDerivedFnScope();
@@ -392,32 +1111,16 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
     if (!request.DeclarationOnly) {
       if (isVectorValued) {
         // Reference to the output parameter.
-        m_Result = BuildDeclRef(params.back());
-        numParams = args.size();
+        m_Result = BuildDeclRef(params[params.size() - 1 - stridedOutput]);
 
         // Creates the ArraySubscriptExprs for the independent variables
-        size_t idx = 0;
-        for (const auto* arg : args) {
-          // FIXME: fix when adding array inputs, now we are just skipping all
-          // array/pointer inputs (not treating them as independent variables).
-          if (utils::isArrayOrPointerType(arg->getType())) {
-            if (arg->getName() == "p")
-              m_Variables[arg] = m_Result;
-            idx += 1;
-            continue;
-          }
-          auto size_type = m_Context.getSizeType();
-          unsigned size_type_bits = m_Context.getIntWidth(size_type);
-          // Create the idx literal.
-          auto* i = IntegerLiteral::Create(
-              m_Context, llvm::APInt(size_type_bits, idx), size_type, noLoc);
-          // Create the jacobianMatrix[idx] expression.
-          auto* result_at_i =
-              m_Sema.CreateBuiltinArraySubscriptExpr(m_Result, noLoc, i, noLoc)
-                  .get();
-          m_Variables[arg] = result_at_i;
-          idx += 1;
-          m_IndependentVars.push_back(arg);
+        for (unsigned i = 0, e = m_IndependentVars.size(); i < e; ++i) {
+          const ValueDecl* VD = m_IndependentVars[i];
+          unsigned col = m_IndependentVarColumns[i];
+          if (utils::isArrayOrPointerType(VD->getType()))
+            m_Variables[VD] = BuildJacobianRow(0, col);
+          else
+            m_Variables[VD] = BuildJacobianElement(0, col);
         }
       }
 
@@ -463,10 +1166,18 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
                                      const DiffRequest& request) {
     if (request.EnableTBRAnalysis)
       enableTBR = true;
-    TBRAnalyzer analyzer(m_Context);
-    if (enableTBR) {
-      analyzer.Analyze(FD);
-      m_ToBeRecorded = analyzer.getResult();
+    if (request.EnableLifetimeAnalysis)
+      enableLifetimeAnalysis = true;
+    if (request.EnableStencilGather)
+      enableStencilGather = true;
+    if (request.EnableLoopCheckpointing)
+      enableLoopCheckpointing = true;
+    m_AdjointType = request.AdjointType;
+    // The declarations of the pullbacks do not depend on the analysis.
+    if (enableTBR && !request.DeclarationOnly) {
+      const TBRAnalysisResult& TBR = m_Builder.getTBRAnalysisResult(FD);
+      m_ToBeRecorded = TBR.ToBeRecorded;
+      m_ToBeRecordedFields = TBR.ToBeRecordedFields;
     }
 
     // FIXME: Duplication of external source here is a workaround
@@ -494,8 +1205,8 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
     if (m_ExternalSource)
       m_ExternalSource->ActAfterParsingDiffArgs(request, args);
 
-    auto derivativeName =
-        utils::ComputeEffectiveFnName(m_Function) + "_pullback";
+    auto derivativeName = utils::ComputeEffectiveFnName(m_Function) +
+                          "_pullback" + AdjointTypeSuffix();
     auto DNI = utils::BuildDeclarationNameInfo(m_Sema, derivativeName);
 
     auto paramTypes = ComputeParamTypes(args);
@@ -517,6 +1228,8 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
     DeclWithContext fnBuildRes = m_Builder.cloneFunction(
         m_Function, *this, m_Sema.CurContext, validLoc, DNI, pullbackFnType);
     m_Derivative = fnBuildRes.first;
+    m_EnableProfiling =
+        request.EnableSweepProfiling && !m_Derivative->isConstexpr();
 
     if (m_ExternalSource)
       m_ExternalSource->ActBeforeCreatingDerivedFnScope();
@@ -550,8 +1263,14 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
       StmtDiff bodyDiff = Visit(m_Function->getBody());
       Stmt* forward = bodyDiff.getStmt();
       Stmt* reverse = bodyDiff.getStmt_dx();
+      if (m_EnableProfiling)
+        AddSweepProbes(forward, reverse);
 
       // Create the body of the function.
+      // The recursion frame lives as long as the function, it is not hoisted
+      // so that the lifetime analysis does not move it.
+      if (m_RecursionFrame)
+        addToCurrentBlock(BuildDeclStmt(m_RecursionFrame), direction::forward);
       // Firstly, all "global" Stmts are put into fn's body.
       for (Stmt* S : m_Globals)
         addToCurrentBlock(S, direction::forward);
@@ -568,6 +1287,9 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
       if (m_ExternalSource)
         m_ExternalSource->ActOnEndOfDerivedFnBody();
 
+      if (enableLifetimeAnalysis)
+        NarrowHoistedDeclScopes();
+
       Stmt* fnBody = endBlock();
       m_Derivative->setBody(fnBody);
       endScope(); // Function body scope
@@ -582,11 +1304,220 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
     return DerivativeAndOverload{fnBuildRes.first, nullptr};
   }
 
+  DerivativeAndOverload
+  ReverseModeVisitor::DeriveRecordingPass(const FunctionDecl* FD,
+                                          const DiffRequest& request) {
+    silenceDiags = !request.VerboseDiags;
+    m_Function = FD;
+    m_Mode = DiffMode::reverse_mode_recording_pass;
+    assert(m_Function && "Must not be null.");
+
+    auto fnName = utils::ComputeEffectiveFnName(m_Function) + "_record";
+    auto fnDNI = utils::BuildDeclarationNameInfo(m_Sema, fnName);
+
+    llvm::SaveAndRestore<DeclContext*> saveContext(m_Sema.CurContext);
+    llvm::SaveAndRestore<Scope*> saveScope(getCurrentScope(),
+                                           getEnclosingNamespaceOrTUScope());
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-const-cast)
+    m_Sema.CurContext = const_cast<DeclContext*>(m_Function->getDeclContext());
+
+    SourceLocation validLoc{m_Function->getLocation()};
+    DeclWithContext fnBuildRes =
+        m_Builder.cloneFunction(m_Function, *this, m_Sema.CurContext,
+                                validLoc, fnDNI, m_Function->getType());
+    m_Derivative = fnBuildRes.first;
+
+    beginScope(Scope::FunctionPrototypeScope | Scope::FunctionDeclarationScope |
+               Scope::DeclScope);
+    m_Sema.PushFunctionScope();
+    m_Sema.PushDeclContext(getCurrentScope(), m_Derivative);
+
+    llvm::SmallVector<ParmVarDecl*, 8> params;
+    for (ParmVarDecl* PVD : m_Function->parameters()) {
+      auto* newPVD = utils::BuildParmVarDecl(
+          m_Sema, m_Derivative, PVD->getIdentifier(), PVD->getType(),
+          PVD->getStorageClass(), /*DefArg=*/nullptr, PVD->getTypeSourceInfo());
+      params.push_back(newPVD);
+      if (newPVD->getIdentifier())
+        m_Sema.PushOnScopeChains(newPVD, getCurrentScope(),
+                                 /*AddToContext=*/false);
+    }
+    m_Derivative->setParams(params);
+    m_Derivative->setBody(nullptr);
+
+    if (!request.DeclarationOnly) {
+      beginScope(Scope::FnScope | Scope::DeclScope);
+      m_DerivativeFnScope = getCurrentScope();
+
+      beginBlock();
+      // The body is differentiated as in the pullback, so that the values are
+      // recorded in the order in which the pullback pops them. The adjoints
+      // are local variables which are not used.
+      for (ParmVarDecl* PVD : params) {
+        QualType dType = getNonConstType(PVD->getType(), m_Context, m_Sema);
+        VarDecl* dVD = BuildGlobalVarDecl(
+            dType, "_d_" + PVD->getNameAsString(), getZeroInit(dType));
+        AddToGlobalBlock(BuildDeclStmt(dVD));
+        m_Variables[PVD] = BuildDeclRef(dVD);
+      }
+      QualType returnType =
+          getNonConstType(m_Function->getReturnType(), m_Context, m_Sema);
+      VarDecl* pullbackVD =
+          BuildGlobalVarDecl(returnType, "_d_y", getZeroInit(returnType));
+      AddToGlobalBlock(BuildDeclStmt(pullbackVD));
+      m_Pullback = BuildDeclRef(pullbackVD);
+
+      StmtDiff bodyDiff = Visit(m_Function->getBody());
+      Stmt* forward = bodyDiff.getStmt();
+
+      if (m_RecursionFrame)
+        addToCurrentBlock(BuildDeclStmt(m_RecursionFrame));
+      for (Stmt* S : m_Globals)
+        addToCurrentBlock(S);
+      if (auto* CS = dyn_cast<CompoundStmt>(forward))
+        for (Stmt* S : CS->body())
+          addToCurrentBlock(S);
+
+      Stmt* fnBody = endBlock();
+      m_Derivative->setBody(fnBody);
+      endScope();
+
+      if (request.DerivedFDPrototype)
+        m_Derivative->setPreviousDeclaration(request.DerivedFDPrototype);
+    }
+    m_Sema.PopFunctionScopeInfo();
+    m_Sema.PopDeclContext();
+    endScope();
+    return DerivativeAndOverload{m_Derivative, nullptr};
+  }
+
+  bool ReverseModeVisitor::IsRecordableRecursiveFn(const FunctionDecl* FD) {
+    FD = FD->getCanonicalDecl();
+    auto found = m_RecordableRecursiveFns.find(FD);
+    if (found != m_RecordableRecursiveFns.end())
+      return found->second;
+    // The frames are thread-local, they are not available on the device.
+    bool recordable = !m_Sema.getLangOpts().CUDA && !isa<CXXMethodDecl>(FD) &&
+                      !FD->isVariadic() && !FD->isConstexpr() &&
+                      FD->getReturnType()->isRealFloatingType() &&
+                      FD->getNumParams() != 0;
+    for (const ParmVarDecl* PVD : FD->parameters())
+      recordable = recordable && (PVD->getType()->isArithmeticType() ||
+                                  PVD->getType()->isEnumeralType());
+    recordable = recordable && utils::IsRecursive(FD);
+    m_RecordableRecursiveFns[FD] = recordable;
+    return recordable;
+  }
+
+  bool ReverseModeVisitor::HasRecordingPass(const FunctionDecl* FD) {
+    const FunctionDecl* definition = nullptr;
+    if (!IsRecordableRecursiveFn(FD) || !FD->hasBody(definition))
+      return false;
+    // The value of a returned call is not used by the pullback.
+    llvm::SmallVector<const CallExpr*, 8> calls;
+    utils::GetCallsNotReturned(definition->getBody(), calls);
+    for (const CallExpr* CE : calls)
+      if (const FunctionDecl* callee = CE->getDirectCallee())
+        if (m_Context.hasSameUnqualifiedType(callee->getReturnType(),
+                                             FD->getReturnType()) &&
+            IsRecordableRecursiveFn(callee))
+          return true;
+    return false;
+  }
+
+  FunctionDecl* ReverseModeVisitor::GetRecordingPass(const FunctionDecl* FD) {
+    if (m_Mode == DiffMode::reverse_mode_recording_pass &&
+        FD->getCanonicalDecl() == m_Function->getCanonicalDecl())
+      return m_Derivative;
+    DiffRequest recordRequest;
+    recordRequest.Function = FD;
+    recordRequest.Mode = DiffMode::reverse_mode_recording_pass;
+    recordRequest.BaseFunctionName = utils::ComputeEffectiveFnName(FD);
+    // Silence diag outputs in nested derivation process.
+    recordRequest.VerboseDiags = false;
+    FunctionDecl* recordFD = m_Builder.FindDerivedFunction(recordRequest);
+    if (!recordFD) {
+      // Derive the declaration of the recording pass.
+      recordRequest.DeclarationOnly = true;
+      recordFD = plugin::ProcessDiffRequest(m_CladPlugin, recordRequest);
+      // Add the request to derive the definition of the recording pass.
+      recordRequest.DeclarationOnly = false;
+      recordRequest.DerivedFDPrototype = recordFD;
+      plugin::AddRequestToSchedule(m_CladPlugin, recordRequest);
+    }
+    return recordFD;
+  }
+
+  Expr* ReverseModeVisitor::GetRecursionFrame() {
+    if (!m_RecursionFrame) {
+      TemplateDecl* frameDecl =
+          LookupTemplateDeclInCladNamespace("recursion_frame");
+      QualType T =
+          getNonConstType(m_Function->getReturnType(), m_Context, m_Sema);
+      m_RecursionFrame = BuildGlobalVarDecl(
+          InstantiateTemplate(frameDecl, {T}), "_frame", /*Init=*/nullptr);
+    }
+    return BuildDeclRef(m_RecursionFrame);
+  }
+
+  Expr* ReverseModeVisitor::BuildRecursiveCallValue(
+      const CallExpr* CE, const FunctionDecl* FD,
+      llvm::MutableArrayRef<Expr*> args) {
+    if (m_ExternalSource || !IsRecordableRecursiveFn(FD))
+      return nullptr;
+    SourceLocation Loc = CE->getExprLoc();
+    bool isReturned = CE == m_ReturnedValue;
+    // The value is stored in a variable of the function scope, so that it can
+    // be used outside of the block of a branch, e.g. in `c ? f(x) : 0`.
+    auto store = [this](Expr* E) -> Expr* {
+      VarDecl* VD = GlobalStoreImpl(
+          getNonConstType(E->getType(), m_Context, m_Sema), "_t");
+      addToCurrentBlock(BuildOp(BO_Assign, BuildDeclRef(VD), E),
+                        direction::forward);
+      return BuildDeclRef(VD);
+    };
+    // The recording pass of the current function records the value of the
+    // call, which the pullback pops.
+    if ((m_Mode == DiffMode::experimental_pullback ||
+         m_Mode == DiffMode::reverse_mode_recording_pass) &&
+        m_Context.hasSameUnqualifiedType(FD->getReturnType(),
+                                         m_Function->getReturnType()) &&
+        HasRecordingPass(m_Function)) {
+      if (m_Mode == DiffMode::experimental_pullback) {
+        if (isReturned)
+          return nullptr;
+        return store(
+            BuildCallExprToMemFn(GetRecursionFrame(), "pop", {}, Loc));
+      }
+      // Record the values of the calls made by the callee as well, its
+      // pullback pops them in the reverse sweep.
+      Expr* call = nullptr;
+      if (HasRecordingPass(FD))
+        call = BuildCallExprToFunction(GetRecordingPass(FD), args);
+      else
+        call = m_Sema
+                   .ActOnCallExpr(getCurrentScope(), Clone(CE->getCallee()),
+                                  Loc, args, Loc)
+                   .get();
+      if (isReturned)
+        return call;
+      return store(
+          BuildCallExprToMemFn(GetRecursionFrame(), "record", {call}, Loc));
+    }
+    // Otherwise, the recording pass of the callee is called in the forward
+    // sweep, before its pullback is called in the reverse sweep.
+    if (m_Mode == DiffMode::reverse_mode_recording_pass ||
+        m_Mode == DiffMode::reverse_mode_forward_pass ||
+        m_Derivative->isConstexpr() || !HasRecordingPass(FD))
+      return nullptr;
+    return store(BuildCallExprToFunction(GetRecordingPass(FD), args));
+  }
+
   void ReverseModeVisitor::DifferentiateWithClad() {
-    TBRAnalyzer analyzer(m_Context);
     if (enableTBR) {
-      analyzer.Analyze(m_Function);
-      m_ToBeRecorded = analyzer.getResult();
+      const TBRAnalysisResult& TBR = m_Builder.getTBRAnalysisResult(m_Function);
+      m_ToBeRecorded = TBR.ToBeRecorded;
+      m_ToBeRecordedFields = TBR.ToBeRecordedFields;
     }
 
     llvm::ArrayRef<ParmVarDecl*> paramsRef = m_Derivative->parameters();
@@ -601,7 +1532,7 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
       // in vector mode last non diff parameter is output parameter.
       if (isVectorValued && i == m_Function->getNumParams() - 1)
         continue;
-      auto VDDerivedType = param->getType();
+      auto VDDerivedType = UseAdjointType(param->getType());
       // We cannot initialize derived variable for pointer types because
       // we do not know the correct size.
       if (utils::isArrayOrPointerType(VDDerivedType))
@@ -617,7 +1548,41 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
     StmtDiff BodyDiff = Visit(m_Function->getBody());
     Stmt* Forward = BodyDiff.getStmt();
     Stmt* Reverse = BodyDiff.getStmt_dx();
+    if (m_EnableProfiling)
+      AddSweepProbes(Forward, Reverse);
+    if (enableTapeCheckpoint)
+      AddTapeStateSync(Forward);
     // Create the body of the function.
+    // The specialized derivatives ignore the values passed for the bound
+    // parameters, check that they are the bound ones.
+    // clad::check_bound_arg(n, 3);
+    for (unsigned i = 0, e = m_Function->getNumParams(); i < e; ++i) {
+      auto constIt = m_ConstantArgs.find(m_Function->getParamDecl(i));
+      if (constIt == m_ConstantArgs.end())
+        continue;
+      ParmVarDecl* PVD = m_Derivative->getParamDecl(i);
+      std::int64_t value = constIt->second;
+      QualType T = PVD->getType().getUnqualifiedType();
+      if (T->isBooleanType() ||
+          m_Context.getTypeSize(T) < m_Context.getTypeSize(m_Context.IntTy))
+        T = m_Context.IntTy;
+      Expr* bound = ConstantFolder::synthesizeLiteral(
+          T, m_Context, value < 0 ? -value : value);
+      if (value < 0)
+        bound = BuildOp(UO_Minus, bound);
+      llvm::SmallVector<Expr*, 2> checkArgs{BuildDeclRef(PVD), bound};
+      CXXScopeSpec CSS;
+      CSS.Extend(m_Context, GetCladNamespace(), noLoc, noLoc);
+      LookupResult R(m_Sema, &m_Context.Idents.get("check_bound_arg"), noLoc,
+                     Sema::LookupOrdinaryName);
+      m_Sema.LookupQualifiedName(R, GetCladNamespace(), CSS);
+      Expr* fn = m_Sema.BuildDeclarationNameExpr(CSS, R, /*ADL=*/false).get();
+      addToCurrentBlock(m_Sema
+                            .ActOnCallExpr(getCurrentScope(), fn, noLoc,
+                                           checkArgs, noLoc)
+                            .get(),
+                        direction::forward);
+    }
     // Firstly, all "global" Stmts are put into fn's body.
     for (Stmt* S : m_Globals)
       addToCurrentBlock(S, direction::forward);
@@ -643,6 +1608,399 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
 
     if (m_ExternalSource)
       m_ExternalSource->ActOnEndOfDerivedFnBody();
+
+    if (enableLifetimeAnalysis)
+      NarrowHoistedDeclScopes();
+  }
+
+  bool ReverseModeVisitor::ComputeJacobianColumns(
+      const DiffParams& args, const DiffRequest& request) {
+    SourceLocation loc = request.Args ? request.Args->getEndLoc() : noLoc;
+    const DiffInputVarsInfo& DVI = request.DVI;
+    numParams = 0;
+    for (std::size_t i = 0; i < args.size(); ++i) {
+      const ValueDecl* arg = args[i];
+      unsigned size = 1;
+      if (utils::isArrayOrPointerType(arg->getType())) {
+        if (columnMajorOutput) {
+          diag(DiagnosticsEngine::Error, loc,
+               "Jacobians w.r.t. array or pointer parameters can only be "
+               "stored in row-major order");
+          return false;
+        }
+        size = 0;
+        if (i < DVI.size() && DVI[i].paramIndexInterval.Finish) {
+          IndexInterval interval = DVI[i].paramIndexInterval;
+          if (interval.Start) {
+            diag(DiagnosticsEngine::Error, loc,
+                 "Jacobian mode differentiation w.r.t. the elements of '%0' "
+                 "must start from index 0",
+                 {arg->getName()});
+            return false;
+          }
+          size = interval.size();
+        } else if (const auto* PVD = dyn_cast<ParmVarDecl>(arg)) {
+          if (const auto* CAT =
+                  m_Context.getAsConstantArrayType(PVD->getOriginalType()))
+            size = CAT->getSize().getZExtValue();
+        }
+        if (!size &&
+            !countConstantIndices(m_Function->getBody(), arg, m_Context,
+                                  size))
+          size = 0;
+        if (!size) {
+          diag(DiagnosticsEngine::Error, loc,
+               "Jacobian mode differentiation w.r.t. array or pointer "
+               "parameters needs explicit declaration of the indices of the "
+               "array using the args parameter, e.g. '%0[0:<last index of "
+               "%0>]'",
+               {arg->getName()});
+          return false;
+        }
+      }
+      m_IndependentVars.push_back(arg);
+      m_IndependentVarColumns.push_back(numParams);
+      numParams += size;
+    }
+    return true;
+  }
+
+  Expr* ReverseModeVisitor::BuildJacobianElement(unsigned row, unsigned col) {
+    return m_Sema
+        .CreateBuiltinArraySubscriptExpr(m_Result, noLoc,
+                                         BuildJacobianIndex(row, col), noLoc)
+        .get();
+  }
+
+  Expr* ReverseModeVisitor::BuildJacobianRow(unsigned row, unsigned col) {
+    if (!row && !col)
+      return m_Result;
+    return BuildParens(
+        BuildOp(BO_Add, m_Result, BuildJacobianIndex(row, col)));
+  }
+
+  Expr* ReverseModeVisitor::BuildJacobianIndex(unsigned row, unsigned col) {
+    unsigned outer = columnMajorOutput ? col : row;
+    unsigned inner = columnMajorOutput ? row : col;
+    QualType sizeTy = m_Context.getSizeType();
+    Expr* idx = nullptr;
+    if (m_LeadingDim) {
+      // outer * ld + inner
+      if (outer) {
+        Expr* outerLit =
+            ConstantFolder::synthesizeLiteral(sizeTy, m_Context, outer);
+        idx = BuildOp(BO_Mul, outerLit, BuildDeclRef(m_LeadingDim));
+      }
+      if (inner || !idx) {
+        Expr* innerLit =
+            ConstantFolder::synthesizeLiteral(sizeTy, m_Context, inner);
+        idx = idx ? BuildOp(BO_Add, idx, innerLit) : innerLit;
+      }
+    } else {
+      assert(!columnMajorOutput && "column-major Jacobians are strided");
+      idx = ConstantFolder::synthesizeLiteral(sizeTy, m_Context,
+                                              row * numParams + col);
+    }
+    return idx;
+  }
+
+  unsigned ReverseModeVisitor::CheckJacobianColumnIndex(const ValueDecl* VD,
+                                                        const Expr* Idx) {
+    const auto* it = llvm::find(m_IndependentVars, VD);
+    if (it == m_IndependentVars.end() ||
+        !utils::isArrayOrPointerType(VD->getType()))
+      return 0;
+    std::size_t i = it - m_IndependentVars.begin();
+    unsigned end = i + 1 < m_IndependentVars.size()
+                       ? m_IndependentVarColumns[i + 1]
+                       : numParams;
+    unsigned size = end - m_IndependentVarColumns[i];
+    // The adjoints of the elements are the columns of VD. An index out of
+    // them would silently write into the columns of the next parameters.
+    Expr::EvalResult res;
+    if (!Idx->EvaluateAsInt(res, m_Context))
+      return size;
+    std::int64_t value = res.Val.getInt().getExtValue();
+    if (value < 0 || value >= static_cast<std::int64_t>(size))
+      diag(DiagnosticsEngine::Error, Idx->getBeginLoc(),
+           "the index %0 of '%1' is outside of the differentiated elements "
+           "'%1[0:%2]'",
+           {std::to_string(value), VD->getName(), std::to_string(size - 1)});
+    return 0;
+  }
+
+  Expr* ReverseModeVisitor::BuildJacobianIndexCheck(Expr* idx,
+                                                    unsigned size) {
+    Expr* sizeLit =
+        ConstantFolder::synthesizeLiteral(m_Context.IntTy, m_Context, size);
+    llvm::SmallVector<Expr*, 2> checkArgs{idx, sizeLit};
+    CXXScopeSpec CSS;
+    CSS.Extend(m_Context, GetCladNamespace(), noLoc, noLoc);
+    LookupResult R(m_Sema, &m_Context.Idents.get("check_jacobian_index"),
+                   noLoc, Sema::LookupOrdinaryName);
+    m_Sema.LookupQualifiedName(R, GetCladNamespace(), CSS);
+    Expr* fn = m_Sema.BuildDeclarationNameExpr(CSS, R, /*ADL=*/false).get();
+    return m_Sema
+        .ActOnCallExpr(getCurrentScope(), fn, noLoc, checkArgs, noLoc)
+        .get();
+  }
+
+  void ReverseModeVisitor::FindSoAAdjointParams(const DiffParams& args) {
+    for (const ValueDecl* VD : args) {
+      const auto* PVD = dyn_cast<ParmVarDecl>(VD);
+      if (!PVD || !utils::isArrayOrPointerType(PVD->getType()))
+        continue;
+      const auto* RD = dyn_cast_or_null<CXXRecordDecl>(
+          PVD->getType()->getPointeeOrArrayElementType()->getAsRecordDecl());
+      if (!RD || RD->isUnion())
+        continue;
+      llvm::SmallPtrSet<const FieldDecl*, 8> accessed;
+      bool onlyByField =
+          isOnlyAccessedByField(m_Function->getBody(), PVD, accessed);
+      // All the floating-point fields are numbered in declaration order, even
+      // those which are never accessed, so that the layout of the adjoints
+      // depends only on the struct and not on the differentiated function.
+      llvm::SmallVector<const FieldDecl*, 8> fields;
+      bool sameType = true;
+      bool anyAccessed = false;
+      for (const FieldDecl* FD : RD->fields()) {
+        if (!FD->getType()->isRealFloatingType())
+          continue;
+        anyAccessed |= accessed.count(FD) != 0;
+        if (!fields.empty() &&
+            !m_Context.hasSameUnqualifiedType(FD->getType(),
+                                              fields.front()->getType()))
+          sameType = false;
+        fields.push_back(FD);
+      }
+      if (fields.empty() || (onlyByField && !anyAccessed))
+        continue;
+      const char* reason = nullptr;
+      if (RD->getNumBases())
+        reason = "its element type has base classes";
+      else if (!sameType)
+        reason = "the floating-point fields of its element type have "
+                 "different types";
+      else if (!onlyByField)
+        reason = "it is not only accessed through the fields of its elements";
+      if (reason) {
+        diag(DiagnosticsEngine::Warning, PVD->getLocation(),
+             "the adjoints of '%0' are passed as an array of structs because "
+             "%1",
+             {PVD->getName(), reason});
+        continue;
+      }
+      m_SoAAdjoints[PVD] = fields;
+    }
+  }
+
+  bool ReverseModeVisitor::AddTapeStateSync(Stmt*& Forward) {
+    SourceLocation loc = m_Function->getLocation();
+    auto unsupported = [&](llvm::StringRef reason) {
+      diag(DiagnosticsEngine::Warning, loc,
+           "tape checkpointing is not supported for '%0': %1",
+           {m_Function->getNameAsString(), reason});
+      return false;
+    };
+    if (m_ExternalSource)
+      return unsupported("error estimation is enabled");
+    // The gradient can only be split between the sweeps if it has a single
+    // entry point into the reverse sweep, that is, a single return statement
+    // at the end of the function.
+    llvm::SmallVector<const ReturnStmt*, 2> returns;
+    collectReturnStmts(m_Function->getBody(), returns);
+    const auto* body = cast<CompoundStmt>(m_Function->getBody());
+    if (returns.size() > 1 ||
+        (returns.size() == 1 &&
+         (body->body_empty() || body->body_back() != returns.front())))
+      return unsupported("the function returns before its end");
+
+    llvm::SmallVector<Stmt*, 16> forwardStmts;
+    if (auto* CS = dyn_cast_or_null<CompoundStmt>(Forward))
+      forwardStmts.append(CS->body_begin(), CS->body_end());
+    else if (Forward)
+      forwardStmts.push_back(Forward);
+    // The jump to the reverse sweep, if any, is replaced by the
+    // synchronization.
+    if (!forwardStmts.empty() && isa<GotoStmt>(forwardStmts.back()))
+      forwardStmts.pop_back();
+
+    // The state consists of the stored values and the top-level locals. The
+    // adjoints are not part of it, they are zero between the sweeps.
+    llvm::SmallPtrSet<const ValueDecl*, 16> adjoints;
+    for (const auto& pair : m_Variables) {
+      if (!pair.second)
+        continue;
+      if (const auto* DRE = dyn_cast<DeclRefExpr>(pair.second->IgnoreImpCasts()))
+        adjoints.insert(DRE->getDecl());
+    }
+    llvm::SmallVector<VarDecl*, 16> state;
+    for (Stmt* S : m_Globals)
+      if (auto* DS = dyn_cast<DeclStmt>(S))
+        for (Decl* D : DS->decls())
+          if (auto* VD = dyn_cast<VarDecl>(D))
+            if (!adjoints.count(VD))
+              state.push_back(VD);
+    // The parameters passed by value which the forward sweep modifies hold
+    // their new values when the reverse sweep starts. The memory which the
+    // parameters refer to is not part of the state, so it must not be written.
+    for (unsigned i = 0, e = m_Function->getNumParams(); i < e; ++i) {
+      const ParmVarDecl* PVD = m_Function->getParamDecl(i);
+      QualType T = PVD->getType();
+      bool modified = isModified(m_Function->getBody(), PVD);
+      if ((T->isReferenceType() && modified) ||
+          (utils::isArrayOrPointerType(T) &&
+           mayWritePointee(m_Function->getBody(), PVD)))
+        return unsupported(("it writes to the memory referred to by '" +
+                            PVD->getName() + "'")
+                               .str());
+      if (modified)
+        state.push_back(m_Derivative->getParamDecl(i));
+    }
+    llvm::SmallVector<VarDecl*, 8> locals;
+    for (Stmt* S : forwardStmts) {
+      auto* DS = dyn_cast<DeclStmt>(S);
+      if (!DS)
+        continue;
+      for (Decl* D : DS->decls()) {
+        auto* VD = dyn_cast<VarDecl>(D);
+        if (!VD)
+          return unsupported("the function declares local types");
+        QualType T = VD->getType();
+        if (T.isConstQualified() || T->isReferenceType() || T->isArrayType() ||
+            (VD->getInit() && isa<InitListExpr>(VD->getInit())))
+          return unsupported(
+              ("local variable '" + VD->getName() + "' cannot be reassigned")
+                  .str());
+        locals.push_back(VD);
+        state.push_back(VD);
+      }
+    }
+    for (const VarDecl* VD : state)
+      if (!isTapeStateSerializable(VD->getType()))
+        return unsupported(
+            ("variable '" + VD->getName() + "' cannot be serialized").str());
+
+    // Declare the locals before the forward sweep and initialize them in it.
+    Stmts result;
+    for (VarDecl* VD : locals)
+      result.push_back(BuildDeclStmt(VD));
+    Stmts guarded;
+    for (Stmt* S : forwardStmts) {
+      auto* DS = dyn_cast<DeclStmt>(S);
+      if (!DS) {
+        guarded.push_back(S);
+        continue;
+      }
+      for (Decl* D : DS->decls()) {
+        auto* VD = cast<VarDecl>(D);
+        if (Expr* init = VD->getInit()) {
+          VD->setInit(nullptr);
+          guarded.push_back(BuildOp(BO_Assign, BuildDeclRef(VD), init));
+        }
+      }
+    }
+
+    NamespaceDecl* CladNS = GetCladNamespace();
+    auto buildCladCall = [&](llvm::StringRef name,
+                             llvm::MutableArrayRef<Expr*> args) {
+      CXXScopeSpec CSS;
+      CSS.Extend(m_Context, CladNS, noLoc, noLoc);
+      LookupResult R(m_Sema, &m_Context.Idents.get(name), noLoc,
+                     Sema::LookupOrdinaryName);
+      m_Sema.LookupQualifiedName(R, CladNS, CSS);
+      Expr* fn = m_Sema.BuildDeclarationNameExpr(CSS, R, /*ADL=*/false).get();
+      return m_Sema.ActOnCallExpr(getCurrentScope(), fn, noLoc, args, noLoc)
+          .get();
+    };
+    // if (!clad::restoring_tape_state()) { forward sweep }
+    Expr* restoring = buildCladCall("restoring_tape_state", {});
+    result.push_back(clad_compat::IfStmt_Create(
+        m_Context, noLoc, /*IsConstexpr=*/false, /*Init=*/nullptr,
+        /*Var=*/nullptr, BuildOp(UO_LNot, restoring), noLoc, noLoc,
+        MakeCompoundStmt(guarded)));
+    // if (clad::sync_tape_state("f_grad", state...)) return;
+    llvm::SmallVector<Expr*, 16> syncArgs{utils::CreateStringLiteral(
+        m_Context, m_Derivative->getNameAsString())};
+    for (VarDecl* VD : state)
+      syncArgs.push_back(BuildDeclRef(VD));
+    Stmt* ret = m_Sema.ActOnReturnStmt(noLoc, nullptr, getCurrentScope()).get();
+    result.push_back(clad_compat::IfStmt_Create(
+        m_Context, noLoc, /*IsConstexpr=*/false, /*Init=*/nullptr,
+        /*Var=*/nullptr, buildCladCall("sync_tape_state", syncArgs), noLoc,
+        noLoc, ret));
+    Forward = MakeCompoundStmt(result);
+    return true;
+  }
+
+  void ReverseModeVisitor::AddSweepProbes(Stmt*& Forward, Stmt*& Reverse) {
+    Stmts forwardStmts{BuildProfilingProbe(/*begin=*/true, "forward")};
+    if (auto* CS = dyn_cast_or_null<CompoundStmt>(Forward))
+      forwardStmts.append(CS->body_begin(), CS->body_end());
+    else if (Forward)
+      forwardStmts.push_back(Forward);
+    if (!isa<GotoStmt>(forwardStmts.back()))
+      AddSweepSwitchProbes(forwardStmts);
+    Forward = MakeCompoundStmt(forwardStmts);
+
+    Stmts reverseStmts;
+    if (auto* RCS = dyn_cast_or_null<CompoundStmt>(Reverse))
+      reverseStmts.append(RCS->body_begin(), RCS->body_end());
+    else if (Reverse)
+      reverseStmts.push_back(Reverse);
+    reverseStmts.push_back(BuildProfilingProbe(/*begin=*/false, "reverse"));
+    Reverse = MakeCompoundStmt(reverseStmts);
+  }
+
+  void ReverseModeVisitor::AddSweepSwitchProbes(Stmts& block) {
+    block.push_back(BuildProfilingProbe(/*begin=*/false, "forward"));
+    block.push_back(BuildProfilingProbe(/*begin=*/true, "reverse"));
+  }
+
+  StmtDiff ReverseModeVisitor::ProfileLoop(const Stmt* Loop,
+                                           StmtDiff LoopDiff) {
+    if (!m_EnableProfiling || !LoopDiff.getStmt())
+      return LoopDiff;
+    std::string site = GetLoopProfilingSite(Loop);
+    Stmt* Forward = BuildProfiledStmt(LoopDiff.getStmt(), site);
+    Stmt* Reverse = LoopDiff.getStmt_dx();
+    if (Reverse)
+      Reverse = BuildProfiledStmt(Reverse, site + ":reverse");
+    return {Forward, Reverse};
+  }
+
+  void ReverseModeVisitor::NarrowHoistedDeclScopes() {
+    Stmts& block = getCurrentBlock(direction::forward);
+    llvm::SmallPtrSet<Stmt*, 16> hoisted(m_Globals.begin(), m_Globals.end());
+    LifetimeAnalyzer analyzer(m_Context);
+    LifetimeAnalyzer::Result res = analyzer.Analyze(block, hoisted);
+
+    llvm::SmallPtrSet<Stmt*, 16> removed(res.Dead.begin(), res.Dead.end());
+    for (const auto& decls : res.Sinkable)
+      removed.insert(decls.begin(), decls.end());
+    if (removed.empty())
+      return;
+
+    Stmts narrowed;
+    for (unsigned i = 0, e = block.size(); i < e; ++i) {
+      Stmt* S = block[i];
+      if (removed.count(S))
+        continue;
+      const auto& decls = res.Sinkable[i];
+      if (decls.empty()) {
+        narrowed.push_back(S);
+        continue;
+      }
+      // Put the declarations at the beginning of the statement if it is a
+      // block, otherwise create a new block around it.
+      Stmts scoped(decls.begin(), decls.end());
+      if (auto* CS = dyn_cast<CompoundStmt>(S))
+        scoped.append(CS->body_begin(), CS->body_end());
+      else
+        scoped.push_back(S);
+      narrowed.push_back(MakeCompoundStmt(scoped));
+    }
+    block = std::move(narrowed);
   }
 
   void ReverseModeVisitor::DifferentiateWithEnzyme() {
@@ -796,6 +2154,23 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
   }
 
   StmtDiff ReverseModeVisitor::VisitIfStmt(const clang::IfStmt* If) {
+    // Only the taken branch is differentiated if the condition depends on
+    // parameters bound to constants only.
+    llvm::APSInt condValue;
+    if (!m_ConstantArgs.empty() && !If->getInit() &&
+        !If->getConditionVariable() &&
+        EvaluateWithConstantArgs(If->getCond(), m_ConstantArgs, m_Context,
+                                 condValue)) {
+      const Stmt* taken =
+          condValue.getBoolValue() ? If->getThen() : If->getElse();
+      if (!taken)
+        return {};
+      if (isa<CompoundStmt>(taken))
+        return Visit(taken);
+      Stmts block{const_cast<Stmt*>(taken)};
+      return Visit(MakeCompoundStmt(block));
+    }
+
     // Control scope of the IfStmt. E.g., in if (double x = ...) {...}, x goes
     // to this scope.
     beginScope(Scope::DeclScope | Scope::ControlScope);
@@ -1031,6 +2406,12 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
   }
 
   StmtDiff ReverseModeVisitor::VisitForStmt(const ForStmt* FS) {
+    if (enableStencilGather && !isInsideLoop) {
+      StmtDiff stencilDiff = DifferentiateStencilLoop(FS);
+      if (stencilDiff.getStmt())
+        return ProfileLoop(FS, stencilDiff);
+    }
+
     beginScope(Scope::DeclScope | Scope::ControlScope | Scope::BreakScope |
                Scope::ContinueScope);
 
@@ -1151,6 +2532,273 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
     Reverse = endBlock(direction::reverse);
     endScope();
 
+    return ProfileLoop(
+        FS, {unwrapIfSingleStmt(Forward), unwrapIfSingleStmt(Reverse)});
+  }
+
+  Expr* ReverseModeVisitor::RebuildStencilExpr(const Expr* E,
+                                               const VarDecl* counter,
+                                               Expr* counterRef) {
+    E = E->IgnoreImpCasts();
+    if (const auto* DRE = dyn_cast<DeclRefExpr>(E)) {
+      if (DRE->getDecl() == counter)
+        return Clone(counterRef);
+      return Visit(DRE).getExpr();
+    }
+    if (const auto* PE = dyn_cast<ParenExpr>(E))
+      return BuildParens(
+          RebuildStencilExpr(PE->getSubExpr(), counter, counterRef));
+    if (const auto* UO = dyn_cast<UnaryOperator>(E))
+      return BuildOp(UO->getOpcode(), RebuildStencilExpr(UO->getSubExpr(),
+                                                         counter, counterRef));
+    if (const auto* BO = dyn_cast<BinaryOperator>(E))
+      return BuildOp(BO->getOpcode(),
+                     RebuildStencilExpr(BO->getLHS(), counter, counterRef),
+                     RebuildStencilExpr(BO->getRHS(), counter, counterRef));
+    if (const auto* ASE = dyn_cast<ArraySubscriptExpr>(E)) {
+      Expr* idx = RebuildStencilExpr(ASE->getIdx(), counter, counterRef);
+      return BuildArraySubscript(
+          RebuildStencilExpr(ASE->getBase(), counter, counterRef), idx);
+    }
+    return Clone(E);
+  }
+
+  StmtDiff ReverseModeVisitor::DifferentiateStencilLoop(const ForStmt* FS) {
+    // Match `for (T i = lower; i < upper; ++i)` with a signed integer `i`.
+    const auto* initDS = dyn_cast_or_null<DeclStmt>(FS->getInit());
+    if (!initDS || !initDS->isSingleDecl() || FS->getConditionVariable())
+      return {};
+    const auto* counter = dyn_cast<VarDecl>(initDS->getSingleDecl());
+    if (!counter || !counter->getType()->isSignedIntegerType() ||
+        !counter->getInit())
+      return {};
+    const auto* cond = dyn_cast_or_null<BinaryOperator>(FS->getCond());
+    if (!cond || cond->getOpcode() != BO_LT)
+      return {};
+    const auto* condDRE =
+        dyn_cast<DeclRefExpr>(cond->getLHS()->IgnoreParenImpCasts());
+    if (!condDRE || condDRE->getDecl() != counter)
+      return {};
+    const auto* inc = dyn_cast_or_null<UnaryOperator>(FS->getInc());
+    if (!inc || !inc->isIncrementOp())
+      return {};
+    const auto* incDRE =
+        dyn_cast<DeclRefExpr>(inc->getSubExpr()->IgnoreParenImpCasts());
+    if (!incDRE || incDRE->getDecl() != counter)
+      return {};
+    // The bounds are evaluated once and must not depend on the loop.
+    const Expr* lower = counter->getInit();
+    const Expr* upper = cond->getRHS();
+    if (!isStencilBound(lower, counter, m_Context) ||
+        !isStencilBound(upper, counter, m_Context))
+      return {};
+
+    // The body has to be a single statement `out[i] = ...` or
+    // `out[i] += ...`, where the right-hand side is a linear combination of
+    // elements of other arrays with constant offsets from `i`.
+    const Stmt* body = FS->getBody();
+    if (const auto* CS = dyn_cast<CompoundStmt>(body)) {
+      if (CS->size() != 1)
+        return {};
+      body = CS->body_front();
+    }
+    const auto* assign = dyn_cast<BinaryOperator>(body);
+    if (!assign || (assign->getOpcode() != BO_Assign &&
+                    assign->getOpcode() != BO_AddAssign))
+      return {};
+    const auto* LHS =
+        dyn_cast<ArraySubscriptExpr>(assign->getLHS()->IgnoreParenImpCasts());
+    int64_t outOffset = 0;
+    if (!LHS || !matchStencilIndex(LHS->getIdx(), counter, outOffset) ||
+        outOffset != 0)
+      return {};
+    const auto* outDRE =
+        dyn_cast<DeclRefExpr>(LHS->getBase()->IgnoreParenImpCasts());
+    const auto* out = outDRE ? dyn_cast<VarDecl>(outDRE->getDecl()) : nullptr;
+    if (!out || !utils::isArrayOrPointerType(out->getType()) ||
+        !m_Variables.count(out))
+      return {};
+    llvm::SmallVector<StencilTerm, 4> terms;
+    if (!collectStencilTerms(assign->getRHS(), counter, StencilTerm(), terms))
+      return {};
+    for (const StencilTerm& term : terms)
+      if (term.In == out)
+        return {};
+
+    beginScope(Scope::DeclScope | Scope::ControlScope | Scope::BreakScope |
+               Scope::ContinueScope);
+    beginBlock(direction::forward);
+    beginBlock(direction::reverse);
+
+    QualType counterTy = counter->getType();
+    auto shift = [&](Expr* E, int64_t offset) -> Expr* {
+      if (offset == 0)
+        return E;
+      Expr* lit = ConstantFolder::synthesizeLiteral(
+          counterTy, m_Context, static_cast<uint64_t>(std::abs(offset)));
+      return BuildOp(offset > 0 ? BO_Add : BO_Sub, E, lit);
+    };
+    auto buildLoop = [&](VarDecl* ctr, Expr* cond, Expr* inc, Stmts& body) {
+      return new (m_Context)
+          ForStmt(m_Context, BuildDeclStmt(ctr), cond, nullptr, inc,
+                  MakeCompoundStmt(body), noLoc, noLoc, noLoc);
+    };
+
+    // The bounds are needed in the reverse pass.
+    Expr* L = GlobalStoreAndRef(Visit(lower).getExpr()).getExpr_dx();
+    Expr* U = GlobalStoreAndRef(Visit(upper).getExpr()).getExpr_dx();
+    Expr* outE = Visit(outDRE).getExpr();
+    Expr* dOutE = m_Variables[out];
+
+    // The gather form assumes that the loop does not read the elements it
+    // writes and that the adjoints it reads are not accumulated into. Unless
+    // the arrays are distinct local arrays, check at run time that the read
+    // and written ranges do not overlap:
+    // clad::check_stencil_alias(in + (L - 1), in + (U + 1), out + L, out + U);
+    llvm::SmallVector<const StencilTerm*, 2> readRanges;
+    for (const StencilTerm& term : terms)
+      if (llvm::none_of(readRanges, [&](const StencilTerm* other) {
+            return other->In == term.In;
+          }))
+        readRanges.push_back(&term);
+    auto isLocalArray = [](const VarDecl* VD) {
+      return !isa<ParmVarDecl>(VD) && VD->getType()->isArrayType();
+    };
+    auto buildAliasCheck = [&](Expr* inE, Expr* outArr, int64_t minOffset,
+                               int64_t maxOffset) {
+      llvm::SmallVector<Expr*, 4> checkArgs{
+          BuildOp(BO_Add, inE, BuildParens(shift(Clone(L), minOffset))),
+          BuildOp(BO_Add, Clone(inE), BuildParens(shift(Clone(U), maxOffset))),
+          BuildOp(BO_Add, Clone(outArr), Clone(L)),
+          BuildOp(BO_Add, Clone(outArr), Clone(U))};
+      CXXScopeSpec CSS;
+      CSS.Extend(m_Context, GetCladNamespace(), noLoc, noLoc);
+      LookupResult R(m_Sema, &m_Context.Idents.get("check_stencil_alias"),
+                     noLoc, Sema::LookupOrdinaryName);
+      m_Sema.LookupQualifiedName(R, GetCladNamespace(), CSS);
+      Expr* fn = m_Sema.BuildDeclarationNameExpr(CSS, R, /*ADL=*/false).get();
+      addToCurrentBlock(m_Sema
+                            .ActOnCallExpr(getCurrentScope(), fn, noLoc,
+                                           checkArgs, noLoc)
+                            .get(),
+                        direction::forward);
+    };
+    for (const StencilTerm* range : readRanges) {
+      if (isLocalArray(range->In) && isLocalArray(out))
+        continue;
+      int64_t minOffset = std::numeric_limits<int64_t>::max();
+      int64_t maxOffset = std::numeric_limits<int64_t>::min();
+      for (const StencilTerm& term : terms)
+        if (term.In == range->In) {
+          minOffset = std::min(minOffset, term.Offset);
+          maxOffset = std::max(maxOffset, term.Offset);
+        }
+      buildAliasCheck(Visit(range->InRef).getExpr(), outE, minOffset,
+                      maxOffset);
+      if (m_Variables.count(range->In))
+        buildAliasCheck(Clone(m_Variables[range->In]), dOutE, minOffset,
+                        maxOffset);
+    }
+
+    // Forward pass: the original loop, storing the overwritten elements.
+    VarDecl* fwdCounter = BuildVarDecl(counterTy, "_i", Clone(L));
+    Expr* fwdIdx = BuildDeclRef(fwdCounter);
+    Expr* outElem = BuildArraySubscript(Clone(outE), fwdIdx);
+    CladTapeResult tape = MakeCladTapeFor(outElem);
+    Stmts fwdBody{tape.Push};
+    fwdBody.push_back(BuildOp(
+        assign->getOpcode(), Clone(outElem),
+        RebuildStencilExpr(assign->getRHS(), counter,
+                           BuildDeclRef(fwdCounter))));
+    addToCurrentBlock(buildLoop(fwdCounter,
+                                BuildOp(BO_LT, BuildDeclRef(fwdCounter),
+                                        Clone(U)),
+                                BuildOp(UO_PreInc, BuildDeclRef(fwdCounter)),
+                                fwdBody),
+                      direction::forward);
+
+    // Reverse pass: the elements of `out` are restored and, for assignments,
+    // their adjoints are reset. The statements of the reverse block are
+    // emitted in the reverse order.
+    VarDecl* revCounter =
+        BuildVarDecl(counterTy, "_i", shift(Clone(U), -1));
+    Expr* revIdx = BuildDeclRef(revCounter);
+    Stmts restoreBody{
+        BuildOp(BO_Assign, BuildArraySubscript(Clone(outE), revIdx), tape.Pop)};
+    if (assign->getOpcode() == BO_Assign) {
+      Expr* dOutIdx = BuildDeclRef(revCounter);
+      Expr* dOutElem = BuildArraySubscript(Clone(dOutE), dOutIdx);
+      restoreBody.push_back(BuildOp(BO_Assign, dOutElem,
+                                    getZeroInit(dOutElem->getType())));
+    }
+    addToCurrentBlock(buildLoop(revCounter,
+                                BuildOp(BO_GE, BuildDeclRef(revCounter),
+                                        Clone(L)),
+                                BuildOp(UO_PreDec, BuildDeclRef(revCounter)),
+                                restoreBody),
+                      direction::reverse);
+
+    // The adjoint of `out[i] = c * in[i + k]` is `_d_in[i + k] += c *
+    // _d_out[i]`. Iterating over the elements of `_d_in` instead, every
+    // iteration only writes to its own element:
+    // `_d_in[j] += c * _d_out[j - k]`, for `lower <= j - k < upper`.
+    llvm::SmallVector<const VarDecl*, 2> inputs;
+    for (const StencilTerm& term : terms)
+      if (m_Variables.count(term.In) && !llvm::is_contained(inputs, term.In))
+        inputs.push_back(term.In);
+    for (const VarDecl* in : inputs) {
+      int64_t minOffset = std::numeric_limits<int64_t>::max();
+      int64_t maxOffset = std::numeric_limits<int64_t>::min();
+      for (const StencilTerm& term : terms)
+        if (term.In == in) {
+          minOffset = std::min(minOffset, term.Offset);
+          maxOffset = std::max(maxOffset, term.Offset);
+        }
+      VarDecl* gatherCounter =
+          BuildVarDecl(counterTy, "_j", shift(Clone(L), minOffset));
+      Expr* dInE = m_Variables[in];
+      Stmts gatherBody;
+      for (const StencilTerm& term : terms) {
+        if (term.In != in)
+          continue;
+        Expr* srcIdx = shift(BuildDeclRef(gatherCounter), -term.Offset);
+        Expr* contribution = BuildArraySubscript(Clone(dOutE), srcIdx);
+        for (const auto& coef : term.Coefs)
+          contribution = coef.second
+                             ? BuildOp(BO_Div, contribution, Clone(coef.first))
+                             : BuildOp(BO_Mul, Clone(coef.first), contribution);
+        Expr* dstIdx = BuildDeclRef(gatherCounter);
+        Stmt* update =
+            BuildOp(term.Negate ? BO_SubAssign : BO_AddAssign,
+                    BuildArraySubscript(Clone(dInE), dstIdx), contribution);
+        // Elements at the boundary are only read by some of the iterations.
+        if (minOffset != maxOffset) {
+          Expr* guard = BuildOp(
+              BO_LAnd,
+              BuildOp(BO_GE,
+                      shift(BuildDeclRef(gatherCounter), -term.Offset),
+                      Clone(L)),
+              BuildOp(BO_LT,
+                      shift(BuildDeclRef(gatherCounter), -term.Offset),
+                      Clone(U)));
+          update = clad_compat::IfStmt_Create(
+              m_Context, noLoc, /*IsConstexpr=*/false, /*Init=*/nullptr,
+              /*Var=*/nullptr, guard, noLoc, noLoc, update);
+        }
+        gatherBody.push_back(update);
+      }
+      addToCurrentBlock(
+          buildLoop(gatherCounter,
+                    BuildOp(BO_LT, BuildDeclRef(gatherCounter),
+                            shift(Clone(U), maxOffset)),
+                    BuildOp(UO_PreInc, BuildDeclRef(gatherCounter)),
+                    gatherBody),
+          direction::reverse);
+    }
+
+    Stmt* Forward = endBlock(direction::forward);
+    Stmt* Reverse = endBlock(direction::reverse);
+    endScope();
     return {unwrapIfSingleStmt(Forward), unwrapIfSingleStmt(Reverse)};
   }
 
@@ -1192,10 +2840,34 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
                                     m_Sema.PrepareScalarCast(tmp, type))
                  .get();
     }
-    auto ReturnResult = DifferentiateSingleExpr(value, dfdf);
+    std::pair<StmtDiff, StmtDiff> ReturnResult;
+    {
+      llvm::SaveAndRestore<const Expr*> SaveReturned(
+          m_ReturnedValue, value->IgnoreParenImpCasts());
+      ReturnResult = DifferentiateSingleExpr(value, dfdf);
+    }
     StmtDiff ReturnDiff = ReturnResult.first;
     StmtDiff ExprDiff = ReturnResult.second;
+    // The recording pass has no reverse sweep and returns the value.
+    if (m_Mode == DiffMode::reverse_mode_recording_pass) {
+      for (Stmt* S : cast<CompoundStmt>(ReturnDiff.getStmt())->body())
+        addToCurrentBlock(S, direction::forward);
+      return m_Sema.BuildReturnStmt(noLoc, ExprDiff.getExpr()).get();
+    }
     Stmt* Reverse = ReturnDiff.getStmt_dx();
+    // A return at the end of a constexpr function is reached by falling
+    // through, so the reverse pass can follow directly. Constant evaluation
+    // does not support goto.
+    const auto* body = dyn_cast<CompoundStmt>(m_Function->getBody());
+    if (m_Derivative->isConstexpr() && body && !body->body_empty() &&
+        body->body_back() == RS) {
+      addToCurrentBlock(Reverse, direction::reverse);
+      for (Stmt* S : cast<CompoundStmt>(ReturnDiff.getStmt())->body())
+        addToCurrentBlock(S, direction::forward);
+      if (m_ExternalSource && !isCladValueAndPushforwardType(type))
+        m_ExternalSource->ActBeforeFinalizingVisitReturnStmt(ExprDiff);
+      return {};
+    }
     // If the original function returns at this point, some part of the reverse
     // pass (corresponding to other branches that do not return here) must be
     // skipped. We create a label in the reverse pass and jump to it via goto.
@@ -1209,6 +2881,8 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
     addToCurrentBlock(LS, direction::reverse);
     for (Stmt* S : cast<CompoundStmt>(ReturnDiff.getStmt())->body())
       addToCurrentBlock(S, direction::forward);
+    if (m_EnableProfiling)
+      AddSweepSwitchProbes(getCurrentBlock(direction::forward));
 
     // FIXME: When the return type of a function is a class, ExprDiff.getExpr()
     // returns nullptr, which is a bug. For the time being, the only use case of
@@ -1317,6 +2991,16 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
     Expr* target = BaseDiff.getExpr_dx();
     if (!target)
       return cloned;
+    // clad::check_jacobian_index(i, size)
+    const auto* BaseDRE = dyn_cast<DeclRefExpr>(Base->IgnoreParenImpCasts());
+    if (isVectorValued && BaseDRE && Indices.size() == 1)
+      if (unsigned size =
+              CheckJacobianColumnIndex(BaseDRE->getDecl(), Indices[0])) {
+        reverseIndices[0] =
+            BuildJacobianIndexCheck(Clone(reverseIndices[0]), size);
+        forwSweepDerivativeIndices[0] =
+            BuildJacobianIndexCheck(forwSweepDerivativeIndices[0], size);
+      }
     Expr* result = nullptr;
     Expr* forwSweepDerivative = nullptr;
     // Create the target[idx] expression.
@@ -1335,6 +3019,24 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
   }
 
   StmtDiff ReverseModeVisitor::VisitDeclRefExpr(const DeclRefExpr* DRE) {
+    auto constIt = m_ConstantArgs.find(DRE->getDecl());
+    if (constIt != m_ConstantArgs.end()) {
+      std::int64_t value = constIt->second;
+      QualType T = DRE->getType().getUnqualifiedType();
+      if (T->isBooleanType())
+        return StmtDiff(
+            m_Sema
+                .ActOnCXXBoolLiteral(noLoc, value ? tok::kw_true : tok::kw_false)
+                .get());
+      // Integer literals of types narrower than int cannot be printed.
+      if (m_Context.getTypeSize(T) < m_Context.getTypeSize(m_Context.IntTy))
+        T = m_Context.IntTy;
+      Expr* literal = ConstantFolder::synthesizeLiteral(
+          T, m_Context, value < 0 ? -value : value);
+      if (value < 0)
+        literal = BuildOp(UO_Minus, literal);
+      return StmtDiff(literal);
+    }
     Expr* clonedDRE = Clone(DRE);
     // Check if referenced Decl was "replaced" with another identifier inside
     // the derivative
@@ -1410,6 +3112,29 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
       return StmtDiff(Clone(CE));
     }
 
+    // With TBR analysis, trivial assignments of objects are differentiated
+    // field by field, so that only the fields required in the reverse pass
+    // are stored instead of the whole object.
+    if (enableTBR && !dfdx() && utils::IsFieldwiseAssignment(CE)) {
+      auto* L = const_cast<Expr*>(CE->getArg(0)->IgnoreParenImpCasts());
+      auto* R = const_cast<Expr*>(CE->getArg(1)->IgnoreParenImpCasts());
+      const CXXRecordDecl* RD = cast<CXXMethodDecl>(FD)->getParent();
+      Expr* forward = nullptr;
+      for (const FieldDecl* field : RD->fields()) {
+        Expr* assign = BuildOp(
+            BO_Assign,
+            utils::BuildMemberExpr(m_Sema, getCurrentScope(), L,
+                                   field->getName()),
+            utils::BuildMemberExpr(m_Sema, getCurrentScope(), R,
+                                   field->getName()));
+        Expr* fieldForward = Visit(assign).getExpr();
+        forward = forward ? BuildOp(BO_Comma, forward, fieldForward)
+                          : fieldForward;
+      }
+      // Keep the result an lvalue referring to the assigned object.
+      return StmtDiff(BuildOp(BO_Comma, forward, Visit(L).getExpr()));
+    }
+
     auto NArgs = FD->getNumParams();
     // If the function has no args and is not a member function call then we
     // assume that it is not related to independent variables and does not
@@ -1656,6 +3381,9 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
     // forward mode(it is unlikely that we need gradient of a one-dimensional'
     // function).
     bool asGrad = true;
+    // Whether the derivative is produced by clad, as opposed to a custom or
+    // numerical derivative.
+    bool isCladDerivative = false;
 
     if (NArgs == 1 && !utils::HasAnyReferenceOrPointerArgument(FD) &&
         !isa<CXXMethodDecl>(FD)) {
@@ -1780,6 +3508,7 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
                                   .ActOnCallExpr(getCurrentScope(), selfRef,
                                                  Loc, pullbackCallArgs, Loc)
                                   .get();
+        isCladDerivative = true;
       } else {
         if (m_ExternalSource)
           m_ExternalSource->ActBeforeDifferentiatingCallExpr(
@@ -1794,6 +3523,11 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
         // Silence diag outputs in nested derivation process.
         pullbackRequest.VerboseDiags = false;
         pullbackRequest.EnableTBRAnalysis = enableTBR;
+        pullbackRequest.EnableLifetimeAnalysis = enableLifetimeAnalysis;
+        pullbackRequest.EnableStencilGather = enableStencilGather;
+        pullbackRequest.EnableLoopCheckpointing = enableLoopCheckpointing;
+        pullbackRequest.EnableSweepProfiling = m_EnableProfiling;
+        pullbackRequest.AdjointType = m_AdjointType;
         bool isaMethod = isa<CXXMethodDecl>(FD);
         for (size_t i = 0, e = FD->getNumParams(); i < e; ++i)
           if (DerivedCallOutputArgs[i + isaMethod])
@@ -1852,6 +3586,7 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
             return StmtDiff(Clone(CE));
           }
         } else if (pullbackFD) {
+          isCladDerivative = true;
           if (baseDiff.getExpr()) {
             Expr* baseE = baseDiff.getExpr();
             OverloadedDerivedFn = BuildCallExprToMemFn(
@@ -1889,7 +3624,11 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
         it++;
       } else {
         // Insert the CallExpr to the derived function
-        it = block.insert(it, OverloadedDerivedFn);
+        Stmt* pullbackCall = OverloadedDerivedFn;
+        if (m_EnableProfiling && isCladDerivative)
+          pullbackCall = BuildProfiledStmt(
+              pullbackCall, "call:" + fnDecl->getNameAsString());
+        it = block.insert(it, pullbackCall);
         it++;
       }
       // Insert PostCallStmts
@@ -1988,6 +3727,9 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
           utils::BuildMemberExpr(m_Sema, getCurrentScope(), callRes, "adjoint");
       return StmtDiff(resValue, nullptr, resAdjoint);
     } // Recreate the original call expression.
+    if (isCladDerivative)
+      if (Expr* value = BuildRecursiveCallValue(CE, FD, CallArgs))
+        return StmtDiff(value);
     call = m_Sema
                .ActOnCallExpr(getCurrentScope(), Clone(CE->getCallee()), Loc,
                               CallArgs, Loc)
@@ -2318,19 +4060,15 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
 
               std::unordered_map<const clang::ValueDecl*, clang::Expr*>
                   temp_m_Variables;
-              for (unsigned i = 0; i < numParams; i++) {
-                auto size_type = m_Context.getSizeType();
-                unsigned size_type_bits = m_Context.getIntWidth(size_type);
-                llvm::APInt idxValue(size_type_bits,
-                                     i + (outputArrayCursor * numParams));
-                auto* idx = IntegerLiteral::Create(m_Context, idxValue,
-                                                   size_type, noLoc);
-                // Create the jacobianMatrix[idx] expression.
-                auto* result_at_i = m_Sema
-                                        .CreateBuiltinArraySubscriptExpr(
-                                            m_Result, noLoc, idx, noLoc)
-                                        .get();
-                temp_m_Variables[m_IndependentVars[i]] = result_at_i;
+              for (unsigned i = 0, e = m_IndependentVars.size(); i < e; ++i) {
+                const ValueDecl* VD = m_IndependentVars[i];
+                unsigned col = m_IndependentVarColumns[i];
+                if (utils::isArrayOrPointerType(VD->getType()))
+                  temp_m_Variables[VD] =
+                      BuildJacobianRow(outputArrayCursor, col);
+                else
+                  temp_m_Variables[VD] =
+                      BuildJacobianElement(outputArrayCursor, col);
               }
               m_VectorOutput.push_back(temp_m_Variables);
             }
@@ -2596,6 +4334,7 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
         // initialize it with its size.
         initDiff = getArraySizeExpr(AT, m_Context, *this);
       }
+      VDDerivedType = UseAdjointType(VDDerivedType);
       VDDerived = BuildGlobalVarDecl(
           VDDerivedType, "_d_" + VD->getNameAsString(), VDDerivedInit, false,
           nullptr, VarDecl::InitializationStyle::CInit);
@@ -2665,6 +4404,7 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
         }
         VDDerivedInit = getZeroInit(VDDerivedType);
       }
+      VDDerivedType = UseAdjointType(VDDerivedType);
       VDDerived =
           BuildGlobalVarDecl(VDDerivedType, "_d_" + VD->getNameAsString(),
                              VDDerivedInit, false, nullptr, VD->getInitStyle());
@@ -3003,6 +4743,15 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
         m_Sema, getCurrentScope(), baseDiff.getExpr(), field->getName());
     if (!baseDiff.getExpr_dx())
       return {clonedME, nullptr};
+    if (const auto* ASE =
+            dyn_cast<ArraySubscriptExpr>(ME->getBase()->IgnoreParens())) {
+      const auto* DRE =
+          dyn_cast<DeclRefExpr>(ASE->getBase()->IgnoreParenImpCasts());
+      auto soaIt = DRE ? m_SoAAdjoints.find(DRE->getDecl())
+                       : m_SoAAdjoints.end();
+      if (soaIt != m_SoAAdjoints.end())
+        return VisitSoAMemberExpr(clonedME, baseDiff, soaIt->second);
+    }
     MemberExpr* derivedME = utils::BuildMemberExpr(
         m_Sema, getCurrentScope(), baseDiff.getExpr_dx(), field->getName());
     if (dfdx()) {
@@ -3013,6 +4762,34 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
     return {clonedME, derivedME, derivedME};
   }
 
+  StmtDiff ReverseModeVisitor::VisitSoAMemberExpr(
+      MemberExpr* clonedME, StmtDiff& baseDiff,
+      llvm::ArrayRef<const FieldDecl*> fields) {
+    const auto* fieldIt = llvm::find(fields, clonedME->getMemberDecl());
+    // The fields which are not floating-point values have no adjoints.
+    if (fieldIt == fields.end())
+      return {clonedME, nullptr};
+    std::size_t fieldIdx = fieldIt - fields.begin();
+    // Turns `_d_p[i]` into `_d_p[fieldIdx][i]`.
+    auto toFieldArray = [&](Expr* E) -> Expr* {
+      auto* ASE = cast<ArraySubscriptExpr>(E->IgnoreParens());
+      Expr* idx = ConstantFolder::synthesizeLiteral(m_Context.getSizeType(),
+                                                    m_Context, fieldIdx);
+      Expr* fieldArray = BuildArraySubscript(ASE->getBase(), idx);
+      Expr* elemIdx = ASE->getIdx();
+      return BuildArraySubscript(fieldArray, elemIdx);
+    };
+    Expr* derivedME = toFieldArray(baseDiff.getExpr_dx());
+    Expr* forwDerivedME = derivedME;
+    if (Expr* forwBaseDiff = baseDiff.getForwSweepExpr_dx())
+      forwDerivedME = toFieldArray(forwBaseDiff);
+    if (dfdx()) {
+      Expr* addAssign = BuildOp(BO_AddAssign, derivedME, dfdx());
+      addToCurrentBlock(addAssign, direction::reverse);
+    }
+    return {clonedME, derivedME, forwDerivedME};
+  }
+
   StmtDiff
   ReverseModeVisitor::VisitExprWithCleanups(const ExprWithCleanups* EWC) {
     StmtDiff subExprDiff = Visit(EWC->getSubExpr(), dfdx());
@@ -3059,7 +4836,16 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
       if (E->getType()->isPointerType())
         return true;
       auto found = m_ToBeRecorded.find(B->getBeginLoc());
-      return found != m_ToBeRecorded.end();
+      if (found == m_ToBeRecorded.end())
+        return false;
+      // For objects assigned field by field, only some of the fields might
+      // be required to store.
+      if (const auto* ME = dyn_cast<MemberExpr>(B)) {
+        auto fields = m_ToBeRecordedFields.find(B->getBeginLoc());
+        if (fields != m_ToBeRecordedFields.end())
+          return llvm::is_contained(fields->second, ME->getMemberDecl());
+      }
+      return true;
     }
 
     // FIXME: Attach checkpointing.
@@ -3236,6 +5022,12 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
   }
 
   StmtDiff ReverseModeVisitor::VisitWhileStmt(const WhileStmt* WS) {
+    if (enableLoopCheckpointing && !isInsideLoop) {
+      StmtDiff checkpointedDiff = DifferentiateCheckpointedLoop(WS);
+      if (checkpointedDiff.getStmt())
+        return ProfileLoop(WS, checkpointedDiff);
+    }
+
     LoopCounter loopCounter(*this);
     if (loopCounter.getPush())
       addToCurrentBlock(loopCounter.getPush());
@@ -3308,10 +5100,16 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
       addToCurrentBlock(reverseWS, direction::reverse);
       reverseBlock = endBlock(direction::reverse);
     }
-    return {forwardWS, reverseBlock};
+    return ProfileLoop(WS, {forwardWS, reverseBlock});
   }
 
   StmtDiff ReverseModeVisitor::VisitDoStmt(const DoStmt* DS) {
+    if (enableLoopCheckpointing && !isInsideLoop) {
+      StmtDiff checkpointedDiff = DifferentiateCheckpointedLoop(DS);
+      if (checkpointedDiff.getStmt())
+        return ProfileLoop(DS, checkpointedDiff);
+    }
+
     LoopCounter loopCounter(*this);
     if (loopCounter.getPush())
       addToCurrentBlock(loopCounter.getPush());
@@ -3364,7 +5162,184 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
       addToCurrentBlock(reverseDS, direction::reverse);
       reverseBlock = endBlock(direction::reverse);
     }
-    return {forwardDS, reverseBlock};
+    return ProfileLoop(DS, {forwardDS, reverseBlock});
+  }
+
+  StmtDiff ReverseModeVisitor::DifferentiateCheckpointedLoop(const Stmt* Loop) {
+    // Only the gradients and the pullbacks have a reverse sweep.
+    if (m_Mode != DiffMode::reverse &&
+        m_Mode != DiffMode::experimental_pullback)
+      return {};
+    auto unsupported = [&](llvm::StringRef reason) {
+      diag(DiagnosticsEngine::Warning, Loop->getBeginLoc(),
+           "loop checkpointing is not supported for this loop: %0", {reason});
+      return StmtDiff{};
+    };
+    if (m_ExternalSource)
+      return unsupported("error estimation is enabled");
+    // TBR analysis may not restore the values which the loop reads and which
+    // are assigned after it, so its iterations cannot be recomputed.
+    if (enableTBR)
+      return unsupported("TBR analysis is enabled");
+    if (m_Derivative->isConstexpr())
+      return unsupported("the derivative is constexpr");
+
+    const auto* WS = dyn_cast<WhileStmt>(Loop);
+    const auto* DS = dyn_cast<DoStmt>(Loop);
+    const Expr* cond = WS ? WS->getCond() : DS->getCond();
+    const Stmt* body = WS ? WS->getBody() : DS->getBody();
+    if (WS && WS->getConditionVariable())
+      return unsupported("its condition declares a variable");
+    // The condition is not evaluated when the iterations are recomputed.
+    llvm::SmallPtrSet<const FunctionDecl*, 8> visited;
+    if (cond->HasSideEffects(m_Context, /*IncludePossibleEffects=*/false) ||
+        mayWriteGlobals(cond, visited))
+      return unsupported("its condition may have side effects");
+    LoopState state;
+    std::string reason = collectLoopState(body, state);
+    if (!reason.empty())
+      return unsupported(reason);
+    if (state.Assigned.empty())
+      return unsupported("it does not assign the variables declared before it");
+    // The values of the calls to recursive functions are recorded on the
+    // stack of clad::recursion_frame, which the recomputed iterations would
+    // push to or pop from again (see BuildRecursiveCallValue).
+    llvm::SmallVector<const CallExpr*, 8> calls;
+    utils::GetCallsNotReturned(body, calls);
+    for (const CallExpr* CE : calls) {
+      const FunctionDecl* FD = CE->getDirectCallee();
+      if (!FD || !IsRecordableRecursiveFn(FD))
+        continue;
+      if (HasRecordingPass(FD) ||
+          (m_Context.hasSameUnqualifiedType(FD->getReturnType(),
+                                            m_Function->getReturnType()) &&
+           HasRecordingPass(m_Function)))
+        return unsupported(
+            ("it calls the recursive function '" + FD->getName() + "'")
+                .str());
+    }
+    llvm::SmallVector<QualType, 4> stateTypes;
+    for (const DeclRefExpr* DRE : state.Assigned) {
+      const auto* VD = cast<VarDecl>(DRE->getDecl());
+      if (!VD->getType().isTriviallyCopyableType(m_Context))
+        return unsupported(
+            ("'" + VD->getName() + "' is not trivially copyable").str());
+      // The locals are declared at function scope in the derivative.
+      for (const VarDecl* local : state.Locals)
+        if (local->getDeclName() == VD->getDeclName())
+          return unsupported(
+              ("it declares a variable shadowing '" + VD->getName() + "'")
+                  .str());
+      stateTypes.push_back(getNonConstType(VD->getType(), m_Context, m_Sema));
+    }
+
+    // The counter is a global since the loop is not nested in another one.
+    LoopCounter loopCounter(*this);
+    TemplateDecl* checkpointsDecl =
+        LookupTemplateDeclInCladNamespace("loop_checkpoints");
+    QualType checkpointsType = InstantiateTemplate(checkpointsDecl, stateTypes);
+    VarDecl* checkpoints = GlobalStoreImpl(checkpointsType, "_cp",
+                                           getZeroInit(checkpointsType));
+
+    beginScope(Scope::DeclScope | Scope::ControlScope | Scope::BreakScope |
+               Scope::ContinueScope);
+    llvm::SmallVector<Expr*, 4> vars;
+    for (const DeclRefExpr* DRE : state.Assigned)
+      vars.push_back(Clone(DRE));
+    Expr* condClone = Clone(cond);
+
+    llvm::SaveAndRestore<bool> SaveIsInsideLoop(isInsideLoop);
+    isInsideLoop = true;
+    llvm::SmallVector<VarDecl*, 8> tapes;
+    llvm::SaveAndRestore<llvm::SmallVectorImpl<VarDecl*>*> SaveLoopTapes(
+        m_LoopTapes);
+    m_LoopTapes = &tapes;
+    StmtDiff bodyDiff = DifferentiateLoopBody(body, loopCounter);
+
+    // Builds `_cp.name(iteration, vars...)`.
+    auto buildCheckpointsCall = [&](llvm::StringRef name, Expr* iteration) {
+      llvm::SmallVector<Expr*, 4> args{iteration};
+      for (Expr* var : vars)
+        args.push_back(Clone(var));
+      return BuildCallExprToMemFn(BuildDeclRef(checkpoints), name, args);
+    };
+    // Builds an iteration of the forward pass, after which its tapes are
+    // cleared unless `reversed` is true.
+    auto buildIteration = [&](Stmt* first, bool clone, bool reversed) {
+      Stmts block;
+      if (first)
+        block.push_back(first);
+      for (Stmt* S : cast<CompoundStmt>(bodyDiff.getStmt())->body())
+        block.push_back(clone ? Clone(S) : S);
+      if (!reversed)
+        for (VarDecl* tape : tapes)
+          block.push_back(
+              BuildCallExprToMemFn(BuildDeclRef(tape), "clear", {}));
+      return MakeCompoundStmt(block);
+    };
+
+    // Create the forward-pass loop, which snapshots the variables at the
+    // beginning of some iterations:
+    // while (cond) {
+    //   _cp.store(_t0, vars...);
+    //   ...
+    // }
+    Stmt* forwardBody = buildIteration(
+        buildCheckpointsCall("store", Clone(loopCounter.getRef())),
+        /*clone=*/false, /*reversed=*/false);
+    Stmt* forwardLoop = nullptr;
+    if (WS) {
+      Sema::ConditionResult condResult = m_Sema.ActOnCondition(
+          getCurrentScope(), noLoc, condClone, Sema::ConditionKind::Boolean);
+      forwardLoop =
+          clad_compat::Sema_ActOnWhileStmt(m_Sema, condResult, forwardBody)
+              .get();
+    } else {
+      forwardLoop = m_Sema
+                        .ActOnDoStmt(/*DoLoc=*/noLoc, forwardBody,
+                                     /*WhileLoc=*/noLoc,
+                                     /*CondLParen=*/noLoc, condClone,
+                                     /*CondRParen=*/noLoc)
+                        .get();
+    }
+
+    // Create the reverse-pass loop, which recomputes each iteration from the
+    // last snapshot before it:
+    // while (_t0) {
+    //   _t0 = _cp.restore(_t0 - 1, vars...);
+    //   while (_cp.replay(_t0, vars...)) {
+    //     ...
+    //   }
+    //   ...
+    //   <reverse pass of the iteration>
+    // }
+    Expr* one = ConstantFolder::synthesizeLiteral(m_Context.getSizeType(),
+                                                  m_Context, /*val=*/1);
+    Expr* restore = buildCheckpointsCall(
+        "restore", BuildOp(BO_Sub, Clone(loopCounter.getRef()), one));
+    Stmts reverseBody;
+    reverseBody.push_back(
+        BuildOp(BO_Assign, Clone(loopCounter.getRef()), restore));
+    Sema::ConditionResult replayCond = m_Sema.ActOnCondition(
+        getCurrentScope(), noLoc,
+        buildCheckpointsCall("replay", Clone(loopCounter.getRef())),
+        Sema::ConditionKind::Boolean);
+    reverseBody.push_back(
+        clad_compat::Sema_ActOnWhileStmt(
+            m_Sema, replayCond,
+            buildIteration(/*first=*/nullptr, /*clone=*/true,
+                           /*reversed=*/false))
+            .get());
+    reverseBody.push_back(
+        buildIteration(/*first=*/nullptr, /*clone=*/true, /*reversed=*/true));
+    reverseBody.push_back(bodyDiff.getStmt_dx());
+    Stmt* reverseLoop =
+        clad_compat::Sema_ActOnWhileStmt(
+            m_Sema, loopCounter.getCounterConditionResult(),
+            MakeCompoundStmt(reverseBody))
+            .get();
+    endScope();
+    return {forwardLoop, reverseLoop};
   }
 
   // Basic idea used for differentiating switch statement is that in the reverse
@@ -3811,9 +5786,13 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
       // we should initialize it implicitly using ParenListExpr.
       diffInit = m_Sema.ActOnParenListExpr(noLoc, noLoc, {}).get();
     }
-    Expr* derivedNewE = utils::BuildCXXNewExpr(
-        m_Sema, CNE->getAllocatedType(), derivedArraySizeE, diffInit,
-        CNE->getAllocatedTypeSourceInfo());
+    QualType derivedAllocatedType = UseAdjointType(CNE->getAllocatedType());
+    TypeSourceInfo* derivedTSI = nullptr;
+    if (derivedAllocatedType == CNE->getAllocatedType())
+      derivedTSI = CNE->getAllocatedTypeSourceInfo();
+    Expr* derivedNewE =
+        utils::BuildCXXNewExpr(m_Sema, derivedAllocatedType, derivedArraySizeE,
+                               diffInit, derivedTSI);
     return {clonedNewE, derivedNewE};
   }
 
@@ -3918,9 +5897,65 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
   clang::QualType ReverseModeVisitor::ComputeParamType(clang::QualType T) {
       QualType TValueType = utils::GetValueType(T);
       TValueType.removeLocalConst();
+      // The adjoints of the parameters of a pullback which are passed by value
+      // are the `_r` results of its callers, which have the type of the
+      // argument, so that the callers can pass them to custom pullbacks too.
+      if (m_Mode != DiffMode::experimental_pullback || T->isReferenceType() ||
+          utils::isArrayOrPointerType(T))
+        TValueType = UseAdjointType(TValueType);
       return m_Context.getPointerType(TValueType);
   }
 
+  clang::QualType ReverseModeVisitor::UseAdjointType(clang::QualType T) {
+    if (m_AdjointType.isNull() || T.isNull())
+      return T;
+    Qualifiers quals = T.getLocalQualifiers();
+    if (T->isRealFloatingType())
+      return m_Context.getQualifiedType(m_AdjointType, quals);
+    QualType inner;
+    QualType adjointInner;
+    QualType result;
+    if (const auto* PT = T->getAs<PointerType>()) {
+      inner = PT->getPointeeType();
+      adjointInner = UseAdjointType(inner);
+      result = m_Context.getPointerType(adjointInner);
+    } else if (const auto* RT = T->getAs<LValueReferenceType>()) {
+      inner = RT->getPointeeType();
+      adjointInner = UseAdjointType(inner);
+      result = m_Context.getLValueReferenceType(adjointInner);
+    } else if (const auto* CAT = m_Context.getAsConstantArrayType(T)) {
+      inner = CAT->getElementType();
+      adjointInner = UseAdjointType(inner);
+      result = clad_compat::getConstantArrayType(
+          m_Context, adjointInner, CAT->getSize(), CAT->getSizeExpr(),
+          CAT->getSizeModifier(), CAT->getIndexTypeCVRQualifiers());
+    } else if (const auto* IAT = m_Context.getAsIncompleteArrayType(T)) {
+      inner = IAT->getElementType();
+      adjointInner = UseAdjointType(inner);
+      result = m_Context.getIncompleteArrayType(
+          adjointInner, IAT->getSizeModifier(),
+          IAT->getIndexTypeCVRQualifiers());
+    } else if (const auto* VAT = m_Context.getAsVariableArrayType(T)) {
+      inner = VAT->getElementType();
+      adjointInner = UseAdjointType(inner);
+      result = m_Context.getVariableArrayType(
+          adjointInner, VAT->getSizeExpr(), VAT->getSizeModifier(),
+          VAT->getIndexTypeCVRQualifiers(), SourceRange());
+    }
+    // Keep the spelling of the types which are not changed, e.g. `size_t*`.
+    if (inner == adjointInner)
+      return T;
+    if (result->isArrayType())
+      return result;
+    return m_Context.getQualifiedType(result, quals);
+  }
+
+  std::string ReverseModeVisitor::AdjointTypeSuffix() const {
+    if (m_AdjointType.isNull())
+      return "";
+    return "_adj_" + m_AdjointType.getAsString();
+  }
+
   llvm::SmallVector<clang::QualType, 8>
   ReverseModeVisitor::ComputeParamTypes(const DiffParams& diffParams) {
     llvm::SmallVector<clang::QualType, 8> paramTypes;
@@ -3960,14 +5995,26 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
       for (auto* PVD : m_Function->parameters()) {
         const auto* it =
             std::find(std::begin(diffParams), std::end(diffParams), PVD);
-        if (it != std::end(diffParams))
-          paramTypes.push_back(ComputeParamType(PVD->getType()));
+        if (it == std::end(diffParams))
+          continue;
+        auto soaIt = m_SoAAdjoints.find(PVD);
+        if (soaIt != m_SoAAdjoints.end()) {
+          // One array per field, e.g. `double**`.
+          QualType fieldType =
+              soaIt->second.front()->getType().getUnqualifiedType();
+          paramTypes.push_back(m_Context.getPointerType(
+              m_Context.getPointerType(fieldType)));
+          continue;
+        }
+        paramTypes.push_back(ComputeParamType(PVD->getType()));
       }
     } else if (m_Mode == DiffMode::jacobian) {
       std::size_t lastArgIdx = m_Function->getNumParams() - 1;
       QualType derivativeParamType =
           m_Function->getParamDecl(lastArgIdx)->getType();
       paramTypes.push_back(derivativeParamType);
+      if (stridedOutput)
+        paramTypes.push_back(m_Context.getSizeType());
     }
     return paramTypes;
   }
@@ -4079,6 +6126,14 @@ Expr* getArraySizeExpr(const ArrayType* AT, ASTContext& context,
       if (dPVD->getIdentifier())
         m_Sema.PushOnScopeChains(dPVD, getCurrentScope(),
                                  /*AddToContext=*/false);
+      if (stridedOutput) {
+        m_LeadingDim = utils::BuildParmVarDecl(
+            m_Sema, m_Derivative, CreateUniqueIdentifier("ld"),
+            derivativeFnType->getParamType(dParamTypesIdx + 1));
+        paramDerivatives.push_back(m_LeadingDim);
+        m_Sema.PushOnScopeChains(m_LeadingDim, getCurrentScope(),
+                                 /*AddToContext=*/false);
+      }
     }
     params.insert(params.end(), paramDerivatives.begin(),
                   paramDerivatives.end());
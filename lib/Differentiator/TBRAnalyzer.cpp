@@ -1,5 +1,6 @@
 #include "TBRAnalyzer.h"
 
+#include "llvm/ADT/STLExtras.h"
 #include "llvm/Support/Debug.h"
 #undef DEBUG_TYPE
 #define DEBUG_TYPE "clad-tbr"
@@ -297,17 +298,58 @@ void TBRAnalyzer::addVar(const clang::VarDecl* VD, bool forceNonRefType) {
 void TBRAnalyzer::markLocation(const clang::Expr* E) {
   VarData* data = getExprVarData(E);
   if (!data || findReq(*data)) {
-    // FIXME: If any of the data's child nodes are required to store then data
-    // itself is stored. We might add an option to store separate fields.
     // FIXME: Sometimes one location might correspond to multiple stores.  For
     // example, in ``(x*=y)=u`` x's location will first be marked as required to
     // be stored (when passing *= operator) but then marked as not required to
     // be stored (when passing = operator). Current method of marking locations
     // does not allow to differentiate between these two.
-    m_TBRLocs.insert(E->getBeginLoc());
+    bool firstMark = m_TBRLocs.insert(E->getBeginLoc()).second;
+    markFields(E, data, firstMark);
   }
 }
 
+void TBRAnalyzer::markFields(const clang::Expr* E, const VarData* data,
+                             bool firstMark) {
+  SourceLocation loc = E->getBeginLoc();
+  auto it = m_TBRFields.find(loc);
+  // The whole object is already required at this location.
+  if (!firstMark && it == m_TBRFields.end())
+    return;
+
+  // Only objects that are assigned field by field can be stored field by
+  // field.
+  const RecordDecl* RD = nullptr;
+  if (data && data->m_Type == VarData::OBJ_TYPE)
+    if (const auto* RT = E->getType()->getAs<RecordType>())
+      RD = RT->getDecl();
+  if (!utils::IsFieldwiseAssignable(RD)) {
+    if (it != m_TBRFields.end())
+      m_TBRFields.erase(it);
+    return;
+  }
+
+  llvm::SmallVector<const FieldDecl*, 4>& fields = m_TBRFields[loc];
+  unsigned numFields = 0;
+  for (const FieldDecl* FD : RD->fields()) {
+    ++numFields;
+    // NOLINTNEXTLINE(cppcoreguidelines-pro-type-union-access)
+    auto fieldIt = data->m_Val.m_ArrData->find(getProfileID(FD));
+    if (fieldIt == data->m_Val.m_ArrData->end() || !findReq(fieldIt->second))
+      continue;
+    if (!llvm::is_contained(fields, FD))
+      fields.push_back(FD);
+  }
+  // All the fields are required.
+  if (fields.size() == numFields) {
+    m_TBRFields.erase(loc);
+    return;
+  }
+  llvm::sort(fields.begin(), fields.end(),
+             [](const FieldDecl* LHS, const FieldDecl* RHS) {
+               return LHS->getFieldIndex() < RHS->getFieldIndex();
+             });
+}
+
 void TBRAnalyzer::setIsRequired(const clang::Expr* E, bool isReq) {
   if (!isReq ||
       (m_ModeStack.back() == (Mode::kMarkingMode | Mode::kNonLinearMode))) {
@@ -750,6 +792,23 @@ bool TBRAnalyzer::VisitUnaryOperator(clang::UnaryOperator* UnOp) {
 }
 
 bool TBRAnalyzer::VisitCallExpr(clang::CallExpr* CE) {
+  // Trivial assignments of objects are differentiated field by field (see
+  // ReverseModeVisitor::VisitCallExpr), so they are analysed like
+  // assignments. This allows storing only the required fields.
+  if (utils::IsFieldwiseAssignment(CE)) {
+    Expr* L = CE->getArg(0);
+    Expr* R = CE->getArg(1);
+    TraverseStmt(L);
+
+    startMarkingMode();
+    TraverseStmt(R);
+    resetMode();
+
+    const Expr* B = L->IgnoreParenImpCasts();
+    markLocation(B);
+    setIsRequired(B, /*isReq=*/false);
+    return true;
+  }
   // FIXME: Currently TBR analysis just stops here and assumes that all the
   // variables passed by value/reference are used/used and changed. Analysis
   // could proceed to the function to analyse data flow inside it.
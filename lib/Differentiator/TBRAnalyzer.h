@@ -225,6 +225,11 @@ class TBRAnalyzer : public clang::RecursiveASTVisitor<TBRAnalyzer> {
   /// Tells if the variable at a given location is required to store. Basically,
   /// is the result of analysis.
   std::set<clang::SourceLocation> m_TBRLocs;
+  /// For the locations in m_TBRLocs referring to objects of which only some
+  /// fields are required to store, the list of those fields. Locations that
+  /// are not present here require the whole object to be stored.
+  std::map<clang::SourceLocation, llvm::SmallVector<const clang::FieldDecl*, 4>>
+      m_TBRFields;
 
   /// Stores modes in a stack (used to retrieve the old mode after entering
   /// a new one).
@@ -262,6 +267,10 @@ class TBRAnalyzer : public clang::RecursiveASTVisitor<TBRAnalyzer> {
   /// Marks the SourceLocation of E if it is required to store.
   /// E could be DeclRefExpr*, ArraySubscriptExpr* or MemberExpr*.
   void markLocation(const clang::Expr* E);
+  /// Records the fields of the object E that are required to store, so that
+  /// the object can be stored field by field. `firstMark` tells if E's
+  /// location has just been added to m_TBRLocs.
+  void markFields(const clang::Expr* E, const VarData* data, bool firstMark);
   /// Sets E's corresponding VarData (or all its child nodes) to
   /// required/not required. For isReq==true, checks if the current mode is
   /// markingMode and nonLinearMode. E could be DeclRefExpr*,
@@ -302,6 +311,12 @@ public:
 
   /// Returns the result of the whole analysis
   std::set<clang::SourceLocation> getResult() { return m_TBRLocs; }
+  /// Returns the required fields of the objects which do not have to be
+  /// stored as a whole.
+  std::map<clang::SourceLocation, llvm::SmallVector<const clang::FieldDecl*, 4>>
+  getFieldsResult() {
+    return m_TBRFields;
+  }
 
   /// Visitors
   void Analyze(const clang::FunctionDecl* FD);
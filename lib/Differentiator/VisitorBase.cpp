@@ -526,6 +526,17 @@ namespace clad {
     return InstantiateTemplate(GetCladTapeDecl(), {T});
   }
 
+  TemplateDecl* VisitorBase::GetCladStaticTapeDecl() {
+    static TemplateDecl* Result = nullptr;
+    if (!Result)
+      Result = LookupTemplateDeclInCladNamespace(/*ClassName=*/"static_tape");
+    return Result;
+  }
+
+  QualType VisitorBase::GetCladStaticTapeOfType(QualType T) {
+    return InstantiateTemplate(GetCladStaticTapeDecl(), {T});
+  }
+
   Expr* VisitorBase::BuildCallExprToMemFn(Expr* Base,
                                           StringRef MemberFunctionName,
                                           MutableArrayRef<Expr*> ArgExprs,
@@ -650,6 +661,68 @@ namespace clad {
     return BuildCallExprToFunction(FD, argExprs, false, &CSS);
   }
 
+  std::string VisitorBase::GetProfilingSite(llvm::StringRef what) {
+    std::string site = m_Derivative->getNameAsString();
+    if (!what.empty())
+      site += (":" + what).str();
+    return site;
+  }
+
+  std::string VisitorBase::GetLoopProfilingSite(const Stmt* Loop) {
+    unsigned line =
+        m_Sema.getSourceManager().getPresumedLineNumber(Loop->getBeginLoc());
+    return "loop@" + std::to_string(line);
+  }
+
+  Expr* VisitorBase::BuildProfilingProbe(bool begin, llvm::StringRef what,
+                                         Expr* value) {
+    NamespaceDecl* CladNS = GetCladNamespace();
+    CXXScopeSpec CSS;
+    CSS.Extend(m_Context, CladNS, noLoc, noLoc);
+    llvm::StringRef name = begin ? "prof_begin" : "prof_end";
+    LookupResult R(m_Sema, &m_Context.Idents.get(name), noLoc,
+                   Sema::LookupOrdinaryName);
+    m_Sema.LookupQualifiedName(R, CladNS, CSS);
+    Expr* fn = m_Sema.BuildDeclarationNameExpr(CSS, R, /*ADL=*/false).get();
+    llvm::SmallVector<Expr*, 2> args{
+        utils::CreateStringLiteral(m_Context, GetProfilingSite(what))};
+    if (value)
+      args.push_back(value);
+    return m_Sema.ActOnCallExpr(getCurrentScope(), fn, noLoc, args, noLoc)
+        .get();
+  }
+
+  Stmt* VisitorBase::BuildProfiledStmt(Stmt* S, llvm::StringRef what) {
+    Stmts block{BuildProfilingProbe(/*begin=*/true, what), S,
+                BuildProfilingProbe(/*begin=*/false, what)};
+    return MakeCompoundStmt(block);
+  }
+
+  Expr* VisitorBase::BuildProfiledExpr(Expr* E, llvm::StringRef what) {
+    Expr* begin = BuildProfilingProbe(/*begin=*/true, what);
+    if (E->getType()->isVoidType())
+      return BuildParens(BuildOp(
+          BO_Comma, BuildOp(BO_Comma, begin, E),
+          BuildProfilingProbe(/*begin=*/false, what)));
+    return BuildParens(BuildOp(BO_Comma, begin,
+                               BuildProfilingProbe(/*begin=*/false, what, E)));
+  }
+
+  Stmt* VisitorBase::BuildProfilingScope(llvm::StringRef what) {
+    NamespaceDecl* CladNS = GetCladNamespace();
+    CXXScopeSpec CSS;
+    CSS.Extend(m_Context, CladNS, noLoc, noLoc);
+    LookupResult R(m_Sema, &m_Context.Idents.get("prof_scope"), noLoc,
+                   Sema::LookupOrdinaryName);
+    m_Sema.LookupQualifiedName(R, CladNS, CSS);
+    assert(!R.empty() && "cannot find clad::prof_scope");
+    QualType T = m_Context.getTypeDeclType(R.getAsSingle<TypeDecl>());
+    Expr* site = utils::CreateStringLiteral(m_Context, GetProfilingSite(what));
+    VarDecl* VD = BuildVarDecl(T, "_prof", site, /*DirectInit=*/true,
+                               /*TSI=*/nullptr, VarDecl::CallInit);
+    return BuildDeclStmt(VD);
+  }
+
   TemplateDecl* VisitorBase::GetCladArrayRefDecl() {
     static TemplateDecl* Result = nullptr;
     if (!Result)
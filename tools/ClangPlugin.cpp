@@ -88,6 +88,9 @@ namespace clad {
       CodeGenOptions& CGOpts = CI.getCodeGenOpts();
       CGOpts.PassPlugins.push_back(CladSoPath.str());
 #endif // CLANG_VERSION_MAJOR > 8
+      if (!m_DO.DerivativeLibraryDir.empty())
+        m_DerivativeLibrary.reset(
+            new DerivativeLibrary(CI, m_DO.DerivativeLibraryDir));
     }
 
     CladPlugin::~CladPlugin() {}
@@ -243,6 +246,9 @@ namespace clad {
             f.flush();
           }
 
+          if (m_DerivativeLibrary)
+            m_DerivativeLibrary->Add(DerivativeDecl);
+
           S.MarkFunctionReferenced(SourceLocation(), DerivativeDecl);
           if (OverloadedDerivativeDecl)
             S.MarkFunctionReferenced(SourceLocation(),
@@ -373,6 +379,15 @@ namespace clad {
       SemaR.LookupQualifiedName(R, C.getTranslationUnitDecl(),
                                 /*allowBuiltinCreation*/ false);
       m_HasRuntime = !R.empty();
+      // The runtime was loaded from a precompiled header or a module, whose
+      // `#pragma clad ON` is not seen by the preprocessor. Enable clad from
+      // the beginning of the main file as if the header was included there.
+      if (m_HasRuntime && CladEnabledRange.empty() &&
+          R.getFoundDecl()->getCanonicalDecl()->isFromASTFile()) {
+        SourceManager& SM = m_CI.getSourceManager();
+        SourceLocation Begin = SM.getLocForStartOfFile(SM.getMainFileID());
+        CladEnabledRange.push_back(SourceRange(Begin, SourceLocation()));
+      }
       return m_HasRuntime;
     }
 
@@ -387,6 +402,31 @@ namespace clad {
 
     void CladPlugin::SetRequestOptions(RequestOptions& opts) const {
       SetTBRAnalysisOptions(m_DO, opts);
+      opts.EnableLifetimeAnalysis = m_DO.EnableLifetimeAnalysis;
+      opts.EnableStencilGather = m_DO.EnableStencilGather;
+      opts.EnableTapeCheckpoint = m_DO.EnableTapeCheckpoint;
+      opts.EnableLoopCheckpointing = m_DO.EnableLoopCheckpointing;
+      opts.EnableSweepProfiling = m_DO.EnableSweepProfiling;
+      opts.EnableSoAAdjoints = m_DO.EnableSoAAdjoints;
+    }
+
+    /// Returns true if the code of FD may be emitted in this translation unit.
+    /// Inline functions, template instantiations and functions with internal
+    /// linkage are only emitted if they are referenced.
+    static bool MayBeEmitted(const FunctionDecl* FD) {
+      if (!FD)
+        return true;
+      GVALinkage L = FD->getASTContext().GetGVALinkageForFunction(FD);
+      if (L == GVA_StrongExternal || L == GVA_StrongODR)
+        return true;
+      return FD->isUsed();
+    }
+
+    /// Returns true if the derivative of the request can be produced as a
+    /// declaration only, without an overload to update the call with.
+    static bool CanDeriveDeclarationOnly(const DiffRequest& request) {
+      return request.Mode == DiffMode::forward &&
+             request.RequestedDerivativeOrder == 1 && !request.use_enzyme;
     }
 
     void CladPlugin::HandleTranslationUnit(ASTContext& C) {
@@ -397,12 +437,40 @@ namespace clad {
       Sema::GlobalEagerInstantiationScope GlobalInstantiations(S, Enabled);
       Sema::LocalEagerInstantiationScope LocalInstantiations(S);
 
+      // The requests made from functions which are not referenced so far. With
+      // lazy derivation, they are only processed once their caller is.
+      DiffSchedule unreferenced;
+      auto isUnreferenced = [](const DiffRequest& R) {
+        return !MayBeEmitted(R.EnclosingFunction);
+      };
       // Use index based loop to avoid iterator invalidation as
       // ProcessDiffRequest might add more requests to m_DiffSchedule.
       for (size_t i = 0; i < m_DiffSchedule.size(); ++i) {
         // make a copy of the request to avoid invalidating the reference
         // when ProcessDiffRequest adds more requests to m_DiffSchedule.
         DiffRequest request = m_DiffSchedule[i];
+        if (m_DO.EnableLazyDerivation && isUnreferenced(request)) {
+          unreferenced.push_back(request);
+        } else {
+          ProcessDiffRequest(request);
+        }
+        if (i + 1 < m_DiffSchedule.size())
+          continue;
+        // The derivatives produced so far may reference the callers of the
+        // deferred requests.
+        auto* referenced = std::stable_partition(
+            unreferenced.begin(), unreferenced.end(), isUnreferenced);
+        m_DiffSchedule.append(referenced, unreferenced.end());
+        unreferenced.erase(referenced, unreferenced.end());
+      }
+      // The remaining requests are never emitted. A declaration is enough to
+      // update their calls, or the calls are left untouched.
+      for (DiffRequest& request : unreferenced) {
+        if (!CanDeriveDeclarationOnly(request))
+          continue;
+        // Reuse the definition if an equivalent request produced one.
+        if (!m_DFC.Find(request).IsValid())
+          request.DeclarationOnly = true;
         ProcessDiffRequest(request);
       }
       // Put the TUScope in a consistent state after clad is done.
@@ -411,6 +479,9 @@ namespace clad {
       LocalInstantiations.perform();
       GlobalInstantiations.perform();
 
+      if (m_DerivativeLibrary)
+        m_DerivativeLibrary->Write();
+
       SendToMultiplexer();
       m_Multiplexer->HandleTranslationUnit(C);
     }
@@ -473,6 +544,9 @@ namespace clad {
         llvm::errs() << "\n";
       }
 
+      if (m_DerivativeBuilder)
+        m_DerivativeBuilder->PrintStats(llvm::errs());
+
       m_Multiplexer->PrintStats();
     }
 
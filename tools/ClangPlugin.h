@@ -13,6 +13,8 @@
 #include "clad/Differentiator/DiffPlanner.h"
 #include "clad/Differentiator/Version.h"
 
+#include "DerivativeLibrary.h"
+
 #include "clang/AST/Decl.h"
 #include "clang/AST/RecursiveASTVisitor.h"
 #include "clang/Basic/Version.h"
@@ -54,8 +56,11 @@ public:
         : DumpSourceFn(false), DumpSourceFnAST(false), DumpDerivedFn(false),
           DumpDerivedAST(false), GenerateSourceFile(false),
           ValidateClangVersion(true), EnableTBRAnalysis(false),
-          DisableTBRAnalysis(false), CustomEstimationModel(false),
-          PrintNumDiffErrorInfo(false) {}
+          DisableTBRAnalysis(false), EnableLifetimeAnalysis(false),
+          EnableStencilGather(false), EnableTapeCheckpoint(false),
+          EnableLoopCheckpointing(false), EnableLazyDerivation(false),
+          EnableSweepProfiling(false), EnableSoAAdjoints(false),
+          CustomEstimationModel(false), PrintNumDiffErrorInfo(false) {}
 
     bool DumpSourceFn : 1;
     bool DumpSourceFnAST : 1;
@@ -65,9 +70,18 @@ public:
     bool ValidateClangVersion : 1;
     bool EnableTBRAnalysis : 1;
     bool DisableTBRAnalysis : 1;
+    bool EnableLifetimeAnalysis : 1;
+    bool EnableStencilGather : 1;
+    bool EnableTapeCheckpoint : 1;
+    bool EnableLoopCheckpointing : 1;
+    bool EnableLazyDerivation : 1;
+    bool EnableSweepProfiling : 1;
+    bool EnableSoAAdjoints : 1;
     bool CustomEstimationModel : 1;
     bool PrintNumDiffErrorInfo : 1;
     std::string CustomModelName;
+    /// The directory where the derivative library is written, if any.
+    std::string DerivativeLibraryDir;
     };
 
     class CladExternalSource : public clang::ExternalSemaSource {
@@ -103,6 +117,8 @@ public:
     CladTimerGroup m_CTG;
     DerivedFnCollector m_DFC;
     DiffSchedule m_DiffSchedule;
+    /// The library the derivatives are written to, if requested.
+    std::unique_ptr<DerivativeLibrary> m_DerivativeLibrary;
     enum class CallKind {
       HandleCXXStaticMemberVarInstantiation,
       HandleTopLevelDecl,
@@ -302,6 +318,20 @@ public:
             m_DO.EnableTBRAnalysis = true;
           } else if (args[i] == "-disable-tbr") {
             m_DO.DisableTBRAnalysis = true;
+          } else if (args[i] == "-enable-lifetime-analysis") {
+            m_DO.EnableLifetimeAnalysis = true;
+          } else if (args[i] == "-enable-stencil-gather") {
+            m_DO.EnableStencilGather = true;
+          } else if (args[i] == "-enable-tape-checkpoint") {
+            m_DO.EnableTapeCheckpoint = true;
+          } else if (args[i] == "-enable-loop-checkpointing") {
+            m_DO.EnableLoopCheckpointing = true;
+          } else if (args[i] == "-enable-lazy-derivation") {
+            m_DO.EnableLazyDerivation = true;
+          } else if (args[i] == "-enable-sweep-profiling") {
+            m_DO.EnableSweepProfiling = true;
+          } else if (args[i] == "-enable-soa-adjoints") {
+            m_DO.EnableSoAAdjoints = true;
           } else if (args[i] == "-fcustom-estimation-model") {
             m_DO.CustomEstimationModel = true;
             if (++i == e) {
@@ -309,6 +339,12 @@ public:
               return false;
             }
             m_DO.CustomModelName = args[i];
+          } else if (args[i] == "-fgenerate-derivative-library") {
+            if (++i == e) {
+              llvm::errs() << "No output directory was specified.";
+              return false;
+            }
+            m_DO.DerivativeLibraryDir = args[i];
           } else if (args[i] == "-fprint-num-diff-errors") {
             m_DO.PrintNumDiffErrorInfo = true;
           } else if (args[i] == "-help") {
@@ -334,6 +370,32 @@ public:
                 << "-disable-tbr - Ensures that TBR analysis is disabled "
                    "during reverse-mode differentiation unless explicitly "
                    "specified in an individual request.\n"
+                << "-enable-lifetime-analysis - Moves the variables declared "
+                   "by reverse-mode derivatives into the narrowest scope "
+                   "they are used in and removes the unused ones.\n"
+                << "-enable-stencil-gather - Builds the adjoints of stencil "
+                   "loops in reverse-mode derivatives in gather form.\n"
+                << "-enable-tape-checkpoint - Allows capturing the tape state "
+                   "of gradients after their forward sweep and resuming their "
+                   "reverse sweep from it (see clad/Differentiator/"
+                   "TapeState.h).\n"
+                << "-enable-loop-checkpointing - Recomputes the iterations "
+                   "of the while and do loops of reverse-mode derivatives "
+                   "from a fixed number of snapshots instead of taping all "
+                   "of them (see clad/Differentiator/Checkpointing.h).\n"
+                << "-enable-lazy-derivation - Derives only the declarations "
+                   "of the derivatives requested from functions which are "
+                   "never referenced.\n"
+                << "-enable-sweep-profiling - Emits timing probes around the "
+                   "sweeps, the loops and the nested derivative calls of the "
+                   "derivatives (see clad/Differentiator/Profiling.h).\n"
+                << "-enable-soa-adjoints - Lays out the adjoints of the arrays "
+                   "of structs passed to gradients as one array per "
+                   "floating-point field (see clad/Differentiator/"
+                   "SoAAdjoints.h).\n"
+                << "-fgenerate-derivative-library <dir> - Writes the "
+                   "derivatives of each translation unit into a header in "
+                   "<dir>, which can be compiled without clad.\n"
                 << "-fcustom-estimation-model - allows user to send in a "
                    "shared object to use as the custom estimation model.\n"
                 << "-fprint-num-diff-errors - allows users to print the "
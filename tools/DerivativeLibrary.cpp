@@ -0,0 +1,336 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#include "DerivativeLibrary.h"
+
+#include "clang/AST/ASTContext.h"
+#include "clang/AST/Decl.h"
+#include "clang/AST/DeclCXX.h"
+#include "clang/AST/GlobalDecl.h"
+#include "clang/AST/Mangle.h"
+#include "clang/AST/PrettyPrinter.h"
+#include "clang/AST/RecursiveASTVisitor.h"
+#include "clang/Basic/SourceManager.h"
+#include "clang/Frontend/CompilerInstance.h"
+
+#include "llvm/ADT/SetVector.h"
+#include "llvm/ADT/SmallString.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Format.h"
+#include "llvm/Support/Path.h"
+#include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/xxhash.h"
+
+#include <cctype>
+#include <memory>
+
+using namespace clang;
+
+namespace clad {
+namespace plugin {
+namespace {
+bool IsInMainFile(const SourceManager& SM, const Decl* D) {
+  return SM.isInMainFile(SM.getExpansionLoc(D->getLocation()));
+}
+
+/// Collects the declarations of the main file a derivative depends on. These
+/// are not visible through the include directives of the main file.
+class MainFileDepsCollector
+    : public RecursiveASTVisitor<MainFileDepsCollector> {
+  const SourceManager& m_SM;
+  const llvm::SmallPtrSetImpl<const FunctionDecl*>& m_Derivatives;
+
+public:
+  /// Functions which can be redeclared in the library.
+  llvm::SetVector<const FunctionDecl*> Functions;
+  /// Declarations which cannot be made visible to the library.
+  llvm::SetVector<const NamedDecl*> Unsupported;
+
+  MainFileDepsCollector(const SourceManager& SM,
+                        const llvm::SmallPtrSetImpl<const FunctionDecl*>& D)
+      : m_SM(SM), m_Derivatives(D) {}
+
+  void CheckType(QualType T) {
+    const Type* Ty = T.getCanonicalType().getTypePtr();
+    while (true) {
+      if (Ty->isPointerType() || Ty->isReferenceType())
+        Ty = Ty->getPointeeType().getTypePtr();
+      else if (Ty->isArrayType())
+        Ty = Ty->getArrayElementTypeNoTypeQual();
+      else
+        break;
+    }
+    if (const TagDecl* TD = Ty->getAsTagDecl())
+      if (IsInMainFile(m_SM, TD))
+        Unsupported.insert(TD);
+  }
+
+  bool VisitDeclaratorDecl(DeclaratorDecl* D) {
+    CheckType(D->getType());
+    return true;
+  }
+
+  bool VisitExpr(Expr* E) {
+    CheckType(E->getType());
+    return true;
+  }
+
+  bool VisitDeclRefExpr(DeclRefExpr* DRE) {
+    const ValueDecl* VD = DRE->getDecl();
+    if (!IsInMainFile(m_SM, VD))
+      return true;
+    if (const auto* FD = dyn_cast<FunctionDecl>(VD)) {
+      if (m_Derivatives.count(FD->getCanonicalDecl()))
+        return true;
+      if (isa<CXXMethodDecl>(FD) || !FD->isExternallyVisible())
+        Unsupported.insert(FD);
+      else
+        Functions.insert(FD->getCanonicalDecl());
+    } else if (const auto* V = dyn_cast<VarDecl>(VD)) {
+      // Locals and parameters belong to the derivative itself.
+      if (V->hasGlobalStorage() && !V->isStaticLocal())
+        Unsupported.insert(V);
+    }
+    return true;
+  }
+};
+
+/// Returns the names of the namespaces enclosing D, outermost first, or
+/// false if D cannot be declared outside of its context.
+bool GetEnclosingNamespaces(const Decl* D,
+                            llvm::SmallVectorImpl<llvm::StringRef>& names) {
+  for (const DeclContext* DC = D->getDeclContext(); !DC->isTranslationUnit();
+       DC = DC->getParent()) {
+    if (isa<LinkageSpecDecl>(DC))
+      continue;
+    const auto* ND = dyn_cast<NamespaceDecl>(DC);
+    if (!ND || ND->isAnonymousNamespace())
+      return false;
+    names.insert(names.begin(), ND->getName());
+  }
+  return true;
+}
+
+/// Prints FD in its namespaces. With `asInline`, FD is declared inline, so
+/// that its definition can appear in several translation units.
+void PrintInNamespaces(llvm::raw_ostream& OS, const FunctionDecl* FD,
+                       const PrintingPolicy& Policy, bool declarationOnly,
+                       bool asInline = false) {
+  llvm::SmallVector<llvm::StringRef, 4> namespaces;
+  GetEnclosingNamespaces(FD, namespaces);
+  for (llvm::StringRef name : namespaces)
+    OS << "namespace " << name << " {\n";
+  if (asInline && !FD->isInlineSpecified())
+    OS << "inline ";
+  FD->print(OS, Policy);
+  OS << (declarationOnly ? ";\n" : "\n");
+  for (size_t i = 0; i < namespaces.size(); ++i)
+    OS << "}\n";
+}
+
+/// Returns `text` with the characters which cannot appear in an identifier
+/// replaced by underscores.
+std::string ToIdentifier(llvm::StringRef text) {
+  std::string identifier;
+  for (char c : text)
+    identifier += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+  return identifier;
+}
+
+/// Returns the macro guarding the definition of FD. It is derived from the
+/// mangled name, so that the libraries of different translation units which
+/// are included together define each derivative once.
+std::string GetDefinitionGuard(MangleContext& MC, const FunctionDecl* FD) {
+  std::string mangled;
+  llvm::raw_string_ostream OS(mangled);
+  if (MC.shouldMangleDeclName(FD))
+    MC.mangleName(GlobalDecl(FD), OS);
+  else
+    OS << FD->getName();
+  OS.flush();
+  return "CLAD_DERIVATIVE_" + ToIdentifier(mangled);
+}
+
+/// Returns the include directive `line` of the main file, with the path of a
+/// quoted header which is found relative to the directory `mainDir` of the
+/// main file made absolute. The library is written to another directory, from
+/// which the spelled path would not find the header.
+std::string ResolveInclude(llvm::StringRef line, llvm::StringRef mainDir) {
+  size_t begin = line.find('"');
+  size_t end = line.find('"', begin + 1);
+  if (begin == llvm::StringRef::npos || end == llvm::StringRef::npos)
+    return line.str();
+  llvm::StringRef spelled = line.slice(begin + 1, end);
+  if (llvm::sys::path::is_absolute(spelled))
+    return line.str();
+  llvm::SmallString<128> path(mainDir);
+  llvm::sys::path::append(path, spelled);
+  if (!llvm::sys::fs::exists(path) || llvm::sys::fs::make_absolute(path))
+    return line.str();
+  llvm::sys::path::remove_dots(path, /*remove_dot_dot=*/true);
+  return (line.take_front(begin + 1) + path + line.drop_front(end)).str();
+}
+
+/// Replaces `path` with a file containing `contents`. The file is written
+/// under a unique name first, so that readers never see a partial file.
+bool WriteAtomically(llvm::StringRef path, llvm::StringRef contents) {
+  llvm::SmallString<128> tmpPath;
+  int FD = -1;
+  if (llvm::sys::fs::createUniqueFile(path + "-%%%%%%%%.tmp", FD, tmpPath))
+    return false;
+  {
+    llvm::raw_fd_ostream OS(FD, /*shouldClose=*/true);
+    OS << contents;
+    OS.close();
+    if (OS.has_error()) {
+      OS.clear_error();
+      llvm::sys::fs::remove(tmpPath);
+      return false;
+    }
+  }
+  if (llvm::sys::fs::rename(tmpPath, path)) {
+    llvm::sys::fs::remove(tmpPath);
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+void DerivativeLibrary::Add(const FunctionDecl* FD) {
+  if (!FD->doesThisDeclarationHaveABody())
+    return;
+  if (!m_Seen.insert(FD->getCanonicalDecl()).second)
+    return;
+  m_Derivatives.push_back(FD);
+}
+
+bool DerivativeLibrary::Write() {
+  SourceManager& SM = m_CI.getSourceManager();
+  DiagnosticsEngine& Diags = m_CI.getDiagnostics();
+  FileID mainFID = SM.getMainFileID();
+
+  // The include directives of the main file provide the declarations used by
+  // the derivatives.
+  llvm::SetVector<std::string> includes;
+  llvm::StringRef mainPath = SM.getFilename(SM.getLocForStartOfFile(mainFID));
+  llvm::StringRef mainDir = llvm::sys::path::parent_path(mainPath);
+  if (mainDir.empty())
+    mainDir = ".";
+  bool invalid = false;
+  llvm::StringRef mainBuffer = SM.getBufferData(mainFID, &invalid);
+  for (unsigned i = 0, e = SM.local_sloc_entry_size(); !invalid && i < e;
+       ++i) {
+    const SrcMgr::SLocEntry& entry = SM.getLocalSLocEntry(i);
+    if (!entry.isFile())
+      continue;
+    SourceLocation includeLoc = entry.getFile().getIncludeLoc();
+    if (includeLoc.isInvalid())
+      continue;
+    includeLoc = SM.getExpansionLoc(includeLoc);
+    std::pair<FileID, unsigned> decomposed = SM.getDecomposedLoc(includeLoc);
+    if (decomposed.first != mainFID)
+      continue;
+    size_t begin = mainBuffer.rfind('\n', decomposed.second);
+    begin = begin == llvm::StringRef::npos ? 0 : begin + 1;
+    llvm::StringRef line =
+        mainBuffer.slice(begin, mainBuffer.find('\n', begin)).trim();
+    if (!line.empty() && line.front() == '#')
+      includes.insert(ResolveInclude(line, mainDir));
+  }
+
+  unsigned skippedID = Diags.getCustomDiagID(
+      DiagnosticsEngine::Warning,
+      "derivative '%0' is not added to the derivative library: %1");
+  llvm::SmallVector<const FunctionDecl*, 16> derivatives;
+  llvm::SetVector<const FunctionDecl*> mainFileFns;
+  for (const FunctionDecl* FD : m_Derivatives) {
+    llvm::SmallVector<llvm::StringRef, 4> namespaces;
+    if (!GetEnclosingNamespaces(FD, namespaces)) {
+      Diags.Report(FD->getLocation(), skippedID)
+          << FD->getNameAsString()
+          << "it is a class member or in an anonymous namespace";
+      continue;
+    }
+    if (!FD->isExternallyVisible()) {
+      Diags.Report(FD->getLocation(), skippedID)
+          << FD->getNameAsString() << "it has internal linkage";
+      continue;
+    }
+    MainFileDepsCollector fnDeps(SM, m_Seen);
+    fnDeps.TraverseDecl(const_cast<FunctionDecl*>(FD));
+    if (!fnDeps.Unsupported.empty()) {
+      Diags.Report(FD->getLocation(), skippedID)
+          << FD->getNameAsString()
+          << "it uses '" + fnDeps.Unsupported.front()->getNameAsString() +
+                 "' declared in the main file";
+      continue;
+    }
+    mainFileFns.insert(fnDeps.Functions.begin(), fnDeps.Functions.end());
+    derivatives.push_back(FD);
+  }
+
+  clang::LangOptions LangOpts;
+  LangOpts.CPlusPlus = true;
+  clang::PrintingPolicy Policy(LangOpts);
+  Policy.Bool = true;
+  clang::PrintingPolicy DeclPolicy(Policy);
+  DeclPolicy.TerseOutput = true;
+
+  // Files with the same name in different directories get different
+  // libraries.
+  llvm::SmallString<128> absMainPath(mainPath);
+  llvm::sys::fs::make_absolute(absMainPath);
+  llvm::sys::path::remove_dots(absMainPath, /*remove_dot_dot=*/true);
+  std::string name;
+  llvm::raw_string_ostream NOS(name);
+  NOS << llvm::sys::path::stem(mainPath) << "_"
+      << llvm::format_hex_no_prefix(
+             llvm::xxHash64(absMainPath.str()) & 0xffffffff, 8)
+      << "_derivatives";
+  NOS.flush();
+  std::string guard =
+      "CLAD_" + llvm::StringRef(ToIdentifier(name)).upper() + "_H";
+  std::unique_ptr<MangleContext> MC(
+      m_CI.getASTContext().createMangleContext());
+
+  std::string header;
+  llvm::raw_string_ostream HOS(header);
+  HOS << "// Derivatives generated by clad for " << mainPath << ".\n"
+      << "#ifndef " << guard << "\n#define " << guard << "\n\n";
+  for (const std::string& include : includes)
+    HOS << include << "\n";
+  HOS << "\n";
+  for (const FunctionDecl* FD : mainFileFns)
+    PrintInNamespaces(HOS, FD, DeclPolicy, /*declarationOnly=*/true);
+  for (const FunctionDecl* FD : derivatives)
+    PrintInNamespaces(HOS, FD, DeclPolicy, /*declarationOnly=*/true,
+                      /*asInline=*/true);
+  // The derivatives are defined inline, so that the libraries of several
+  // translation units can be linked together. A derivative appearing in more
+  // than one library is defined by the first one included.
+  for (const FunctionDecl* FD : derivatives) {
+    std::string defGuard = GetDefinitionGuard(*MC, FD);
+    HOS << "\n#ifndef " << defGuard << "\n#define " << defGuard << "\n";
+    PrintInNamespaces(HOS, FD, Policy, /*declarationOnly=*/false,
+                      /*asInline=*/true);
+    HOS << "#endif\n";
+  }
+  HOS << "\n#endif // " << guard << "\n";
+  HOS.flush();
+
+  unsigned failedID = Diags.getCustomDiagID(
+      DiagnosticsEngine::Error, "cannot write the derivative library to '%0'");
+  llvm::SmallString<128> headerPath(m_OutputDir);
+  llvm::sys::path::append(headerPath, name + ".h");
+  if (llvm::sys::fs::create_directories(m_OutputDir) ||
+      !WriteAtomically(headerPath, header)) {
+    Diags.Report(failedID) << m_OutputDir;
+    return false;
+  }
+  return true;
+}
+} // namespace plugin
+} // namespace clad
@@ -0,0 +1,57 @@
+//--------------------------------------------------------------------*- C++ -*-
+// clad - the C++ Clang-based Automatic Differentiator
+// version: $Id$
+// author:  Vassil Vassilev <vvasilev-at-cern.ch>
+//------------------------------------------------------------------------------
+
+#ifndef CLAD_DERIVATIVE_LIBRARY_H
+#define CLAD_DERIVATIVE_LIBRARY_H
+
+#include "llvm/ADT/SmallPtrSet.h"
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/ADT/StringRef.h"
+
+#include <string>
+
+namespace clang {
+class CompilerInstance;
+class FunctionDecl;
+} // namespace clang
+
+namespace clad {
+namespace plugin {
+/// Writes the derivatives produced for a translation unit into a header-only
+/// library which can be compiled without the plugin. For an input
+/// `dir/foo.cpp`, it produces `foo_<hash>_derivatives.h` in the output
+/// directory, where `<hash>` is a hash of the absolute path of the input. The
+/// header contains the include directives of `foo.cpp`, declarations of the
+/// functions of `foo.cpp` used by the derivatives and inline definitions of
+/// the derivatives.
+///
+/// Each derivative is written once and its definition is guarded by a macro
+/// named after its mangled name, so that the headers of several translation
+/// units can be included together. The file is replaced atomically, so
+/// concurrent compilations never observe a partially written file.
+class DerivativeLibrary {
+  clang::CompilerInstance& m_CI;
+  std::string m_OutputDir;
+  /// The derivatives with a body, in the order they were produced.
+  llvm::SmallVector<const clang::FunctionDecl*, 16> m_Derivatives;
+  llvm::SmallPtrSet<const clang::FunctionDecl*, 16> m_Seen;
+
+public:
+  DerivativeLibrary(clang::CompilerInstance& CI, llvm::StringRef outputDir)
+      : m_CI(CI), m_OutputDir(outputDir) {}
+
+  /// Records a derivative produced by clad. Declarations without a body and
+  /// derivatives which were already recorded are ignored.
+  void Add(const clang::FunctionDecl* FD);
+
+  /// Writes the header of the library.
+  /// \returns false if the file could not be written.
+  bool Write();
+};
+} // namespace plugin
+} // namespace clad
+
+#endif // CLAD_DERIVATIVE_LIBRARY_H